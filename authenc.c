@@ -40,6 +40,7 @@
 #include <linux/uaccess.h>
 #include <crypto/cryptodev.h>
 #include <crypto/scatterwalk.h>
+#include <asm/unaligned.h>
 #include <linux/scatterlist.h>
 #include "cryptodev_int.h"
 #include "zc.h"
@@ -47,6 +48,31 @@
 #include "cryptlib.h"
 #include "version.h"
 
+/* modes that take their nonce and sequence number from the session */
+#define COP_FLAG_RECORD_MODES	(COP_FLAG_AEAD_TLS13_TYPE | \
+				 COP_FLAG_AEAD_TLS12_GCM_TYPE | \
+				 COP_FLAG_AEAD_ESP_TYPE)
+
+#define TLS_HEADER_SIZE			5
+#define TLS_CONTENT_APPLICATION_DATA	23
+#define TLS_MAC_HEADER_SIZE		13
+#define DTLS_HEADER_SIZE		13
+#define DTLS_SEQ_OFFSET			3
+#define DTLS_SEQ_MASK			((1ULL << 48) - 1)
+#define TLS13_TAG_SIZE			16
+#define TLS13_MAX_PLAINTEXT		(1 << 14)
+#define TLS13_MAX_CIPHERTEXT		((1 << 14) + 256)
+#define TLS12_GCM_SALT_SIZE		4
+#define TLS12_GCM_EXPLICIT_SIZE		8
+#define TLS12_GCM_TAG_SIZE		16
+#define TLS12_GCM_AAD_SIZE		13
+#define TLS12_MAX_PLAINTEXT		(1 << 14)
+#define TLS12_MAX_CIPHERTEXT		((1 << 14) + 2048)
+#define ESP_HEADER_SIZE			8
+#define ESP_GCM_IV_SIZE			8
+#define ESP_TRAILER_SIZE		2
+#define TLS_BATCH_MAX_RECORDS		64
+
 
 /* make caop->dst available in scatterlist.
  * (caop->src is assumed to be equal to caop->dst)
@@ -77,9 +103,11 @@ static int get_userbuf_tls(struct csession *ses, struct kernel_crypt_auth_op *kc
 	ses->used_pages = pagecount;
 	ses->readonly_pages = 0;
 
-	rc = adjust_sg_array(ses, pagecount);
-	if (rc)
-		return rc;
+	if (pagecount > ses->array_size) {
+		rc = adjust_sg_array(ses, pagecount);
+		if (rc)
+			return rc;
+	}
 
 	rc = __get_userbuf(caop->dst, kcaop->dst_len, 1, pagecount,
 	                   ses->pages, ses->sg, kcaop->task, kcaop->mm);
@@ -94,13 +122,11 @@ static int get_userbuf_tls(struct csession *ses, struct kernel_crypt_auth_op *kc
 }
 
 
-#define MAX_SRTP_AUTH_DATA_DIFF 256
-
 /* Makes caop->auth_src available as scatterlist.
  * It also provides a pointer to caop->dst, which however,
  * is assumed to be within the caop->auth_src buffer. If not
- * (if their difference exceeds MAX_SRTP_AUTH_DATA_DIFF) it
- * returns error.
+ * it returns error. With AEAD ciphers the tag follows the
+ * encrypted data, so it is mapped as well.
  */
 static int get_userbuf_srtp(struct csession *ses, struct kernel_crypt_auth_op *kcaop,
 			struct scatterlist **auth_sg, struct scatterlist **dst_sg)
@@ -108,6 +134,7 @@ static int get_userbuf_srtp(struct csession *ses, struct kernel_crypt_auth_op *k
 	int pagecount, diff;
 	int auth_pagecount = 0;
 	struct crypt_auth_op *caop = &kcaop->caop;
+	uint32_t map_len;
 	int rc;
 
 	if (caop->dst == NULL && caop->auth_src == NULL) {
@@ -132,13 +159,17 @@ static int get_userbuf_srtp(struct csession *ses, struct kernel_crypt_auth_op *k
 	/* Note that in SRTP auth data overlap with data to be encrypted (dst)
          */
 
-	auth_pagecount = PAGECOUNT(caop->auth_src, caop->auth_len);
 	diff = (int)(caop->src - caop->auth_src);
-	if (diff > MAX_SRTP_AUTH_DATA_DIFF || diff < 0) {
+	if (diff > caop->auth_len || diff < 0) {
 		dwarning(1, "auth_src must overlap with src (diff: %d).", diff);
 		return -EINVAL;
 	}
 
+	map_len = caop->auth_len;
+	if (ses->cdata.aead)
+		map_len += caop->tag_len;
+	auth_pagecount = PAGECOUNT(caop->auth_src, map_len);
+
 	pagecount = auth_pagecount;
 
 	rc = adjust_sg_array(ses, pagecount*2); /* double pages to have pages for dst(=auth_src) */
@@ -147,7 +178,7 @@ static int get_userbuf_srtp(struct csession *ses, struct kernel_crypt_auth_op *k
 		return rc;
 	}
 
-	rc = __get_userbuf(caop->auth_src, caop->auth_len, 1, auth_pagecount,
+	rc = __get_userbuf(caop->auth_src, map_len, 1, auth_pagecount,
 			   ses->pages, ses->sg, kcaop->task, kcaop->mm);
 	if (unlikely(rc)) {
 		derr(1, "failed to get user pages for data input");
@@ -161,7 +192,7 @@ static int get_userbuf_srtp(struct csession *ses, struct kernel_crypt_auth_op *k
 
 	(*dst_sg) = ses->sg + auth_pagecount;
 	sg_init_table(*dst_sg, auth_pagecount);
-	sg_copy(ses->sg, (*dst_sg), caop->auth_len);
+	sg_copy(ses->sg, (*dst_sg), map_len);
 	(*dst_sg) = sg_advance(*dst_sg, diff);
 	if (*dst_sg == NULL) {
 		release_user_pages(ses);
@@ -172,6 +203,162 @@ static int get_userbuf_srtp(struct csession *ses, struct kernel_crypt_auth_op *k
 	return 0;
 }
 
+/* Makes the ESP packet at caop->dst available as scatterlist, twice: from
+ * its start, for the ICV, and from its encrypted part.
+ */
+static int get_userbuf_esp(struct csession *ses, struct kernel_crypt_auth_op *kcaop,
+			struct scatterlist **dst_sg, struct scatterlist **data_sg,
+			uint32_t offset)
+{
+	struct crypt_auth_op *caop = &kcaop->caop;
+	int pagecount;
+	int rc;
+
+	if (caop->dst == NULL || kcaop->dst_len <= offset) {
+		dwarning(1, "invalid ESP packet");
+		return -EINVAL;
+	}
+
+	pagecount = PAGECOUNT(caop->dst, kcaop->dst_len);
+
+	rc = adjust_sg_array(ses, pagecount * 2);
+	if (rc) {
+		derr(1, "cannot adjust sg array");
+		return rc;
+	}
+
+	rc = __get_userbuf(caop->dst, kcaop->dst_len, 1, pagecount,
+			   ses->pages, ses->sg, kcaop->task, kcaop->mm);
+	if (unlikely(rc)) {
+		derr(1, "failed to get user pages for data input");
+		return -EINVAL;
+	}
+
+	ses->used_pages = pagecount;
+	ses->readonly_pages = 0;
+
+	(*dst_sg) = ses->sg;
+
+	(*data_sg) = ses->sg + pagecount;
+	sg_init_table(*data_sg, pagecount);
+	sg_copy(ses->sg, (*data_sg), kcaop->dst_len);
+	(*data_sg) = sg_advance(*data_sg, offset);
+
+	return 0;
+}
+
+/* Auth data up to that size are copied to a buffer cached in the session.
+ * Larger ones are mapped from userspace, which avoids the copy as well as
+ * any size limit.
+ */
+#define MAX_COPY_AUTH_DATA 512
+
+/* Returns the session's auth buffer of MAX_COPY_AUTH_DATA bytes */
+static unsigned char *session_auth_buf(struct csession *ses)
+{
+	if (unlikely(!ses->auth_buf)) {
+		ses->auth_buf = kmalloc(MAX_COPY_AUTH_DATA, GFP_KERNEL);
+		if (unlikely(!ses->auth_buf))
+			derr(1, "unable to allocate auth buffer.");
+	}
+
+	return ses->auth_buf;
+}
+
+/* Copies caop->auth_src to the session's auth buffer, or to a newly
+ * allocated one if they don't fit. The caller frees the latter.
+ */
+static int copy_auth_data(struct csession *ses, struct crypt_auth_op *caop,
+			  unsigned char **auth_buf)
+{
+	unsigned char *buf;
+
+	if (caop->auth_len <= MAX_COPY_AUTH_DATA) {
+		buf = session_auth_buf(ses);
+		if (unlikely(!buf))
+			return -ENOMEM;
+	} else {
+		buf = kmalloc(caop->auth_len, GFP_KERNEL);
+		if (unlikely(!buf)) {
+			derr(1, "unable to allocate %u bytes for auth data.",
+			     caop->auth_len);
+			return -ENOMEM;
+		}
+	}
+
+	if (unlikely(copy_from_user(buf, caop->auth_src, caop->auth_len))) {
+		derr(1, "unable to copy auth data from userspace.");
+		if (buf != ses->auth_buf)
+			kfree(buf);
+		return -EFAULT;
+	}
+
+	*auth_buf = buf;
+	return 0;
+}
+
+/* Makes sure the session's arrays can hold the pages of an in-place
+ * operation plus extra entries.
+ */
+static int reserve_sg_array(struct csession *ses,
+			    struct kernel_crypt_auth_op *kcaop, int extra)
+{
+	struct crypt_auth_op *caop = &kcaop->caop;
+	int pagecount;
+
+	pagecount = PAGECOUNT(caop->dst, max_t(uint32_t, caop->len, kcaop->dst_len));
+	if (pagecount + extra <= ses->array_size)
+		return 0;
+
+	return adjust_sg_array(ses, pagecount + extra);
+}
+
+/* Maps caop->auth_src (read-only) right after the pages already in use.
+ * The space must have been reserved with reserve_sg_array().
+ */
+static int get_userbuf_auth(struct csession *ses, struct kernel_crypt_auth_op *kcaop,
+			    int auth_pagecount, struct scatterlist **auth_sg)
+{
+	struct crypt_auth_op *caop = &kcaop->caop;
+	int rc;
+
+	if (unlikely(ses->used_pages + auth_pagecount + 1 > ses->array_size)) {
+		derr(1, "no room for auth data pages");
+		return -EINVAL;
+	}
+
+	rc = __get_userbuf(caop->auth_src, caop->auth_len, 0, auth_pagecount,
+			   ses->pages + ses->used_pages, ses->sg + ses->used_pages,
+			   kcaop->task, kcaop->mm);
+	if (unlikely(rc)) {
+		derr(1, "failed to get user pages for auth data");
+		return -EINVAL;
+	}
+
+	*auth_sg = ses->sg + ses->used_pages;
+	ses->used_pages += auth_pagecount;
+
+	return 0;
+}
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 3, 0))
+/* Since 4.3 the AEAD API expects the auth data in front of the data, in
+ * both the source and destination lists. auth_sg must have a spare entry
+ * after its auth_nents ones to hold the link.
+ */
+static struct scatterlist *chain_auth_sg(struct scatterlist *auth_sg,
+					 int auth_nents, struct scatterlist *sg)
+{
+	if (sg == NULL)
+		return auth_sg;
+
+	sg_unmark_end(&auth_sg[auth_nents - 1]);
+	sg_chain(auth_sg, auth_nents + 1, sg);
+
+	return auth_sg;
+}
+#endif
+
 /*
  * Return tag (digest) length for authenticated encryption
  * If the cipher and digest are separate, hdata.init is set - just return
@@ -185,6 +372,20 @@ static int cryptodev_get_tag_len(struct csession *ses_ptr)
 		return cryptodev_cipher_get_tag_size(&ses_ptr->cdata);
 }
 
+static unsigned int esp_iv_size(struct csession *ses_ptr)
+{
+	return ses_ptr->cdata.aead ? ESP_GCM_IV_SIZE : ses_ptr->cdata.ivsize;
+}
+
+/* the padding aligns the encrypted part to the block size and the ICV
+ * to 4 bytes */
+static unsigned int esp_pad_size(struct csession *ses_ptr, uint32_t len)
+{
+	unsigned int align = max_t(unsigned int, ses_ptr->cdata.blocksize, 4);
+
+	return (align - (len + ESP_TRAILER_SIZE) % align) % align;
+}
+
 /*
  * Calculate destination buffer length for authenticated encryption. The
  * expectation is that user-space code allocates exactly the same space for
@@ -196,18 +397,182 @@ static int cryptodev_get_dst_len(struct crypt_auth_op *caop, struct csession *se
 	if (caop->op == COP_DECRYPT)
 		return dst_len;
 
+	/* TLS 1.3 appends the content type */
+	if (caop->flags & COP_FLAG_AEAD_TLS13_TYPE)
+		return dst_len + 1 + TLS13_TAG_SIZE;
+
+	/* TLS 1.2 GCM prepends the explicit nonce */
+	if (caop->flags & COP_FLAG_AEAD_TLS12_GCM_TYPE)
+		return TLS12_GCM_EXPLICIT_SIZE + dst_len + TLS12_GCM_TAG_SIZE;
+
+	if (caop->flags & COP_FLAG_AEAD_ESP_TYPE)
+		return ESP_HEADER_SIZE + esp_iv_size(ses_ptr) + dst_len +
+		       esp_pad_size(ses_ptr, dst_len) + ESP_TRAILER_SIZE +
+		       caop->tag_len;
+
 	dst_len += caop->tag_len;
 
 	/* for TLS always add some padding so the total length is rounded to
-	 * cipher block size */
+	 * cipher block size; with encrypt-then-MAC the tag follows it */
 	if (caop->flags & COP_FLAG_AEAD_TLS_TYPE) {
 		int bs = ses_ptr->cdata.blocksize;
-		dst_len += bs - (dst_len % bs);
+		if (caop->flags & COP_FLAG_TLS_ETM)
+			dst_len += bs - (caop->len % bs);
+		else
+			dst_len += bs - (dst_len % bs);
 	}
 
 	return dst_len;
 }
 
+#define RTP_HEADER_SIZE		12
+#define RTP_VERSION		2
+
+/* Locates the payload of an SRTP packet whose IV the kernel derives. The
+ * packet is auth_src (without the tag) and the payload follows the RTP
+ * header, its CSRCs and its extension, if any. The tag follows the packet.
+ */
+static int srtp_parse_header(struct csession *ses_ptr,
+			     struct kernel_crypt_auth_op *kcaop)
+{
+	struct crypt_auth_op *caop = &kcaop->caop;
+	uint8_t hdr[RTP_HEADER_SIZE];
+	uint32_t hdr_len;
+
+	if (unlikely(caop->auth_len < RTP_HEADER_SIZE)) {
+		derr(1, "SRTP packet too short: %u", caop->auth_len);
+		return -EINVAL;
+	}
+
+	if (unlikely(copy_from_user(hdr, caop->auth_src, RTP_HEADER_SIZE)))
+		return -EFAULT;
+
+	if (unlikely(hdr[0] >> 6 != RTP_VERSION)) {
+		derr(1, "not an RTP packet");
+		return -EINVAL;
+	}
+
+	hdr_len = RTP_HEADER_SIZE + 4 * (hdr[0] & 0x0f);
+	if (hdr[0] & 0x10) {
+		uint8_t ext[4];
+
+		if (unlikely(hdr_len + sizeof(ext) > caop->auth_len ||
+			     copy_from_user(ext, caop->auth_src + hdr_len,
+					    sizeof(ext)))) {
+			derr(1, "invalid RTP header extension");
+			return -EINVAL;
+		}
+		hdr_len += sizeof(ext) + 4 * get_unaligned_be16(ext + 2);
+	}
+
+	if (unlikely(hdr_len > caop->auth_len)) {
+		derr(1, "RTP header exceeds the packet");
+		return -EINVAL;
+	}
+
+	kcaop->srtp_seq = get_unaligned_be16(hdr + 2);
+	kcaop->srtp_ssrc = get_unaligned_be32(hdr + 8);
+
+	caop->src = caop->dst = caop->auth_src + hdr_len;
+	caop->len = caop->auth_len - hdr_len;
+	if (ses_ptr->cdata.aead) {
+		if (caop->op == COP_DECRYPT)
+			caop->len += caop->tag_len;
+	} else {
+		caop->tag = caop->auth_src + caop->auth_len;
+	}
+	kcaop->ivlen = ses_ptr->cdata.ivsize;
+
+	return 0;
+}
+
+/* Derives the IV of an SRTP packet from the session salt, the SSRC and
+ * the packet index, estimating the rollover counter as in RFC 3711,
+ * appendix A. The stream's state is only updated by srtp_stream_update(),
+ * once the packet is authenticated.
+ */
+static int srtp_stream_iv(struct csession *ses_ptr,
+			  struct kernel_crypt_auth_op *kcaop,
+			  struct srtp_stream **stream)
+{
+	struct cipher_data *cdata = &ses_ptr->cdata;
+	struct srtp_stream *s, *unused = NULL;
+	uint16_t seq = kcaop->srtp_seq;
+	uint32_t roc;
+	uint8_t *iv = kcaop->iv;
+	int i;
+
+	if (unlikely(!ses_ptr->record.enabled ||
+		     ses_ptr->record.iv_len != (cdata->aead ? 12 : 14) ||
+		     cdata->ivsize != (cdata->aead ? 12 : 16))) {
+		derr(1, "SRTP needs the session salt, see CIOCRECORD");
+		return -EINVAL;
+	}
+
+	*stream = NULL;
+	for (i = 0; i < SRTP_MAX_STREAMS; i++) {
+		s = &ses_ptr->record.srtp[i];
+		if (!s->valid) {
+			if (!unused)
+				unused = s;
+		} else if (s->ssrc == kcaop->srtp_ssrc) {
+			*stream = s;
+			break;
+		}
+	}
+
+	if (*stream) {
+		s = *stream;
+		roc = s->roc;
+		if (s->seq < 32768) {
+			if (seq - s->seq > 32768)
+				roc--;
+		} else if (s->seq - 32768 > seq) {
+			roc++;
+		}
+	} else if (unused) {
+		*stream = unused;
+		roc = 0;
+	} else {
+		derr(1, "too many SRTP streams in session");
+		return -ENOSPC;
+	}
+	kcaop->srtp_roc = roc;
+
+	memset(iv, 0, cdata->ivsize);
+	if (cdata->aead) {
+		/* RFC 7714: (0 || SSRC || ROC || SEQ) XOR salt */
+		put_unaligned_be32(kcaop->srtp_ssrc, iv + 2);
+		put_unaligned_be32(roc, iv + 6);
+		put_unaligned_be16(seq, iv + 10);
+	} else {
+		/* RFC 3711: salt * 2^16 XOR SSRC * 2^64 XOR index * 2^16 */
+		put_unaligned_be32(kcaop->srtp_ssrc, iv + 4);
+		put_unaligned_be32(roc, iv + 8);
+		put_unaligned_be16(seq, iv + 12);
+	}
+	for (i = 0; i < ses_ptr->record.iv_len; i++)
+		iv[i] ^= ses_ptr->record.iv[i];
+
+	return 0;
+}
+
+static void srtp_stream_update(struct srtp_stream *s,
+			       struct kernel_crypt_auth_op *kcaop)
+{
+	if (!s->valid) {
+		s->ssrc = kcaop->srtp_ssrc;
+		s->roc = kcaop->srtp_roc;
+		s->seq = kcaop->srtp_seq;
+		s->valid = 1;
+	} else if (kcaop->srtp_roc == s->roc + 1) {
+		s->roc = kcaop->srtp_roc;
+		s->seq = kcaop->srtp_seq;
+	} else if (kcaop->srtp_roc == s->roc && kcaop->srtp_seq > s->seq) {
+		s->seq = kcaop->srtp_seq;
+	}
+}
+
 static int fill_kcaop_from_caop(struct kernel_crypt_auth_op *kcaop, struct fcrypt *fcr)
 {
 	struct crypt_auth_op *caop = &kcaop->caop;
@@ -221,7 +586,8 @@ static int fill_kcaop_from_caop(struct kernel_crypt_auth_op *kcaop, struct fcryp
 		return -EINVAL;
 	}
 
-	if (caop->flags & COP_FLAG_AEAD_TLS_TYPE || caop->flags & COP_FLAG_AEAD_SRTP_TYPE) {
+	if (caop->flags & (COP_FLAG_AEAD_TLS_TYPE | COP_FLAG_AEAD_SRTP_TYPE |
+			   COP_FLAG_RECORD_MODES)) {
 		if (caop->src != caop->dst) {
 			derr(1, "Non-inplace encryption and decryption is not efficient and not implemented");
 			ret = -EINVAL;
@@ -229,15 +595,34 @@ static int fill_kcaop_from_caop(struct kernel_crypt_auth_op *kcaop, struct fcryp
 		}
 	}
 
-	if (caop->tag_len == 0)
+	if (caop->tag_len == 0) {
 		caop->tag_len = cryptodev_get_tag_len(ses_ptr);
+		/* ESP truncates the HMAC to half its size (RFC 4868) */
+		if (caop->flags & COP_FLAG_AEAD_ESP_TYPE && ses_ptr->hdata.init)
+			caop->tag_len /= 2;
+	}
 
 	kcaop->ivlen = caop->iv ? ses_ptr->cdata.ivsize : 0;
+
+	/* SRTP packets without an IV get one from the session's salt */
+	kcaop->srtp_kernel_iv = (caop->flags & COP_FLAG_AEAD_SRTP_TYPE) &&
+				!caop->iv && ses_ptr->record.enabled;
+	if (kcaop->srtp_kernel_iv) {
+		ret = srtp_parse_header(ses_ptr, kcaop);
+		if (unlikely(ret))
+			goto out_unlock;
+	}
+
+	/* the record modes make their own nonces */
+	kcaop->iv_generated = !(caop->flags & COP_FLAG_RECORD_MODES) &&
+			      !kcaop->srtp_kernel_iv &&
+			      crypto_iv_generated(ses_ptr, caop->op);
 	kcaop->dst_len = cryptodev_get_dst_len(caop, ses_ptr);
 	kcaop->task = current;
 	kcaop->mm = current->mm;
 
-	if (caop->iv) {
+	/* the IV is filled in by crypto_auth_run() */
+	if (caop->iv && !kcaop->iv_generated) {
 		ret = copy_from_user(kcaop->iv, caop->iv, kcaop->ivlen);
 		if (unlikely(ret)) {
 			derr(1, "error copying IV (%d bytes), copy_from_user returned %d for address %p",
@@ -261,7 +646,8 @@ static int fill_caop_from_kcaop(struct kernel_crypt_auth_op *kcaop, struct fcryp
 
 	kcaop->caop.len = kcaop->dst_len;
 
-	if (kcaop->ivlen && kcaop->caop.flags & COP_FLAG_WRITE_IV) {
+	if (kcaop->ivlen && !kcaop->srtp_kernel_iv &&
+	    (kcaop->caop.flags & COP_FLAG_WRITE_IV || kcaop->iv_generated)) {
 		ret = copy_to_user(kcaop->caop.iv,
 				kcaop->iv, kcaop->ivlen);
 		if (unlikely(ret)) {
@@ -348,6 +734,54 @@ static int verify_tls_record_pad(struct scatterlist *dst_sg, int len, int block_
 	return pad_size + 1;
 }
 
+/* Without a fused transform, large records are hashed and encrypted (or
+ * decrypted and hashed) in chunks of cryptodev_chunk_size bytes, each one
+ * while it is still in the cache, rather than read twice in full. The size
+ * is rounded to whole cipher blocks; UINT_MAX processes the record at once.
+ * Each chunk continues from the IV that the previous one left in the
+ * request, which only CBC and CTR write back; other ciphers, chacha20 among
+ * them, would start over with the same keystream.
+ */
+static uint32_t authenc_chunk_size(struct csession *ses_ptr)
+{
+	uint32_t chunk = round_down(cryptodev_chunk_size, EALG_MAX_BLOCK_LEN);
+
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(4, 2, 0))
+	/* no scatterwalk_ffwd() */
+	chunk = 0;
+#endif
+	if (chunk == 0 || ses_ptr->cdata.init == 0 || ses_ptr->hdata.init == 0)
+		return UINT_MAX;
+	if (ses_ptr->mode != CIPHER_MODE_CBC && ses_ptr->mode != CIPHER_MODE_CTR)
+		return UINT_MAX;
+	return chunk;
+}
+
+/* Returns sg starting offset bytes in; tmp holds the entries it needs. */
+static struct scatterlist *sg_chunk(struct scatterlist tmp[2],
+				    struct scatterlist *sg, uint32_t offset)
+{
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 2, 0))
+	if (offset)
+		return scatterwalk_ffwd(tmp, sg, offset);
+#endif
+	return sg;
+}
+
+static int hash_chunk(struct csession *ses_ptr, struct scatterlist *sg,
+		      uint32_t len)
+{
+	int ret;
+
+	if (len == 0)
+		return 0;
+
+	ret = cryptodev_hash_update(&ses_ptr->hdata, sg, len);
+	if (unlikely(ret))
+		derr(0, "cryptodev_hash_update: %d", ret);
+	return ret;
+}
+
 /* Authenticate and encrypt the TLS way (also perform padding).
  * During decryption it verifies the pad and tag and returns -EBADMSG on error.
  */
@@ -360,29 +794,56 @@ tls_auth_n_crypt(struct csession *ses_ptr, struct kernel_crypt_auth_op *kcaop,
 	struct crypt_auth_op *caop = &kcaop->caop;
 	uint8_t vhash[AALG_MAX_RESULT_LEN];
 	uint8_t hash_output[AALG_MAX_RESULT_LEN];
+	uint32_t chunk = authenc_chunk_size(ses_ptr);
+	struct scatterlist tmp[2], *sg;
+	uint32_t done = 0, tail;
+
+	if (ses_ptr->hdata.init != 0) {
+		ret = hash_chunk(ses_ptr, auth_sg, auth_len);
+		if (unlikely(ret))
+			return ret;
+	}
 
-	/* TLS authenticates the plaintext except for the padding.
+	/* TLS authenticates the plaintext except for the padding. On
+	 * decryption the chunks that may hold the MAC or the padding are
+	 * left for the end.
 	 */
-	if (caop->op == COP_ENCRYPT) {
-		if (ses_ptr->hdata.init != 0) {
-			if (auth_len > 0) {
-				ret = cryptodev_hash_update(&ses_ptr->hdata,
-								auth_sg, auth_len);
-				if (unlikely(ret)) {
-					derr(0, "cryptodev_hash_update: %d", ret);
-					return ret;
-				}
-			}
+	tail = caop->op == COP_ENCRYPT ? 0 : caop->tag_len + 256;
+	while (len - done > tail && len - done - tail > chunk) {
+		sg = sg_chunk(tmp, dst_sg, done);
+		if (caop->op == COP_ENCRYPT) {
+			ret = hash_chunk(ses_ptr, sg, chunk);
+			if (unlikely(ret))
+				return ret;
 
-			if (len > 0) {
-				ret = cryptodev_hash_update(&ses_ptr->hdata,
-								dst_sg, len);
-				if (unlikely(ret)) {
-					derr(0, "cryptodev_hash_update: %d", ret);
-					return ret;
-				}
+			ret = cryptodev_cipher_encrypt(&ses_ptr->cdata,
+							sg, sg, chunk);
+			if (unlikely(ret)) {
+				derr(0, "cryptodev_cipher_encrypt: %d", ret);
+				return ret;
+			}
+		} else {
+			ret = cryptodev_cipher_decrypt(&ses_ptr->cdata,
+							sg, sg, chunk);
+			if (unlikely(ret)) {
+				derr(0, "cryptodev_cipher_decrypt: %d", ret);
+				return ret;
 			}
 
+			ret = hash_chunk(ses_ptr, sg, chunk);
+			if (unlikely(ret))
+				return ret;
+		}
+		done += chunk;
+	}
+	sg = sg_chunk(tmp, dst_sg, done);
+
+	if (caop->op == COP_ENCRYPT) {
+		if (ses_ptr->hdata.init != 0) {
+			ret = hash_chunk(ses_ptr, sg, len - done);
+			if (unlikely(ret))
+				return ret;
+
 			ret = cryptodev_hash_final(&ses_ptr->hdata, hash_output);
 			if (unlikely(ret)) {
 				derr(0, "cryptodev_hash_final: %d", ret);
@@ -400,7 +861,7 @@ tls_auth_n_crypt(struct csession *ses_ptr, struct kernel_crypt_auth_op *kcaop,
 			}
 
 			ret = cryptodev_cipher_encrypt(&ses_ptr->cdata,
-							dst_sg, dst_sg, len);
+							sg, sg, len - done);
 			if (unlikely(ret)) {
 				derr(0, "cryptodev_cipher_encrypt: %d", ret);
 				return ret;
@@ -409,7 +870,7 @@ tls_auth_n_crypt(struct csession *ses_ptr, struct kernel_crypt_auth_op *kcaop,
 	} else {
 		if (ses_ptr->cdata.init != 0) {
 			ret = cryptodev_cipher_decrypt(&ses_ptr->cdata,
-							dst_sg, dst_sg, len);
+							sg, sg, len - done);
 
 			if (unlikely(ret)) {
 				derr(0, "cryptodev_cipher_decrypt: %d", ret);
@@ -436,23 +897,10 @@ tls_auth_n_crypt(struct csession *ses_ptr, struct kernel_crypt_auth_op *kcaop,
 			read_tls_hash(dst_sg, len, vhash, caop->tag_len);
 			len -= caop->tag_len;
 
-			if (auth_len > 0) {
-				ret = cryptodev_hash_update(&ses_ptr->hdata,
-								auth_sg, auth_len);
-				if (unlikely(ret)) {
-					derr(0, "cryptodev_hash_update: %d", ret);
-					return ret;
-				}
-			}
-
-			if (len > 0) {
-				ret = cryptodev_hash_update(&ses_ptr->hdata,
-									dst_sg, len);
-				if (unlikely(ret)) {
-					derr(0, "cryptodev_hash_update: %d", ret);
-					return ret;
-				}
-			}
+			/* the chunks hashed above precede the MAC */
+			ret = hash_chunk(ses_ptr, sg, len - done);
+			if (unlikely(ret))
+				return ret;
 
 			ret = cryptodev_hash_final(&ses_ptr->hdata, hash_output);
 			if (unlikely(ret)) {
@@ -470,71 +918,1017 @@ tls_auth_n_crypt(struct csession *ses_ptr, struct kernel_crypt_auth_op *kcaop,
 	return 0;
 }
 
-/* Authenticate and encrypt the SRTP way. During decryption
- * it verifies the tag and returns -EBADMSG on error.
+/* Authenticate and encrypt the TLS way in a single pass, using the
+ * session's fused MAC-then-encrypt transform. The transform does the
+ * padding and verifies it during decryption. auth_sg has auth_nents
+ * entries and a spare one.
  */
 static int
-srtp_auth_n_crypt(struct csession *ses_ptr, struct kernel_crypt_auth_op *kcaop,
-		  struct scatterlist *auth_sg, uint32_t auth_len,
-		  struct scatterlist *dst_sg, uint32_t len)
+tls_auth_n_crypt_fused(struct csession *ses_ptr, struct kernel_crypt_auth_op *kcaop,
+		 struct scatterlist *auth_sg, int auth_nents, uint32_t auth_len,
+		 struct scatterlist *dst_sg, uint32_t len)
 {
-	int ret, fail = 0;
+	struct cipher_data *tdata = &ses_ptr->tdata;
 	struct crypt_auth_op *caop = &kcaop->caop;
-	uint8_t vhash[AALG_MAX_RESULT_LEN];
-	uint8_t hash_output[AALG_MAX_RESULT_LEN];
+	struct scatterlist *sg = dst_sg;
+	uint8_t pad_size;
+	int ret;
 
-	/* SRTP authenticates the encrypted data.
-	 */
-	if (caop->op == COP_ENCRYPT) {
-		if (ses_ptr->cdata.init != 0) {
-			ret = cryptodev_cipher_encrypt(&ses_ptr->cdata,
-							dst_sg, dst_sg, len);
-			if (unlikely(ret)) {
-				derr(0, "cryptodev_cipher_encrypt: %d", ret);
-				return ret;
-			}
-		}
+	if (unlikely(caop->tag_len > ses_ptr->hdata.digestsize)) {
+		derr(1, "Illegal tag len size");
+		return -EINVAL;
+	}
 
-		if (ses_ptr->hdata.init != 0) {
-			if (auth_len > 0) {
-				ret = cryptodev_hash_update(&ses_ptr->hdata,
-								auth_sg, auth_len);
-				if (unlikely(ret)) {
-					derr(0, "cryptodev_hash_update: %d", ret);
-					return ret;
-				}
-			}
+	cryptodev_cipher_set_tag_size(tdata, caop->tag_len);
+	cryptodev_cipher_auth(tdata, auth_sg, auth_len);
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 3, 0))
+	if (auth_sg)
+		sg = chain_auth_sg(auth_sg, auth_nents, dst_sg);
+#endif
 
-			ret = cryptodev_hash_final(&ses_ptr->hdata, hash_output);
-			if (unlikely(ret)) {
-				derr(0, "cryptodev_hash_final: %d", ret);
-				return ret;
-			}
+	/* the IV is kept in the plain cipher's context */
+	cryptodev_cipher_set_iv(tdata, ses_ptr->cdata.async.iv,
+				ses_ptr->cdata.ivsize);
 
-			if (unlikely(copy_to_user(caop->tag, hash_output, caop->tag_len)))
-				return -EFAULT;
+	if (caop->op == COP_ENCRYPT) {
+		ret = cryptodev_cipher_encrypt(tdata, sg, sg, len);
+		if (unlikely(ret)) {
+			derr(0, "cryptodev_cipher_encrypt: %d", ret);
+			return ret;
 		}
 
+		len += caop->tag_len;
+		len += tdata->blocksize - (len % tdata->blocksize);
 	} else {
-		if (ses_ptr->hdata.init != 0) {
-			if (unlikely(caop->tag_len > sizeof(vhash) || caop->tag_len > len)) {
-				derr(1, "Illegal tag len size");
-				return -EINVAL;
-			}
-
-			if (unlikely(copy_from_user(vhash, caop->tag, caop->tag_len)))
-				return -EFAULT;
+		ret = cryptodev_cipher_decrypt(tdata, sg, sg, len);
+		if (unlikely(ret)) {
+			derr(2, "cryptodev_cipher_decrypt: %d", ret);
+			return ret;
+		}
 
-			ret = cryptodev_hash_update(&ses_ptr->hdata,
-							auth_sg, auth_len);
+		scatterwalk_map_and_copy(&pad_size, dst_sg, len - 1, 1, 0);
+		if (unlikely(pad_size + 1 + caop->tag_len > len)) {
+			derr(1, "Pad size: %d", pad_size);
+			return -EBADMSG;
+		}
+		len -= pad_size + 1 + caop->tag_len;
+	}
+
+	cryptodev_cipher_get_iv(tdata, ses_ptr->cdata.async.iv,
+				ses_ptr->cdata.ivsize);
+
+	kcaop->dst_len = len;
+	return 0;
+}
+
+/* Builds the MAC header (sequence number, type, version, length) of a
+ * CBC record from the header given in auth_src. DTLS headers carry the
+ * epoch and sequence number after the version (RFC 6347, section 4.1);
+ * TLS ones are already in MAC order. The length is filled in later.
+ */
+static void tls_mac_header(uint8_t *mac, const uint8_t *hdr, int dtls)
+{
+	if (dtls) {
+		memcpy(mac, hdr + DTLS_SEQ_OFFSET, 8);
+		memcpy(mac + 8, hdr, 3);
+	} else {
+		memcpy(mac, hdr, 11);
+	}
+}
+
+/* The MAC header is followed by the ivlen bytes of the explicit IV, which
+ * encrypt-then-MAC authenticates with the ciphertext.
+ */
+static int tls_record_mac(struct csession *ses_ptr, uint8_t *mac, uint32_t ivlen,
+			  struct scatterlist *dst_sg, uint32_t len, void *result)
+{
+	struct scatterlist mac_sg;
+	int ret;
+
+	sg_init_one(&mac_sg, mac, TLS_MAC_HEADER_SIZE + ivlen);
+	put_unaligned_be16(ivlen + len, mac + 11);
+
+	ret = cryptodev_hash_update(&ses_ptr->hdata, &mac_sg,
+				    TLS_MAC_HEADER_SIZE + ivlen);
+	if (unlikely(ret)) {
+		derr(0, "cryptodev_hash_update: %d", ret);
+		return ret;
+	}
+
+	if (len > 0) {
+		ret = cryptodev_hash_update(&ses_ptr->hdata, dst_sg, len);
+		if (unlikely(ret)) {
+			derr(0, "cryptodev_hash_update: %d", ret);
+			return ret;
+		}
+	}
+
+	ret = cryptodev_hash_final(&ses_ptr->hdata, result);
+	if (unlikely(ret))
+		derr(0, "cryptodev_hash_final: %d", ret);
+	return ret;
+}
+
+/* Authenticate and encrypt CBC records with encrypt-then-MAC (RFC 7366)
+ * or DTLS headers (RFC 6347). The MAC covers the 13-byte MAC header with
+ * the length of the data it is computed over, which the kernel fills in:
+ * the explicit IV, if any, and the ciphertext with encrypt-then-MAC, the
+ * plaintext otherwise. With encrypt-then-MAC the MAC is verified before
+ * anything is decrypted.
+ */
+static int
+tls_record_auth_n_crypt(struct csession *ses_ptr, struct kernel_crypt_auth_op *kcaop,
+			struct scatterlist *dst_sg, uint32_t len)
+{
+	struct crypt_auth_op *caop = &kcaop->caop;
+	int etm = caop->flags & COP_FLAG_TLS_ETM;
+	int dtls = caop->flags & COP_FLAG_DTLS;
+	unsigned int bs = ses_ptr->cdata.blocksize;
+	uint8_t vhash[AALG_MAX_RESULT_LEN];
+	uint8_t hash_output[AALG_MAX_RESULT_LEN];
+	/* the record's explicit IV, none when the IV is chained (TLS 1.0) */
+	uint32_t ivlen = kcaop->ivlen;
+	uint8_t *hdr, *mac;
+	int ret, fail = 0;
+
+	if (unlikely(ses_ptr->cdata.init == 0 || ses_ptr->hdata.init == 0 ||
+		     bs < 2)) {
+		derr(1, "Only CBC ciphers with a MAC are allowed");
+		return -EINVAL;
+	}
+
+	if (unlikely(caop->auth_len != TLS_MAC_HEADER_SIZE)) {
+		derr(1, "invalid TLS header length %u", caop->auth_len);
+		return -EINVAL;
+	}
+
+	if (unlikely(caop->tag_len > ses_ptr->hdata.digestsize)) {
+		derr(1, "Illegal tag len size");
+		return -EINVAL;
+	}
+
+	if (unlikely(dtls && ivlen == 0)) {
+		derr(1, "DTLS records need an explicit IV");
+		return -EINVAL;
+	}
+
+	/* the header and the MAC header share the session buffer */
+	hdr = session_auth_buf(ses_ptr);
+	if (unlikely(!hdr))
+		return -ENOMEM;
+	mac = hdr + 16;
+
+	if (unlikely(copy_from_user(hdr, caop->auth_src, TLS_MAC_HEADER_SIZE)))
+		return -EFAULT;
+	tls_mac_header(mac, hdr, dtls);
+	memcpy(mac + TLS_MAC_HEADER_SIZE, kcaop->iv, ivlen);
+
+	if (caop->op == COP_ENCRYPT) {
+		if (!etm) {
+			ret = tls_record_mac(ses_ptr, mac, 0, dst_sg, len, hash_output);
+			if (unlikely(ret))
+				return ret;
+
+			copy_tls_hash(dst_sg, len, hash_output, caop->tag_len);
+			len += caop->tag_len;
+		}
+
+		len += pad_record(dst_sg, len, bs);
+
+		ret = cryptodev_cipher_encrypt(&ses_ptr->cdata, dst_sg, dst_sg, len);
+		if (unlikely(ret)) {
+			derr(0, "cryptodev_cipher_encrypt: %d", ret);
+			return ret;
+		}
+
+		if (etm) {
+			ret = tls_record_mac(ses_ptr, mac, ivlen, dst_sg, len, hash_output);
+			if (unlikely(ret))
+				return ret;
+
+			copy_tls_hash(dst_sg, len, hash_output, caop->tag_len);
+			len += caop->tag_len;
+		}
+
+		/* the DTLS length is that of the record on the wire */
+		put_unaligned_be16(dtls ? ivlen + len : get_unaligned_be16(mac + 11),
+				   hdr + 11);
+		if (unlikely(copy_to_user(caop->auth_src, hdr, TLS_MAC_HEADER_SIZE)))
+			return -EFAULT;
+	} else {
+		if (unlikely(dtls && get_unaligned_be16(hdr + 11) != ivlen + len)) {
+			derr(1, "DTLS record length mismatch");
+			return -EBADMSG;
+		}
+
+		if (etm) {
+			if (unlikely(len < caop->tag_len + bs ||
+				     (len - caop->tag_len) % bs)) {
+				derr(1, "invalid record length %u", len);
+				return -EBADMSG;
+			}
+
+			read_tls_hash(dst_sg, len, vhash, caop->tag_len);
+			len -= caop->tag_len;
+
+			ret = tls_record_mac(ses_ptr, mac, ivlen, dst_sg, len, hash_output);
+			if (unlikely(ret))
+				return ret;
+
+			if (memcmp(vhash, hash_output, caop->tag_len) != 0) {
+				derr(2, "MAC verification failed (tag_len: %d)", caop->tag_len);
+				return -EBADMSG;
+			}
+		} else if (unlikely(len % bs)) {
+			derr(1, "invalid record length %u", len);
+			return -EBADMSG;
+		}
+
+		ret = cryptodev_cipher_decrypt(&ses_ptr->cdata, dst_sg, dst_sg, len);
+		if (unlikely(ret)) {
+			derr(0, "cryptodev_cipher_decrypt: %d", ret);
+			return ret;
+		}
+
+		ret = verify_tls_record_pad(dst_sg, len, bs);
+		if (unlikely(ret < 0)) {
+			derr(2, "verify_record_pad: %d", ret);
+			if (etm)
+				return ret;
+			/* MtE: keep going so that the MAC is computed anyway */
+			fail = 1;
+		} else {
+			len -= ret;
+		}
+
+		if (!etm) {
+			if (unlikely(caop->tag_len > len)) {
+				derr(1, "Illegal tag len size");
+				return -EBADMSG;
+			}
+
+			read_tls_hash(dst_sg, len, vhash, caop->tag_len);
+			len -= caop->tag_len;
+
+			ret = tls_record_mac(ses_ptr, mac, 0, dst_sg, len, hash_output);
+			if (unlikely(ret))
+				return ret;
+
+			if (memcmp(vhash, hash_output, caop->tag_len) != 0 || fail != 0) {
+				derr(2, "MAC verification failed (tag_len: %d)", caop->tag_len);
+				return -EBADMSG;
+			}
+		}
+	}
+
+	kcaop->dst_len = len;
+	return 0;
+}
+
+/* Checks that a session has the AEAD and static IV of TLS 1.3 records */
+static int tls13_check_session(struct csession *ses_ptr)
+{
+	struct cipher_data *cdata = &ses_ptr->cdata;
+
+	if (unlikely(cdata->aead == 0 || cdata->ivsize < sizeof(u64) ||
+		     ses_ptr->record.iv_len != cdata->ivsize)) {
+		derr(1, "TLS 1.3 needs an AEAD session and its static IV");
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/* Builds the header of a sealed TLS 1.3 record of len bytes of plaintext,
+ * which is also its additional data.
+ */
+static void tls13_header(uint8_t *hdr, uint32_t len)
+{
+	hdr[0] = TLS_CONTENT_APPLICATION_DATA;
+	hdr[1] = 3;
+	hdr[2] = 3;
+	put_unaligned_be16(len + 1 + TLS13_TAG_SIZE, hdr + 3);
+}
+
+/* Builds the nonce of a TLS 1.3 record: the static IV XOR the sequence
+ * number.
+ */
+static void tls13_nonce(struct csession *ses_ptr, u64 seq, uint8_t *nonce)
+{
+	int i, ivsize = ses_ptr->cdata.ivsize;
+
+	memcpy(nonce, ses_ptr->record.iv, ivsize);
+	for (i = 0; i < sizeof(seq); i++)
+		nonce[ivsize - 1 - i] ^= seq >> (8 * i);
+}
+
+/* Seals or opens a TLS 1.3 record in place (RFC 8446, section 5.2). The
+ * nonce is the static IV XOR the sequence number and the record header is
+ * the additional data. On decryption the padding is removed and the inner
+ * content type is returned in the first byte of auth_src.
+ */
+static int
+tls13_auth_n_crypt(struct csession *ses_ptr, struct kernel_crypt_auth_op *kcaop,
+		   struct scatterlist *dst_sg, uint32_t len)
+{
+	struct cipher_data *cdata = &ses_ptr->cdata;
+	struct crypt_auth_op *caop = &kcaop->caop;
+	struct scatterlist hdr_sg[2], *sg = dst_sg;
+	uint8_t nonce[EALG_MAX_BLOCK_LEN];
+	uint8_t *hdr, type;
+	u64 seq;
+	int ret;
+
+	ret = tls13_check_session(ses_ptr);
+	if (unlikely(ret))
+		return ret;
+
+	if (unlikely(caop->auth_len != TLS_HEADER_SIZE)) {
+		derr(1, "invalid TLS header length %u", caop->auth_len);
+		return -EINVAL;
+	}
+
+	hdr = session_auth_buf(ses_ptr);
+	if (unlikely(!hdr))
+		return -ENOMEM;
+
+	if (unlikely(copy_from_user(hdr, caop->auth_src, TLS_HEADER_SIZE)))
+		return -EFAULT;
+
+	caop->tag_len = TLS13_TAG_SIZE;
+	if (caop->op == COP_ENCRYPT) {
+		if (unlikely(len > TLS13_MAX_PLAINTEXT)) {
+			derr(1, "record too large: %u", len);
+			return -EMSGSIZE;
+		}
+
+		type = hdr[0];
+		tls13_header(hdr, len);
+	} else if (unlikely(hdr[0] != TLS_CONTENT_APPLICATION_DATA ||
+			    get_unaligned_be16(hdr + 3) != len ||
+			    len > TLS13_MAX_CIPHERTEXT ||
+			    len < TLS13_TAG_SIZE + 1)) {
+		derr(2, "invalid TLS 1.3 record header");
+		return -EBADMSG;
+	}
+
+	ret = crypto_record_seq(ses_ptr, &seq);
+	if (unlikely(ret))
+		return ret;
+
+	tls13_nonce(ses_ptr, seq, nonce);
+	cryptodev_cipher_set_iv(cdata, nonce, cdata->ivsize);
+
+	sg_init_table(hdr_sg, 2);
+	sg_set_buf(hdr_sg, hdr, TLS_HEADER_SIZE);
+	cryptodev_cipher_set_tag_size(cdata, TLS13_TAG_SIZE);
+	cryptodev_cipher_auth(cdata, hdr_sg, TLS_HEADER_SIZE);
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 3, 0))
+	sg = chain_auth_sg(hdr_sg, 1, dst_sg);
+#endif
+
+	if (caop->op == COP_ENCRYPT) {
+		scatterwalk_map_and_copy(&type, dst_sg, len, 1, 1);
+		len++;
+
+		ret = cryptodev_cipher_encrypt(cdata, sg, sg, len);
+		if (unlikely(ret)) {
+			derr(0, "cryptodev_cipher_encrypt: %d", ret);
+			return ret;
+		}
+		len += TLS13_TAG_SIZE;
+
+		if (unlikely(copy_to_user(caop->auth_src, hdr, TLS_HEADER_SIZE)))
+			return -EFAULT;
+	} else {
+		ret = cryptodev_cipher_decrypt(cdata, sg, sg, len);
+		if (unlikely(ret)) {
+			derr(2, "cryptodev_cipher_decrypt: %d", ret);
+			return ret;
+		}
+		len -= TLS13_TAG_SIZE;
+
+		/* the content type is the last non-zero byte */
+		do {
+			if (unlikely(len == 0)) {
+				derr(2, "TLS 1.3 record without content type");
+				return -EBADMSG;
+			}
+			scatterwalk_map_and_copy(&type, dst_sg, --len, 1, 0);
+		} while (type == 0);
+
+		if (unlikely(copy_to_user(caop->auth_src, &type, 1)))
+			return -EFAULT;
+	}
+
+	kcaop->dst_len = len;
+	return 0;
+}
+
+/* Checks that a session is AES-GCM with the salt of TLS 1.2 records. Other
+ * AEADs with a 12-byte nonce, such as ChaCha20-Poly1305, build it
+ * differently in TLS 1.2.
+ */
+static int tls12_gcm_check_session(struct csession *ses_ptr)
+{
+	if (unlikely(ses_ptr->mode != CIPHER_MODE_GCM ||
+		     ses_ptr->cdata.ivsize != TLS12_GCM_SALT_SIZE + TLS12_GCM_EXPLICIT_SIZE ||
+		     ses_ptr->record.iv_len != TLS12_GCM_SALT_SIZE)) {
+		derr(1, "TLS 1.2 GCM needs an AES-GCM session and its 4-byte salt");
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/* Builds the additional data of a TLS 1.2 GCM record of len bytes of
+ * plaintext: the sequence number, then the type and version from hdr and
+ * the length.
+ */
+static void tls12_gcm_aad(uint8_t *aad, u64 seq, const uint8_t *hdr,
+			  uint32_t len)
+{
+	put_unaligned_be64(seq, aad);
+	memcpy(aad + 8, hdr, 3);
+	put_unaligned_be16(len, aad + 11);
+}
+
+/* Seals or opens a TLS 1.2 AES-GCM record in place (RFC 5288). The record
+ * body is the 8-byte explicit nonce, the data and the tag. The nonce is the
+ * 4-byte salt of the session followed by the explicit nonce, which is the
+ * sequence number when encrypting, and the additional data is the sequence
+ * number, the type, version and length of the plaintext. DTLS records
+ * (RFC 6347) carry the epoch and sequence number in their header, which
+ * is where they are taken from when decrypting.
+ */
+static int
+tls12_gcm_auth_n_crypt(struct csession *ses_ptr, struct kernel_crypt_auth_op *kcaop,
+		       struct scatterlist *dst_sg, uint32_t len)
+{
+	struct cipher_data *cdata = &ses_ptr->cdata;
+	struct crypt_auth_op *caop = &kcaop->caop;
+	struct scatterlist aad_sg[2], *sg;
+	uint8_t nonce[EALG_MAX_BLOCK_LEN];
+	int dtls = caop->flags & COP_FLAG_DTLS;
+	unsigned int hdr_size = dtls ? DTLS_HEADER_SIZE : TLS_HEADER_SIZE;
+	uint8_t *hdr, *aad, *length;
+	u64 seq;
+	int ret;
+
+	ret = tls12_gcm_check_session(ses_ptr);
+	if (unlikely(ret))
+		return ret;
+
+	if (unlikely(caop->auth_len != hdr_size)) {
+		derr(1, "invalid TLS header length %u", caop->auth_len);
+		return -EINVAL;
+	}
+
+	/* the header and the additional data share the session buffer */
+	hdr = session_auth_buf(ses_ptr);
+	if (unlikely(!hdr))
+		return -ENOMEM;
+	aad = hdr + 16;
+	length = hdr + hdr_size - 2;
+
+	if (unlikely(copy_from_user(hdr, caop->auth_src, hdr_size)))
+		return -EFAULT;
+
+	caop->tag_len = TLS12_GCM_TAG_SIZE;
+	if (caop->op == COP_ENCRYPT) {
+		if (unlikely(len > TLS12_MAX_PLAINTEXT)) {
+			derr(1, "record too large: %u", len);
+			return -EMSGSIZE;
+		}
+	} else {
+		if (unlikely(get_unaligned_be16(length) != len ||
+			     len > TLS12_MAX_CIPHERTEXT ||
+			     len < TLS12_GCM_EXPLICIT_SIZE + TLS12_GCM_TAG_SIZE)) {
+			derr(2, "invalid TLS 1.2 GCM record header");
+			return -EBADMSG;
+		}
+		len -= TLS12_GCM_EXPLICIT_SIZE + TLS12_GCM_TAG_SIZE;
+	}
+
+	if (dtls && caop->op == COP_DECRYPT) {
+		seq = get_unaligned_be64(hdr + DTLS_SEQ_OFFSET);
+	} else {
+		ret = crypto_record_seq(ses_ptr, &seq);
+		if (unlikely(ret))
+			return ret;
+	}
+
+	if (dtls && caop->op == COP_ENCRYPT) {
+		/* the 48-bit sequence number must not run into the epoch */
+		if (unlikely((seq & DTLS_SEQ_MASK) == DTLS_SEQ_MASK)) {
+			derr(1, "DTLS sequence number exhausted");
+			return -EOVERFLOW;
+		}
+		put_unaligned_be64(seq, hdr + DTLS_SEQ_OFFSET);
+	}
+
+	memcpy(nonce, ses_ptr->record.iv, TLS12_GCM_SALT_SIZE);
+	if (caop->op == COP_ENCRYPT) {
+		put_unaligned_be64(seq, nonce + TLS12_GCM_SALT_SIZE);
+		scatterwalk_map_and_copy(nonce + TLS12_GCM_SALT_SIZE, dst_sg,
+					 0, TLS12_GCM_EXPLICIT_SIZE, 1);
+	} else {
+		scatterwalk_map_and_copy(nonce + TLS12_GCM_SALT_SIZE, dst_sg,
+					 0, TLS12_GCM_EXPLICIT_SIZE, 0);
+	}
+	cryptodev_cipher_set_iv(cdata, nonce, cdata->ivsize);
+
+	tls12_gcm_aad(aad, seq, hdr, len);
+
+	/* the pages are released through ses_ptr->pages, so the entries
+	 * can be moved past the explicit nonce */
+	sg = dst_sg = sg_advance(dst_sg, TLS12_GCM_EXPLICIT_SIZE);
+
+	sg_init_table(aad_sg, 2);
+	sg_set_buf(aad_sg, aad, TLS12_GCM_AAD_SIZE);
+	cryptodev_cipher_set_tag_size(cdata, TLS12_GCM_TAG_SIZE);
+	cryptodev_cipher_auth(cdata, aad_sg, TLS12_GCM_AAD_SIZE);
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 3, 0))
+	sg = chain_auth_sg(aad_sg, 1, dst_sg);
+#endif
+
+	if (caop->op == COP_ENCRYPT) {
+		ret = cryptodev_cipher_encrypt(cdata, sg, sg, len);
+		if (unlikely(ret)) {
+			derr(0, "cryptodev_cipher_encrypt: %d", ret);
+			return ret;
+		}
+		len += TLS12_GCM_EXPLICIT_SIZE + TLS12_GCM_TAG_SIZE;
+
+		put_unaligned_be16(len, length);
+		if (unlikely(copy_to_user(caop->auth_src, hdr, hdr_size)))
+			return -EFAULT;
+	} else {
+		ret = cryptodev_cipher_decrypt(cdata, sg, sg,
+					       len + TLS12_GCM_TAG_SIZE);
+		if (unlikely(ret)) {
+			derr(2, "cryptodev_cipher_decrypt: %d", ret);
+			return ret;
+		}
+	}
+
+	kcaop->dst_len = len;
+	return 0;
+}
+
+/* The SRTP MAC covers the packet and the rollover counter. The latter is
+ * appended by userspace to the authenticated data, unless the kernel
+ * derives it.
+ */
+static int srtp_hash_final(struct csession *ses_ptr,
+			   struct kernel_crypt_auth_op *kcaop, void *output)
+{
+	struct scatterlist roc_sg;
+	uint8_t *roc;
+	ssize_t ret;
+
+	if (kcaop->srtp_kernel_iv) {
+		roc = session_auth_buf(ses_ptr);
+		if (unlikely(!roc))
+			return -ENOMEM;
+		put_unaligned_be32(kcaop->srtp_roc, roc);
+		sg_init_one(&roc_sg, roc, 4);
+
+		ret = cryptodev_hash_update(&ses_ptr->hdata, &roc_sg, 4);
+		if (unlikely(ret < 0))
+			return ret;
+	}
+
+	return cryptodev_hash_final(&ses_ptr->hdata, output);
+}
+
+static int srtp_hash(struct csession *ses_ptr, struct kernel_crypt_auth_op *kcaop,
+		     struct scatterlist *auth_sg, uint32_t auth_len, void *output)
+{
+	ssize_t ret;
+
+	if (!kcaop->srtp_kernel_iv)
+		return cryptodev_hash_digest(&ses_ptr->hdata, auth_sg, auth_len,
+					     output);
+
+	ret = cryptodev_hash_update(&ses_ptr->hdata, auth_sg, auth_len);
+	if (unlikely(ret < 0))
+		return ret;
+
+	return srtp_hash_final(ses_ptr, kcaop, output);
+}
+
+/* Encrypts the payload of an SRTP packet and computes its MAC chunk by
+ * chunk: the header, each encrypted chunk of the payload and the rest of
+ * the packet. The payload is at offset diff of the authenticated data.
+ */
+static int srtp_crypt_n_hash(struct csession *ses_ptr,
+			     struct kernel_crypt_auth_op *kcaop,
+			     struct scatterlist *auth_sg, uint32_t auth_len,
+			     struct scatterlist *dst_sg, uint32_t len,
+			     uint32_t diff, uint32_t chunk, void *output)
+{
+	struct scatterlist tmp[2], *sg;
+	uint32_t done, n;
+	int ret;
+
+	ret = hash_chunk(ses_ptr, auth_sg, diff);
+	if (unlikely(ret))
+		return ret;
+
+	for (done = 0; done < len; done += n) {
+		n = min(chunk, len - done);
+		sg = sg_chunk(tmp, dst_sg, done);
+
+		ret = cryptodev_cipher_encrypt(&ses_ptr->cdata, sg, sg, n);
+		if (unlikely(ret)) {
+			derr(0, "cryptodev_cipher_encrypt: %d", ret);
+			return ret;
+		}
+
+		ret = hash_chunk(ses_ptr, sg, n);
+		if (unlikely(ret))
+			return ret;
+	}
+
+	ret = hash_chunk(ses_ptr, sg_chunk(tmp, auth_sg, diff + len),
+			 auth_len - diff - len);
+	if (unlikely(ret))
+		return ret;
+
+	return srtp_hash_final(ses_ptr, kcaop, output);
+}
+
+/* Estimates the high half of an extended sequence number from the low
+ * half received and the anti-replay window (RFC 4303, appendix A2).
+ */
+static u64 esp_inbound_seq(struct csession *ses_ptr, uint32_t seql)
+{
+	uint32_t tl = ses_ptr->esp.top;
+	uint32_t th = ses_ptr->esp.top >> 32;
+	uint32_t w = ses_ptr->esp.window ? ses_ptr->esp.window : 64;
+
+	if (!ses_ptr->esp.esn)
+		return seql;
+
+	if (tl >= w - 1) {
+		if (seql < tl - w + 1)
+			th++;
+	} else if (seql >= tl - w + 1) {
+		th--;
+	}
+
+	return (u64)th << 32 | seql;
+}
+
+static int esp_replay_check(struct csession *ses_ptr, u64 seq)
+{
+	u64 diff;
+
+	if (unlikely(seq == 0)) {
+		derr(2, "ESP sequence number zero");
+		return -EBADMSG;
+	}
+
+	if (ses_ptr->esp.window == 0 || seq > ses_ptr->esp.top)
+		return 0;
+
+	diff = ses_ptr->esp.top - seq;
+	if (diff >= ses_ptr->esp.window ||
+	    ses_ptr->esp.bitmap & (1ULL << diff)) {
+		derr(2, "ESP packet %llu replayed or too old",
+		     (unsigned long long)seq);
+		return -EBADMSG;
+	}
+
+	return 0;
+}
+
+static void esp_replay_update(struct csession *ses_ptr, u64 seq)
+{
+	u64 diff;
+
+	if (seq > ses_ptr->esp.top) {
+		diff = seq - ses_ptr->esp.top;
+		ses_ptr->esp.bitmap = diff >= 64 ? 0 : ses_ptr->esp.bitmap << diff;
+		ses_ptr->esp.bitmap |= 1;
+		ses_ptr->esp.top = seq;
+	} else {
+		diff = ses_ptr->esp.top - seq;
+		if (diff < 64)
+			ses_ptr->esp.bitmap |= 1ULL << diff;
+	}
+}
+
+/* The ICV of CBC SAs is the HMAC of the packet. With extended sequence
+ * numbers the high half is appended to the MAC input, but not sent.
+ */
+static int esp_hmac(struct csession *ses_ptr, struct scatterlist *sg,
+		    uint32_t len, u64 seq, uint8_t *seqhi, void *output)
+{
+	struct scatterlist hi_sg;
+	ssize_t ret;
+
+	if (!ses_ptr->esp.esn)
+		return cryptodev_hash_digest(&ses_ptr->hdata, sg, len, output);
+
+	put_unaligned_be32(seq >> 32, seqhi);
+	sg_init_one(&hi_sg, seqhi, 4);
+
+	ret = cryptodev_hash_update(&ses_ptr->hdata, sg, len);
+	if (likely(ret >= 0))
+		ret = cryptodev_hash_update(&ses_ptr->hdata, &hi_sg, 4);
+	if (unlikely(ret < 0))
+		return ret;
+
+	return cryptodev_hash_final(&ses_ptr->hdata, output);
+}
+
+/* Builds or opens an ESP packet in place (RFC 4303). dst_sg maps the whole
+ * packet and data_sg its encrypted part, after the header and the IV.
+ * AES-GCM SAs use the sequence number as IV and SPI || sequence number as
+ * additional data (RFC 4106); CBC SAs use a random IV and authenticate
+ * the encrypted packet.
+ */
+static int
+esp_auth_n_crypt(struct csession *ses_ptr, struct kernel_crypt_auth_op *kcaop,
+		 struct scatterlist *dst_sg, struct scatterlist *data_sg,
+		 uint32_t len)
+{
+	struct cipher_data *cdata = &ses_ptr->cdata;
+	struct crypt_auth_op *caop = &kcaop->caop;
+	unsigned int iv_size = esp_iv_size(ses_ptr);
+	unsigned int offset = ESP_HEADER_SIZE + iv_size;
+	unsigned int icv_len = caop->tag_len;
+	struct scatterlist aad_sg[2], *sg = data_sg;
+	uint8_t nonce[EALG_MAX_BLOCK_LEN];
+	uint8_t trailer[EALG_MAX_BLOCK_LEN + ESP_TRAILER_SIZE];
+	uint8_t icv[AALG_MAX_RESULT_LEN], vicv[AALG_MAX_RESULT_LEN];
+	uint8_t *hdr, *aad, nh;
+	unsigned int pad_len, aad_len, i;
+	uint32_t ct_len;
+	u64 seq;
+	int ret;
+
+	if (unlikely(!ses_ptr->esp.enabled)) {
+		derr(1, "ESP SA not set, see CIOCESPSA");
+		return -EINVAL;
+	}
+
+	if (unlikely(caop->auth_len != 1)) {
+		derr(1, "invalid ESP next header length %u", caop->auth_len);
+		return -EINVAL;
+	}
+
+	if (cdata->aead ? (icv_len != 8 && icv_len != 12 && icv_len != 16) :
+			  (icv_len == 0 || icv_len > ses_ptr->hdata.digestsize)) {
+		derr(1, "invalid ICV length %u", icv_len);
+		return -EINVAL;
+	}
+
+	/* header, additional data and the high sequence number */
+	hdr = session_auth_buf(ses_ptr);
+	if (unlikely(!hdr))
+		return -ENOMEM;
+	aad = hdr + 16;
+
+	if (caop->op == COP_ENCRYPT) {
+		if (unlikely(len > 0xffff)) {
+			derr(1, "ESP payload too large: %u", len);
+			return -EMSGSIZE;
+		}
+
+		if (unlikely(get_user(nh, caop->auth_src)))
+			return -EFAULT;
+
+		ret = crypto_record_seq(ses_ptr, &seq);
+		if (unlikely(ret))
+			return ret;
+		if (unlikely(seq == 0 || (!ses_ptr->esp.esn && seq > 0xffffffff))) {
+			derr(1, "ESP sequence number would cycle");
+			return -EOVERFLOW;
+		}
+
+		put_unaligned_be32(ses_ptr->esp.spi, hdr);
+		put_unaligned_be32(seq, hdr + 4);
+		scatterwalk_map_and_copy(hdr, dst_sg, 0, ESP_HEADER_SIZE, 1);
+
+		if (cdata->aead) {
+			memcpy(nonce, ses_ptr->record.iv, ses_ptr->record.iv_len);
+			put_unaligned_be64(seq, nonce + ses_ptr->record.iv_len);
+			scatterwalk_map_and_copy(nonce + ses_ptr->record.iv_len,
+						 dst_sg, ESP_HEADER_SIZE, iv_size, 1);
+		} else {
+			get_random_bytes(nonce, iv_size);
+			scatterwalk_map_and_copy(nonce, dst_sg, ESP_HEADER_SIZE,
+						 iv_size, 1);
+		}
+
+		/* the padding bytes are 1, 2, 3, ... */
+		pad_len = esp_pad_size(ses_ptr, len);
+		for (i = 0; i < pad_len; i++)
+			trailer[i] = i + 1;
+		trailer[pad_len] = pad_len;
+		trailer[pad_len + 1] = nh;
+		scatterwalk_map_and_copy(trailer, dst_sg, offset + len,
+					 pad_len + ESP_TRAILER_SIZE, 1);
+
+		ct_len = len + pad_len + ESP_TRAILER_SIZE;
+	} else {
+		if (unlikely(len < offset + ESP_TRAILER_SIZE + icv_len)) {
+			derr(2, "ESP packet too short: %u", len);
+			return -EBADMSG;
+		}
+
+		ct_len = len - offset - icv_len;
+		if (unlikely(ct_len % cdata->blocksize)) {
+			derr(2, "ESP packet not aligned to the block size");
+			return -EBADMSG;
+		}
+
+		scatterwalk_map_and_copy(hdr, dst_sg, 0, ESP_HEADER_SIZE, 0);
+		if (unlikely(get_unaligned_be32(hdr) != ses_ptr->esp.spi)) {
+			derr(2, "ESP packet for another SPI");
+			return -EBADMSG;
+		}
+
+		seq = esp_inbound_seq(ses_ptr, get_unaligned_be32(hdr + 4));
+		ret = esp_replay_check(ses_ptr, seq);
+		if (unlikely(ret))
+			return ret;
+
+		if (cdata->aead) {
+			memcpy(nonce, ses_ptr->record.iv, ses_ptr->record.iv_len);
+			scatterwalk_map_and_copy(nonce + ses_ptr->record.iv_len,
+						 dst_sg, ESP_HEADER_SIZE, iv_size, 0);
+		} else {
+			scatterwalk_map_and_copy(nonce, dst_sg, ESP_HEADER_SIZE,
+						 iv_size, 0);
+		}
+	}
+
+	if (cdata->aead) {
+		put_unaligned_be32(ses_ptr->esp.spi, aad);
+		if (ses_ptr->esp.esn) {
+			put_unaligned_be64(seq, aad + 4);
+			aad_len = 12;
+		} else {
+			put_unaligned_be32(seq, aad + 4);
+			aad_len = 8;
+		}
+
+		cryptodev_cipher_set_iv(cdata, nonce, cdata->ivsize);
+		sg_init_table(aad_sg, 2);
+		sg_set_buf(aad_sg, aad, aad_len);
+		cryptodev_cipher_set_tag_size(cdata, icv_len);
+		cryptodev_cipher_auth(cdata, aad_sg, aad_len);
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 3, 0))
+		sg = chain_auth_sg(aad_sg, 1, data_sg);
+#endif
+
+		if (caop->op == COP_ENCRYPT) {
+			ret = cryptodev_cipher_encrypt(cdata, sg, sg, ct_len);
+			if (unlikely(ret)) {
+				derr(0, "cryptodev_cipher_encrypt: %d", ret);
+				return ret;
+			}
+		} else {
+			ret = cryptodev_cipher_decrypt(cdata, sg, sg,
+						       ct_len + icv_len);
+			if (unlikely(ret)) {
+				derr(2, "cryptodev_cipher_decrypt: %d", ret);
+				return ret;
+			}
+		}
+	} else {
+		cryptodev_cipher_set_iv(cdata, nonce, iv_size);
+
+		if (caop->op == COP_ENCRYPT) {
+			ret = cryptodev_cipher_encrypt(cdata, data_sg, data_sg,
+						       ct_len);
 			if (unlikely(ret)) {
-				derr(0, "cryptodev_hash_update: %d", ret);
+				derr(0, "cryptodev_cipher_encrypt: %d", ret);
 				return ret;
 			}
 
-			ret = cryptodev_hash_final(&ses_ptr->hdata, hash_output);
+			ret = esp_hmac(ses_ptr, dst_sg, offset + ct_len, seq,
+				       aad, icv);
 			if (unlikely(ret)) {
-				derr(0, "cryptodev_hash_final: %d", ret);
+				derr(0, "esp_hmac: %d", ret);
+				return ret;
+			}
+			scatterwalk_map_and_copy(icv, dst_sg, offset + ct_len,
+						 icv_len, 1);
+		} else {
+			ret = esp_hmac(ses_ptr, dst_sg, offset + ct_len, seq,
+				       aad, icv);
+			if (unlikely(ret)) {
+				derr(0, "esp_hmac: %d", ret);
+				return ret;
+			}
+
+			scatterwalk_map_and_copy(vicv, dst_sg, offset + ct_len,
+						 icv_len, 0);
+			if (memcmp(icv, vicv, icv_len) != 0) {
+				derr(2, "ESP ICV verification failed");
+				return -EBADMSG;
+			}
+
+			ret = cryptodev_cipher_decrypt(cdata, data_sg, data_sg,
+						       ct_len);
+			if (unlikely(ret)) {
+				derr(0, "cryptodev_cipher_decrypt: %d", ret);
+				return ret;
+			}
+		}
+	}
+
+	if (caop->op == COP_ENCRYPT) {
+		kcaop->dst_len = offset + ct_len + icv_len;
+		return 0;
+	}
+
+	scatterwalk_map_and_copy(trailer, dst_sg,
+				 offset + ct_len - ESP_TRAILER_SIZE,
+				 ESP_TRAILER_SIZE, 0);
+	if (unlikely(trailer[0] + ESP_TRAILER_SIZE > ct_len)) {
+		derr(2, "invalid ESP padding");
+		return -EBADMSG;
+	}
+
+	/* the packet is authentic, so it counts against replays */
+	esp_replay_update(ses_ptr, seq);
+
+	if (unlikely(put_user(trailer[1], caop->auth_src)))
+		return -EFAULT;
+
+	kcaop->dst_len = ct_len - ESP_TRAILER_SIZE - trailer[0];
+	return 0;
+}
+
+/* Authenticate and encrypt the SRTP way. During decryption
+ * it verifies the tag and returns -EBADMSG on error.
+ */
+static int
+srtp_auth_n_crypt(struct csession *ses_ptr, struct kernel_crypt_auth_op *kcaop,
+		  struct scatterlist *auth_sg, uint32_t auth_len,
+		  struct scatterlist *dst_sg, uint32_t len)
+{
+	int ret, fail = 0;
+	struct crypt_auth_op *caop = &kcaop->caop;
+	uint8_t vhash[AALG_MAX_RESULT_LEN];
+	uint8_t hash_output[AALG_MAX_RESULT_LEN];
+	uint32_t chunk = authenc_chunk_size(ses_ptr);
+	uint32_t diff = caop->src - caop->auth_src;
+
+	/* SRTP authenticates the encrypted data. Large payloads inside the
+	 * authenticated data are encrypted and hashed a chunk at a time.
+	 */
+	if (caop->op == COP_ENCRYPT && len > chunk &&
+	    diff <= auth_len && len <= auth_len - diff) {
+		ret = srtp_crypt_n_hash(ses_ptr, kcaop, auth_sg, auth_len,
+					dst_sg, len, diff, chunk, hash_output);
+		if (unlikely(ret)) {
+			derr(0, "srtp_crypt_n_hash: %d", ret);
+			return ret;
+		}
+
+		if (unlikely(copy_to_user(caop->tag, hash_output, caop->tag_len)))
+			return -EFAULT;
+	} else if (caop->op == COP_ENCRYPT) {
+		if (ses_ptr->cdata.init != 0) {
+			ret = cryptodev_cipher_encrypt(&ses_ptr->cdata,
+							dst_sg, dst_sg, len);
+			if (unlikely(ret)) {
+				derr(0, "cryptodev_cipher_encrypt: %d", ret);
+				return ret;
+			}
+		}
+
+		if (ses_ptr->hdata.init != 0) {
+			ret = srtp_hash(ses_ptr, kcaop, auth_sg, auth_len,
+					hash_output);
+			if (unlikely(ret)) {
+				derr(0, "srtp_hash: %d", ret);
+				return ret;
+			}
+
+			if (unlikely(copy_to_user(caop->tag, hash_output, caop->tag_len)))
+				return -EFAULT;
+		}
+
+	} else {
+		if (ses_ptr->hdata.init != 0) {
+			if (unlikely(caop->tag_len > sizeof(vhash) || caop->tag_len > len)) {
+				derr(1, "Illegal tag len size");
+				return -EINVAL;
+			}
+
+			if (unlikely(copy_from_user(vhash, caop->tag, caop->tag_len)))
+				return -EFAULT;
+
+			ret = srtp_hash(ses_ptr, kcaop, auth_sg, auth_len,
+					hash_output);
+			if (unlikely(ret)) {
+				derr(0, "srtp_hash: %d", ret);
 				return ret;
 			}
 
@@ -559,6 +1953,98 @@ srtp_auth_n_crypt(struct csession *ses_ptr, struct kernel_crypt_auth_op *kcaop,
 	return 0;
 }
 
+/* Authenticated encryption of SRTP and SRTCP packets with an AEAD cipher
+ * (RFC 7714). The additional data is the header before the payload and,
+ * for SRTCP, the E flag and index trailing the tag; the tag follows the
+ * encrypted payload.
+ */
+static int
+srtp_aead_auth_n_crypt(struct csession *ses_ptr, struct kernel_crypt_auth_op *kcaop,
+		       struct scatterlist *dst_sg, uint32_t len)
+{
+	struct cipher_data *cdata = &ses_ptr->cdata;
+	struct crypt_auth_op *caop = &kcaop->caop;
+	struct scatterlist aad_sg[2], *sg = dst_sg;
+	uint32_t hdr_len = caop->src - caop->auth_src;
+	uint32_t plain_len, aad_len;
+	unsigned char *aad;
+	int max_tag_len;
+	int ret;
+
+	max_tag_len = cryptodev_cipher_get_tag_size(cdata);
+	if (unlikely(caop->tag_len > max_tag_len)) {
+		derr(0, "Illegal tag length: %d", caop->tag_len);
+		return -EINVAL;
+	}
+	cryptodev_cipher_set_tag_size(cdata, caop->tag_len);
+
+	if (caop->op == COP_ENCRYPT) {
+		plain_len = len;
+	} else {
+		if (unlikely(len < caop->tag_len)) {
+			derr(2, "SRTP packet shorter than its tag");
+			return -EBADMSG;
+		}
+		plain_len = len - caop->tag_len;
+	}
+
+	if (unlikely(hdr_len + plain_len > caop->auth_len)) {
+		derr(1, "SRTP payload exceeds the authenticated data");
+		return -EINVAL;
+	}
+	aad_len = caop->auth_len - plain_len;
+
+	if (aad_len <= MAX_COPY_AUTH_DATA) {
+		aad = session_auth_buf(ses_ptr);
+		if (unlikely(!aad))
+			return -ENOMEM;
+	} else {
+		aad = kmalloc(aad_len, GFP_KERNEL);
+		if (unlikely(!aad)) {
+			derr(1, "unable to allocate %u bytes for auth data.",
+			     aad_len);
+			return -ENOMEM;
+		}
+	}
+
+	if (unlikely(copy_from_user(aad, caop->auth_src, hdr_len) ||
+		     copy_from_user(aad + hdr_len,
+				    caop->src + plain_len + caop->tag_len,
+				    aad_len - hdr_len))) {
+		ret = -EFAULT;
+		goto out;
+	}
+
+	sg_init_table(aad_sg, 2);
+	sg_set_buf(aad_sg, aad, aad_len);
+	cryptodev_cipher_auth(cdata, aad_sg, aad_len);
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 3, 0))
+	sg = chain_auth_sg(aad_sg, 1, dst_sg);
+#endif
+
+	if (caop->op == COP_ENCRYPT) {
+		ret = cryptodev_cipher_encrypt(cdata, sg, sg, len);
+		if (unlikely(ret)) {
+			derr(0, "cryptodev_cipher_encrypt: %d", ret);
+			goto out;
+		}
+		kcaop->dst_len = len + caop->tag_len;
+	} else {
+		ret = cryptodev_cipher_decrypt(cdata, sg, sg, len);
+		if (unlikely(ret)) {
+			derr(2, "cryptodev_cipher_decrypt: %d", ret);
+			goto out;
+		}
+		kcaop->dst_len = plain_len;
+	}
+	caop->tag = caop->dst + plain_len;
+
+out:
+	if (aad != ses_ptr->auth_buf)
+		kfree(aad);
+	return ret;
+}
+
 /* Typical AEAD (i.e. GCM) encryption/decryption.
  * During decryption the tag is verified.
  */
@@ -619,9 +2105,9 @@ __crypto_auth_run_zc(struct csession *ses_ptr, struct kernel_crypt_auth_op *kcao
 
 	if (caop->flags & COP_FLAG_AEAD_SRTP_TYPE) {
 		if (unlikely(ses_ptr->cdata.init != 0 &&
-		             (ses_ptr->cdata.stream == 0 ||
-			      ses_ptr->cdata.aead != 0))) {
-			derr(0, "Only stream modes are allowed in SRTP mode (but not AEAD)");
+		             ses_ptr->cdata.stream == 0 &&
+			     ses_ptr->cdata.aead == 0)) {
+			derr(0, "Only stream and AEAD modes are allowed in SRTP mode");
 			return -EINVAL;
 		}
 
@@ -631,39 +2117,73 @@ __crypto_auth_run_zc(struct csession *ses_ptr, struct kernel_crypt_auth_op *kcao
 			return ret;
 		}
 
-		ret = srtp_auth_n_crypt(ses_ptr, kcaop, auth_sg, caop->auth_len,
-			   dst_sg, caop->len);
+		if (ses_ptr->cdata.aead)
+			ret = srtp_aead_auth_n_crypt(ses_ptr, kcaop, dst_sg,
+						     caop->len);
+		else
+			ret = srtp_auth_n_crypt(ses_ptr, kcaop, auth_sg,
+						caop->auth_len, dst_sg, caop->len);
 
 		release_user_pages(ses_ptr);
-	} else { /* TLS and normal cases. Here auth data are usually small
-	          * so we just copy them to a free page, instead of trying
-	          * to map them.
-	          */
-		unsigned char *auth_buf = NULL;
-		struct scatterlist tmp;
+	} else if (caop->flags & COP_FLAG_AEAD_TLS13_TYPE) {
+		ret = get_userbuf_tls(ses_ptr, kcaop, &dst_sg);
+		if (unlikely(ret)) {
+			derr(1, "get_userbuf_tls(): Error getting user pages.");
+			return ret;
+		}
 
-		if (unlikely(caop->auth_len > PAGE_SIZE)) {
-			derr(1, "auth data len is excessive.");
-			return -EINVAL;
+		ret = tls13_auth_n_crypt(ses_ptr, kcaop, dst_sg, caop->len);
+
+		release_user_pages(ses_ptr);
+	} else if (caop->flags & COP_FLAG_AEAD_TLS12_GCM_TYPE) {
+		ret = get_userbuf_tls(ses_ptr, kcaop, &dst_sg);
+		if (unlikely(ret)) {
+			derr(1, "get_userbuf_tls(): Error getting user pages.");
+			return ret;
 		}
 
-		auth_buf = (char *)__get_free_page(GFP_KERNEL);
-		if (unlikely(!auth_buf)) {
-			derr(1, "unable to get a free page.");
-			return -ENOMEM;
+		ret = tls12_gcm_auth_n_crypt(ses_ptr, kcaop, dst_sg, caop->len);
+
+		release_user_pages(ses_ptr);
+	} else if (caop->flags & COP_FLAG_AEAD_ESP_TYPE) {
+		ret = get_userbuf_esp(ses_ptr, kcaop, &dst_sg, &src_sg,
+				      ESP_HEADER_SIZE + esp_iv_size(ses_ptr));
+		if (unlikely(ret)) {
+			derr(1, "get_userbuf_esp(): Error getting user pages.");
+			return ret;
 		}
 
+		ret = esp_auth_n_crypt(ses_ptr, kcaop, dst_sg, src_sg, caop->len);
+
+		release_user_pages(ses_ptr);
+	} else { /* TLS and normal cases. Auth data are usually small so
+	          * we copy them to a buffer kept in the session; large ones
+	          * are mapped instead, if the operation is in-place.
+	          */
+		unsigned char *auth_buf = NULL;
+		struct scatterlist tmp[2];
+		int auth_pagecount = 0;
+
+		auth_sg = NULL;
 		if (caop->auth_src && caop->auth_len > 0) {
-			if (unlikely(copy_from_user(auth_buf, caop->auth_src, caop->auth_len))) {
-				derr(1, "unable to copy auth data from userspace.");
-				ret = -EFAULT;
-				goto free_auth_buf;
-			}
+			if (caop->auth_len > MAX_COPY_AUTH_DATA && caop->src == caop->dst) {
+				auth_pagecount = PAGECOUNT(caop->auth_src, caop->auth_len);
+
+				/* reserve room for the auth pages (and a chain
+				 * entry) after the data, so that mapping the
+				 * data doesn't reallocate under our feet */
+				ret = reserve_sg_array(ses_ptr, kcaop, auth_pagecount + 1);
+				if (unlikely(ret))
+					return ret;
+			} else {
+				ret = copy_auth_data(ses_ptr, caop, &auth_buf);
+				if (unlikely(ret))
+					return ret;
 
-			sg_init_one(&tmp, auth_buf, caop->auth_len);
-			auth_sg = &tmp;
-		} else {
-			auth_sg = NULL;
+				sg_init_table(tmp, 2);
+				sg_set_buf(tmp, auth_buf, caop->auth_len);
+				auth_sg = tmp;
+			}
 		}
 
 		if (caop->flags & COP_FLAG_AEAD_TLS_TYPE && ses_ptr->cdata.aead == 0) {
@@ -673,9 +2193,29 @@ __crypto_auth_run_zc(struct csession *ses_ptr, struct kernel_crypt_auth_op *kcao
 				goto free_auth_buf;
 			}
 
-			ret = tls_auth_n_crypt(ses_ptr, kcaop, auth_sg, caop->auth_len,
-				   dst_sg, caop->len);
+			if (caop->flags & (COP_FLAG_TLS_ETM | COP_FLAG_DTLS)) {
+				ret = tls_record_auth_n_crypt(ses_ptr, kcaop, dst_sg,
+							      caop->len);
+				goto release_pages;
+			}
+
+			if (auth_pagecount) {
+				ret = get_userbuf_auth(ses_ptr, kcaop, auth_pagecount, &auth_sg);
+				if (unlikely(ret))
+					goto release_pages;
+			}
+
+			if (ses_ptr->tdata.init != 0)
+				ret = tls_auth_n_crypt_fused(ses_ptr, kcaop, auth_sg,
+					   auth_pagecount ? auth_pagecount : 1,
+					   caop->auth_len, dst_sg, caop->len);
+			else
+				ret = tls_auth_n_crypt(ses_ptr, kcaop, auth_sg, caop->auth_len,
+					   dst_sg, caop->len);
 		} else {
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 3, 0))
+			struct scatterlist tmp_dst[2];
+#endif
 			if (unlikely(ses_ptr->cdata.init == 0 ||
 			             (ses_ptr->cdata.stream == 0 &&
 				      ses_ptr->cdata.aead == 0))) {
@@ -691,14 +2231,38 @@ __crypto_auth_run_zc(struct csession *ses_ptr, struct kernel_crypt_auth_op *kcao
 				goto free_auth_buf;
 			}
 
+			if (auth_pagecount) {
+				ret = get_userbuf_auth(ses_ptr, kcaop, auth_pagecount, &auth_sg);
+				if (unlikely(ret))
+					goto release_pages;
+			}
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 3, 0))
+			/* The auth data precede the data in both lists */
+			if (auth_sg && ses_ptr->cdata.aead != 0) {
+				int auth_nents = auth_pagecount ? auth_pagecount : 1;
+
+				if (src_sg == dst_sg) {
+					src_sg = dst_sg = chain_auth_sg(auth_sg, auth_nents, src_sg);
+				} else {
+					sg_init_table(tmp_dst, 2);
+					sg_set_buf(tmp_dst, auth_buf, caop->auth_len);
+					src_sg = chain_auth_sg(auth_sg, auth_nents, src_sg);
+					dst_sg = chain_auth_sg(tmp_dst, 1, dst_sg);
+				}
+			}
+#endif
+
 			ret = auth_n_crypt(ses_ptr, kcaop, auth_sg, caop->auth_len,
 					   src_sg, dst_sg, caop->len);
 		}
 
+release_pages:
 		release_user_pages(ses_ptr);
 
 free_auth_buf:
-		free_page((unsigned long)auth_buf);
+		if (auth_buf != ses_ptr->auth_buf)
+			kfree(auth_buf);
 	}
 
 	return ret;
@@ -707,6 +2271,7 @@ free_auth_buf:
 
 int crypto_auth_run(struct fcrypt *fcr, struct kernel_crypt_auth_op *kcaop)
 {
+	struct srtp_stream *stream = NULL;
 	struct csession *ses_ptr;
 	struct crypt_auth_op *caop = &kcaop->caop;
 	int ret;
@@ -738,8 +2303,21 @@ int crypto_auth_run(struct fcrypt *fcr, struct kernel_crypt_auth_op *kcaop)
 		}
 	}
 
-	cryptodev_cipher_set_iv(&ses_ptr->cdata, kcaop->iv,
-				min(ses_ptr->cdata.ivsize, kcaop->ivlen));
+	if (kcaop->srtp_kernel_iv) {
+		ret = srtp_stream_iv(ses_ptr, kcaop, &stream);
+		if (unlikely(ret))
+			goto out_unlock;
+	}
+
+	if (kcaop->iv_generated) {
+		ret = crypto_next_iv(ses_ptr, kcaop->iv);
+		if (unlikely(ret))
+			goto out_unlock;
+		cryptodev_cipher_set_iv(&ses_ptr->cdata, kcaop->iv,
+					ses_ptr->cdata.ivsize);
+	} else
+		cryptodev_cipher_set_iv(&ses_ptr->cdata, kcaop->iv,
+					min(ses_ptr->cdata.ivsize, kcaop->ivlen));
 
 	ret = __crypto_auth_run_zc(ses_ptr, kcaop);
 	if (unlikely(ret)) {
@@ -747,12 +2325,282 @@ int crypto_auth_run(struct fcrypt *fcr, struct kernel_crypt_auth_op *kcaop)
 		goto out_unlock;
 	}
 
+	if (kcaop->srtp_kernel_iv)
+		srtp_stream_update(stream, kcaop);
+
 	ret = 0;
 
-	cryptodev_cipher_get_iv(&ses_ptr->cdata, kcaop->iv,
-				min(ses_ptr->cdata.ivsize, kcaop->ivlen));
+	/* a generated IV is returned as it was used */
+	if (!kcaop->iv_generated)
+		cryptodev_cipher_get_iv(&ses_ptr->cdata, kcaop->iv,
+					min(ses_ptr->cdata.ivsize, kcaop->ivlen));
+
+out_unlock:
+	crypto_put_session(ses_ptr);
+	return ret;
+}
+
+/* Protects or unprotects a batch of SRTP packets, each one as a separate
+ * CIOCAUTHCRYPT in SRTP mode. The outcome of each packet is stored in its
+ * status; the call only fails if the batch itself cannot be accessed.
+ */
+int crypto_srtp_batch_run(struct fcrypt *fcr, struct srtp_batch_op *sbop)
+{
+	struct kernel_crypt_auth_op kcaop;
+	struct crypt_auth_op __user *arg;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < sbop->count; i++) {
+		arg = sbop->caops + i;
+		if (unlikely(copy_from_user(&kcaop.caop, arg, sizeof(kcaop.caop))))
+			return -EFAULT;
+
+		if (unlikely(!(kcaop.caop.flags & COP_FLAG_AEAD_SRTP_TYPE))) {
+			derr(1, "packet %u of the batch is not in SRTP mode", i);
+			ret = -EINVAL;
+		} else {
+			ret = fill_kcaop_from_caop(&kcaop, fcr);
+			if (likely(ret == 0))
+				ret = crypto_auth_run(fcr, &kcaop);
+			if (likely(ret == 0))
+				ret = fill_caop_from_kcaop(&kcaop, fcr);
+			if (likely(ret == 0) &&
+			    unlikely(copy_to_user(arg, &kcaop.caop, sizeof(kcaop.caop))))
+				return -EFAULT;
+		}
+
+		if (unlikely(put_user(ret, sbop->status + i)))
+			return -EFAULT;
+
+		if (fatal_signal_pending(current))
+			return -EINTR;
+		cond_resched();
+	}
+
+	return 0;
+}
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 3, 0))
+/* Moves the plaintext of a record of the batch to its place in the mapped
+ * records, through the bounce buffer.
+ */
+static int tls_batch_move(struct tls_batch_op *tbop, struct scatterlist *sg,
+			  uint8_t *bounce, uint32_t from, uint32_t to, uint32_t len)
+{
+	if (tbop->src == tbop->dst)
+		scatterwalk_map_and_copy(bounce, sg, from, len, 0);
+	else if (unlikely(copy_from_user(bounce, tbop->src + from, len)))
+		return -EFAULT;
+
+	scatterwalk_map_and_copy(bounce, sg, to, len, 1);
+	return 0;
+}
+
+/* Builds the request sealing the record of the batch at offset pos of the
+ * mapped records, with n bytes of plaintext already in place, and writes
+ * its header. This takes the sequence number of the record.
+ */
+static int tls_batch_prepare(struct csession *ses_ptr, struct tls_batch_op *tbop,
+			     struct cipher_aead_req *areq, uint32_t pos, uint32_t n)
+{
+	struct scatterlist *data;
+	uint8_t hdr[TLS_HEADER_SIZE];
+	u64 seq;
+	int ret;
+
+	ret = crypto_record_seq(ses_ptr, &seq);
+	if (unlikely(ret))
+		return ret;
+
+	sg_init_table(areq->ad_sg, 2);
+	if (tbop->flags == COP_FLAG_AEAD_TLS13_TYPE) {
+		tls13_header(hdr, n);
+		tls13_nonce(ses_ptr, seq, areq->iv);
+		memcpy(areq->ad, hdr, TLS_HEADER_SIZE);
+		areq->ad_len = TLS_HEADER_SIZE;
+
+		data = scatterwalk_ffwd(areq->data_sg, ses_ptr->sg,
+					pos + TLS_HEADER_SIZE);
+		scatterwalk_map_and_copy(&tbop->type, data, n, 1, 1);
+		areq->len = n + 1;
+	} else {
+		hdr[0] = tbop->type;
+		hdr[1] = 3;
+		hdr[2] = 3;
+		put_unaligned_be16(TLS12_GCM_EXPLICIT_SIZE + n + TLS12_GCM_TAG_SIZE,
+				   hdr + 3);
+		memcpy(areq->iv, ses_ptr->record.iv, TLS12_GCM_SALT_SIZE);
+		put_unaligned_be64(seq, areq->iv + TLS12_GCM_SALT_SIZE);
+		tls12_gcm_aad(areq->ad, seq, hdr, n);
+		areq->ad_len = TLS12_GCM_AAD_SIZE;
+
+		scatterwalk_map_and_copy(areq->iv + TLS12_GCM_SALT_SIZE,
+					 ses_ptr->sg, pos + TLS_HEADER_SIZE,
+					 TLS12_GCM_EXPLICIT_SIZE, 1);
+		data = scatterwalk_ffwd(areq->data_sg, ses_ptr->sg,
+					pos + TLS_HEADER_SIZE + TLS12_GCM_EXPLICIT_SIZE);
+		areq->len = n;
+	}
+	sg_set_buf(areq->ad_sg, areq->ad, areq->ad_len);
+	areq->sg = chain_auth_sg(areq->ad_sg, 1, data);
+
+	if (unlikely(copy_to_user(tbop->dst + pos, hdr, TLS_HEADER_SIZE)))
+		return -EFAULT;
+	return 0;
+}
+#endif
+
+/* The records are sealed CIPHER_AEAD_WINDOW at a time: those of a window
+ * are all prepared, then submitted together and waited for once.
+ */
+int crypto_tls_batch_run(struct fcrypt *fcr, struct tls_batch_op *tbop)
+{
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(4, 3, 0))
+	tbop->records = 0;
+	return -EOPNOTSUPP;
+#else
+	struct csession *ses_ptr;
+	struct cipher_aead_req *areqs;
+	uint32_t prefix, overhead, rec_max, count, total, pos, n, i, j, w;
+	uint8_t *bounce;
+	int pagecount, ret;
+
+	tbop->records = 0;
+	if (tbop->flags == COP_FLAG_AEAD_TLS13_TYPE) {
+		prefix = TLS_HEADER_SIZE;
+		overhead = TLS_HEADER_SIZE + 1 + TLS13_TAG_SIZE;
+	} else if (tbop->flags == COP_FLAG_AEAD_TLS12_GCM_TYPE) {
+		prefix = TLS_HEADER_SIZE + TLS12_GCM_EXPLICIT_SIZE;
+		overhead = prefix + TLS12_GCM_TAG_SIZE;
+	} else {
+		derr(1, "invalid TLS batch flags 0x%x", tbop->flags);
+		return -EINVAL;
+	}
+
+	rec_max = tbop->max_record ? tbop->max_record : TLS12_MAX_PLAINTEXT;
+	if (unlikely(rec_max > TLS12_MAX_PLAINTEXT || tbop->len == 0 ||
+		     tbop->len > TLS_BATCH_MAX_RECORDS * rec_max)) {
+		derr(1, "invalid TLS batch of %u bytes", tbop->len);
+		return -EINVAL;
+	}
+
+	count = DIV_ROUND_UP(tbop->len, rec_max);
+	total = tbop->len + count * overhead;
+
+	bounce = kmalloc(rec_max, GFP_KERNEL);
+	areqs = kcalloc(min_t(uint32_t, count, CIPHER_AEAD_WINDOW),
+			sizeof(*areqs), GFP_KERNEL);
+	if (unlikely(!bounce || !areqs)) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	/* this also enters ses_ptr->sem */
+	ses_ptr = crypto_get_session_by_sid(fcr, tbop->ses);
+	if (unlikely(!ses_ptr)) {
+		derr(1, "invalid session ID=0x%08X", tbop->ses);
+		ret = -EINVAL;
+		goto out_free;
+	}
+
+	/* the records are mapped once and each request of a window views
+	 * its own record through its data_sg */
+	pagecount = PAGECOUNT(tbop->dst, total);
+	ret = adjust_sg_array(ses_ptr, pagecount);
+	if (unlikely(ret))
+		goto out_unlock;
+
+	ret = __get_userbuf(tbop->dst, total, 1, pagecount, ses_ptr->pages,
+			    ses_ptr->sg, current, current->mm);
+	if (unlikely(ret)) {
+		derr(1, "failed to get user pages for the records");
+		goto out_unlock;
+	}
+	ses_ptr->used_pages = pagecount;
+	ses_ptr->readonly_pages = 0;
+
+	/* before anything is moved in place */
+	if (tbop->flags == COP_FLAG_AEAD_TLS13_TYPE)
+		ret = tls13_check_session(ses_ptr);
+	else
+		ret = tls12_gcm_check_session(ses_ptr);
+	if (unlikely(ret))
+		goto out_release;
+
+	if (unlikely(!ses_ptr->record.enabled)) {
+		derr(1, "record state not set, see CIOCRECORD");
+		ret = -EINVAL;
+		goto out_release;
+	}
+
+	/* in place, each plaintext moves forward: start with the last one */
+	if (tbop->src == tbop->dst) {
+		for (i = count; i-- > 0; ) {
+			n = min(rec_max, tbop->len - i * rec_max);
+			ret = tls_batch_move(tbop, ses_ptr->sg, bounce, i * rec_max,
+					     i * (rec_max + overhead) + prefix, n);
+			if (unlikely(ret))
+				goto out_release;
+		}
+	}
+
+	/* both record types have a 16-byte tag */
+	cryptodev_cipher_set_tag_size(&ses_ptr->cdata, TLS13_TAG_SIZE);
+
+	for (i = 0, pos = 0; i < count; i += w) {
+		/* every record but the last one has rec_max bytes */
+		for (w = 0; w < CIPHER_AEAD_WINDOW && i + w < count; w++) {
+			uint32_t at = (i + w) * (rec_max + overhead);
+
+			n = min(rec_max, tbop->len - (i + w) * rec_max);
+			if (tbop->src != tbop->dst) {
+				ret = tls_batch_move(tbop, ses_ptr->sg, bounce,
+						     (i + w) * rec_max, at + prefix, n);
+				if (unlikely(ret))
+					break;
+			}
+
+			ret = tls_batch_prepare(ses_ptr, tbop, &areqs[w], at, n);
+			if (unlikely(ret))
+				break;
+		}
+
+		/* the records prepared before a failure are still sealed */
+		cryptodev_cipher_aead_many(&ses_ptr->cdata, 1, areqs, w);
+		for (j = 0; j < w; j++) {
+			if (unlikely(areqs[j].rc)) {
+				derr(0, "cryptodev_cipher_aead_many: %d",
+				     areqs[j].rc);
+				ret = areqs[j].rc;
+				break;
+			}
+			pos += overhead + min(rec_max, tbop->len - (i + j) * rec_max);
+		}
+		if (unlikely(ret)) {
+			i += j;
+			goto out_sealed;
+		}
+
+		if (fatal_signal_pending(current)) {
+			ret = -EINTR;
+			i += w;
+			goto out_sealed;
+		}
+		cond_resched();
+	}
 
+out_sealed:
+	/* also on failure, so the caller knows which records were sent */
+	tbop->len = pos;
+	tbop->records = i;
+out_release:
+	release_user_pages(ses_ptr);
 out_unlock:
 	crypto_put_session(ses_ptr);
+out_free:
+	kfree(areqs);
+	kfree(bounce);
 	return ret;
+#endif
 }
@@ -29,12 +29,28 @@
 #include <linux/random.h>
 #include <linux/scatterlist.h>
 #include <linux/uaccess.h>
+#include <linux/workqueue.h>
 #include <crypto/algapi.h>
 #include <crypto/hash.h>
+#include <crypto/rng.h>
 #include <crypto/cryptodev.h>
 #include <crypto/aead.h>
 #include <linux/rtnetlink.h>
 #include <crypto/authenc.h>
+#include <crypto/scatterwalk.h>
+#include <asm/unaligned.h>
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 10, 0))
+#include <crypto/acompress.h>
+#endif
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 8, 0))
+#include <crypto/akcipher.h>
+#include <crypto/kpp.h>
+#include <crypto/dh.h>
+#include <crypto/ecdh.h>
+#endif
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0))
+#include <linux/sched/clock.h>
+#endif
 #include "cryptodev_int.h"
 #include "cipherapi.h"
 
@@ -236,6 +252,21 @@ void cryptodev_cipher_deinit(struct cipher_data *cdata)
 	}
 }
 
+/* For small requests sleeping and being woken up costs more than the
+ * request itself, so spin on the completion for cryptodev_poll_usecs
+ * before going to sleep.
+ */
+static void busy_poll_completion(struct completion *comp)
+{
+	u64 end = local_clock() + (u64)cryptodev_poll_usecs * NSEC_PER_USEC;
+
+	while (!completion_done(comp)) {
+		if (need_resched() || local_clock() > end)
+			break;
+		cpu_relax();
+	}
+}
+
 static inline int waitfor(struct cryptodev_result *cr, ssize_t ret)
 {
 	switch (ret) {
@@ -243,6 +274,9 @@ static inline int waitfor(struct cryptodev_result *cr, ssize_t ret)
 		break;
 	case -EINPROGRESS:
 	case -EBUSY:
+		if (cryptodev_poll_usecs)
+			busy_poll_completion(&cr->completion);
+
 		wait_for_completion(&cr->completion);
 		/* At this point we known for sure the request has finished,
 		 * because wait_for_completion above was not interruptible.
@@ -308,6 +342,173 @@ ssize_t cryptodev_cipher_decrypt(struct cipher_data *cdata,
 	return waitfor(&cdata->async.result, ret);
 }
 
+/* a data unit in flight of cryptodev_cipher_crypt_units() */
+struct cipher_unit {
+	cryptodev_blkcipher_request_t *req;
+	struct cryptodev_result result;
+	int rc;
+	uint8_t iv[EALG_MAX_BLOCK_LEN];
+	struct scatterlist src[2], dst[2];
+};
+
+/*
+ * Encrypts or decrypts len bytes as consecutive data units (sectors) of
+ * du_size bytes each. The IV of every unit is its number as a little
+ * endian integer (like dm-crypt's plain64), the first one being du_index.
+ * Up to CIPHER_UNIT_WINDOW units are kept in flight at once.
+ */
+int cryptodev_cipher_crypt_units(struct cipher_data *cdata, int encrypt,
+			struct scatterlist *src, struct scatterlist *dst,
+			size_t len, size_t du_size, u64 du_index)
+{
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(4, 2, 0))
+	return -EOPNOTSUPP;
+#else
+	struct cipher_unit *units;
+	size_t count = len / du_size, i;
+	unsigned int j, n, submitted, window;
+	int ret = 0;
+
+	if (unlikely(cdata->aead != 0 || cdata->ivsize < sizeof(u64)))
+		return -EINVAL;
+
+	window = min_t(size_t, count, CIPHER_UNIT_WINDOW);
+	units = kcalloc(window, sizeof(*units), GFP_KERNEL);
+	if (unlikely(!units))
+		return -ENOMEM;
+
+	for (j = 0; j < window; j++) {
+		units[j].req = cryptodev_blkcipher_request_alloc(cdata->async.s,
+								 GFP_KERNEL);
+		if (unlikely(!units[j].req)) {
+			derr(0, "error allocating async crypto request");
+			ret = -ENOMEM;
+			goto out;
+		}
+		cryptodev_blkcipher_request_set_callback(units[j].req,
+				CRYPTO_TFM_REQ_MAY_BACKLOG,
+				cryptodev_complete, &units[j].result);
+	}
+
+	for (i = 0; i < count && ret == 0; i += n) {
+		n = min_t(size_t, count - i, window);
+
+		for (submitted = 0; submitted < n; submitted++) {
+			struct cipher_unit *u = &units[submitted];
+			struct scatterlist *usrc, *udst;
+			size_t offset = (i + submitted) * du_size;
+
+			init_completion(&u->result.completion);
+			memset(u->iv, 0, cdata->ivsize);
+			put_unaligned_le64(du_index + i + submitted, u->iv);
+
+			usrc = scatterwalk_ffwd(u->src, src, offset);
+			udst = (dst == src) ? usrc :
+					scatterwalk_ffwd(u->dst, dst, offset);
+			cryptodev_blkcipher_request_set_crypt(u->req, usrc, udst,
+							      du_size, u->iv);
+
+			if (encrypt)
+				u->rc = cryptodev_crypto_blkcipher_encrypt(u->req);
+			else
+				u->rc = cryptodev_crypto_blkcipher_decrypt(u->req);
+			if (u->rc != 0 && u->rc != -EINPROGRESS &&
+			    u->rc != -EBUSY) {
+				ret = u->rc;
+				break;
+			}
+		}
+
+		/* wait for everything in flight, even on error */
+		for (j = 0; j < submitted; j++) {
+			int err = waitfor(&units[j].result, units[j].rc);
+
+			if (unlikely(err) && ret == 0)
+				ret = err;
+		}
+	}
+
+out:
+	for (j = 0; j < window; j++)
+		cryptodev_blkcipher_request_free(units[j].req);
+	kfree(units);
+	return ret;
+#endif
+}
+
+/* an AEAD request in flight of cryptodev_cipher_aead_many() */
+struct aead_unit {
+	struct aead_request *req;
+	struct cryptodev_result result;
+};
+
+/*
+ * Encrypts or decrypts count independent requests in place. They are all
+ * submitted before waiting for any of them, so that an asynchronous driver
+ * works on them together. The outcome of each one is left in its rc and
+ * the first error, in the order of the requests, is returned.
+ */
+int cryptodev_cipher_aead_many(struct cipher_data *cdata, int encrypt,
+			struct cipher_aead_req *reqs, unsigned int count)
+{
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(4, 3, 0))
+	return -EOPNOTSUPP;
+#else
+	struct aead_unit *units;
+	unsigned int i, submitted;
+	int ret = 0;
+
+	if (unlikely(cdata->aead == 0 || count > CIPHER_AEAD_WINDOW))
+		return -EINVAL;
+	if (count == 0)
+		return 0;
+
+	units = kcalloc(count, sizeof(*units), GFP_KERNEL);
+	if (unlikely(!units))
+		return -ENOMEM;
+
+	for (i = 0; i < count; i++)
+		reqs[i].rc = -ECANCELED;
+
+	for (submitted = 0; submitted < count; ) {
+		struct cipher_aead_req *r = &reqs[submitted];
+		struct aead_unit *u = &units[submitted];
+
+		u->req = aead_request_alloc(cdata->async.as, GFP_KERNEL);
+		if (unlikely(!u->req)) {
+			derr(0, "error allocating async crypto request");
+			r->rc = -ENOMEM;
+			break;
+		}
+		init_completion(&u->result.completion);
+		aead_request_set_callback(u->req, CRYPTO_TFM_REQ_MAY_BACKLOG,
+					  cryptodev_complete, &u->result);
+		aead_request_set_ad(u->req, r->ad_len);
+		aead_request_set_crypt(u->req, r->sg, r->sg, r->len, r->iv);
+
+		if (encrypt)
+			r->rc = crypto_aead_encrypt(u->req);
+		else
+			r->rc = crypto_aead_decrypt(u->req);
+		submitted++;
+		if (r->rc != 0 && r->rc != -EINPROGRESS && r->rc != -EBUSY)
+			break;
+	}
+
+	/* wait for everything in flight, even on error */
+	for (i = 0; i < submitted; i++)
+		reqs[i].rc = waitfor(&units[i].result, reqs[i].rc);
+
+	for (i = 0; i < count; i++) {
+		if (unlikely(reqs[i].rc) && ret == 0)
+			ret = reqs[i].rc;
+		aead_request_free(units[i].req);
+	}
+	kfree(units);
+	return ret;
+#endif
+}
+
 /* Hash functions */
 
 int cryptodev_hash_init(struct hash_data *hdata, const char *alg_name,
@@ -333,6 +534,7 @@ int cryptodev_hash_init(struct hash_data *hdata, const char *alg_name,
 	}
 
 	hdata->digestsize = crypto_ahash_digestsize(hdata->async.s);
+	hdata->statesize = crypto_ahash_statesize(hdata->async.s);
 	hdata->alignmask = crypto_ahash_alignmask(hdata->async.s);
 
 	init_completion(&hdata->async.result.completion);
@@ -378,6 +580,32 @@ int cryptodev_hash_reset(struct hash_data *hdata)
 
 }
 
+int cryptodev_hash_export(struct hash_data *hdata, void *out)
+{
+	int ret;
+
+	ret = crypto_ahash_export(hdata->async.request, out);
+	if (unlikely(ret)) {
+		derr(0, "error in crypto_ahash_export()");
+		return ret;
+	}
+
+	return 0;
+}
+
+int cryptodev_hash_import(struct hash_data *hdata, const void *in)
+{
+	int ret;
+
+	ret = crypto_ahash_import(hdata->async.request, in);
+	if (unlikely(ret)) {
+		derr(0, "error in crypto_ahash_import()");
+		return ret;
+	}
+
+	return 0;
+}
+
 ssize_t cryptodev_hash_update(struct hash_data *hdata,
 				struct scatterlist *sg, size_t len)
 {
@@ -391,6 +619,22 @@ ssize_t cryptodev_hash_update(struct hash_data *hdata,
 	return waitfor(&hdata->async.result, ret);
 }
 
+/* Hashes a complete message in one request, as in reset, update and
+ * final. The multi-update state is lost.
+ */
+int cryptodev_hash_digest(struct hash_data *hdata, struct scatterlist *sg,
+			  size_t len, void *output)
+{
+	int ret;
+
+	reinit_completion(&hdata->async.result.completion);
+	ahash_request_set_crypt(hdata->async.request, sg, output, len);
+
+	ret = crypto_ahash_digest(hdata->async.request);
+
+	return waitfor(&hdata->async.result, ret);
+}
+
 int cryptodev_hash_final(struct hash_data *hdata, void *output)
 {
 	int ret;
@@ -403,3 +647,505 @@ int cryptodev_hash_final(struct hash_data *hdata, void *output)
 	return waitfor(&hdata->async.result, ret);
 }
 
+struct hash_digest_work {
+	struct work_struct work;
+	struct ahash_request *req;
+	struct cryptodev_result result;
+	int rc;
+};
+
+static void hash_digest_routine(struct work_struct *work)
+{
+	struct hash_digest_work *w =
+		container_of(work, struct hash_digest_work, work);
+
+	w->rc = waitfor(&w->result, crypto_ahash_digest(w->req));
+}
+
+/* Computes the digests of count independent messages, output having
+ * space for count digests. With an asynchronous transform all requests
+ * are submitted before waiting for any of them, so that the engine has
+ * them all. A synchronous one would compute each digest within
+ * crypto_ahash_digest(), one after the other on this CPU, so there each
+ * message is a work item on the unbound system workqueue instead, and
+ * the messages are hashed on as many CPUs as the workqueue uses.
+ */
+int cryptodev_hash_digest_many(struct hash_data *hdata,
+			struct scatterlist **sg, const uint32_t *len,
+			int count, uint8_t *output)
+{
+	struct hash_digest_work *w;
+	int async = crypto_tfm_alg_flags(crypto_ahash_tfm(hdata->async.s)) &
+		    CRYPTO_ALG_ASYNC;
+	int i, submitted, ret = 0;
+
+	if (unlikely(count > HASH_BATCH_WINDOW))
+		return -EINVAL;
+
+	w = kcalloc(count, sizeof(*w), GFP_KERNEL);
+	if (unlikely(!w))
+		return -ENOMEM;
+
+	for (submitted = 0; submitted < count; submitted++) {
+		struct hash_digest_work *cur = &w[submitted];
+
+		cur->req = ahash_request_alloc(hdata->async.s, GFP_KERNEL);
+		if (unlikely(!cur->req)) {
+			derr(0, "error allocating async crypto request");
+			ret = -ENOMEM;
+			break;
+		}
+
+		init_completion(&cur->result.completion);
+		ahash_request_set_callback(cur->req, CRYPTO_TFM_REQ_MAY_BACKLOG,
+				cryptodev_complete, &cur->result);
+		ahash_request_set_crypt(cur->req, sg[submitted],
+				output + submitted * hdata->digestsize,
+				len[submitted]);
+
+		if (!async) {
+			INIT_WORK(&cur->work, hash_digest_routine);
+			queue_work(system_unbound_wq, &cur->work);
+			continue;
+		}
+
+		cur->rc = crypto_ahash_digest(cur->req);
+		if (cur->rc != 0 && cur->rc != -EINPROGRESS && cur->rc != -EBUSY) {
+			ret = cur->rc;
+			ahash_request_free(cur->req);
+			break;
+		}
+	}
+
+	/* wait for everything in flight, even on error */
+	for (i = 0; i < submitted; i++) {
+		int err;
+
+		if (async) {
+			err = waitfor(&w[i].result, w[i].rc);
+		} else {
+			flush_work(&w[i].work);
+			err = w[i].rc;
+		}
+		if (unlikely(err) && ret == 0)
+			ret = err;
+		ahash_request_free(w[i].req);
+	}
+
+	kfree(w);
+	return ret;
+}
+
+/* The acomp interface is available since 4.10 */
+int cryptodev_compress_init(struct compress_data *zdata, const char *alg_name)
+{
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(4, 10, 0))
+	ddebug(1, "no asynchronous compression support for %s", alg_name);
+	return -EINVAL;
+#else
+	zdata->async.s = crypto_alloc_acomp(alg_name, 0, 0);
+	if (unlikely(IS_ERR(zdata->async.s))) {
+		ddebug(1, "Failed to load transform for %s", alg_name);
+		return -EINVAL;
+	}
+
+	init_completion(&zdata->async.result.completion);
+
+	zdata->async.request = acomp_request_alloc(zdata->async.s);
+	if (unlikely(!zdata->async.request)) {
+		derr(0, "error allocating async crypto request");
+		crypto_free_acomp(zdata->async.s);
+		return -ENOMEM;
+	}
+
+	acomp_request_set_callback(zdata->async.request,
+			CRYPTO_TFM_REQ_MAY_BACKLOG,
+			cryptodev_complete, &zdata->async.result);
+	zdata->init = 1;
+	return 0;
+#endif
+}
+
+void cryptodev_compress_deinit(struct compress_data *zdata)
+{
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 10, 0))
+	if (zdata->init) {
+		acomp_request_free(zdata->async.request);
+		crypto_free_acomp(zdata->async.s);
+		zdata->init = 0;
+	}
+#endif
+}
+
+/* Returns the length of the output, or a negative error (e.g., when it
+ * does not fit in dst_len bytes).
+ */
+ssize_t cryptodev_compress(struct compress_data *zdata, int compress,
+			struct scatterlist *src, size_t src_len,
+			struct scatterlist *dst, size_t dst_len)
+{
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(4, 10, 0))
+	return -EINVAL;
+#else
+	int ret;
+
+	reinit_completion(&zdata->async.result.completion);
+	acomp_request_set_params(zdata->async.request, src, dst,
+				 src_len, dst_len);
+
+	if (compress)
+		ret = crypto_acomp_compress(zdata->async.request);
+	else
+		ret = crypto_acomp_decompress(zdata->async.request);
+
+	ret = waitfor(&zdata->async.result, ret);
+	if (unlikely(ret))
+		return ret;
+
+	return zdata->async.request->dlen;
+#endif
+}
+
+/* Allocates the default random number generator and seeds it, like
+ * crypto_get_default_rng() does for the shared instance.
+ */
+struct crypto_rng *cryptodev_rng_alloc(void)
+{
+	struct crypto_rng *rng;
+	int ret;
+
+	rng = crypto_alloc_rng("stdrng", 0, 0);
+	if (unlikely(IS_ERR(rng))) {
+		ddebug(1, "Failed to load transform for stdrng");
+		return rng;
+	}
+
+	ret = crypto_rng_reset(rng, NULL, crypto_rng_seedsize(rng));
+	if (unlikely(ret)) {
+		ddebug(1, "Seeding the generator failed: %d", ret);
+		crypto_free_rng(rng);
+		return ERR_PTR(ret);
+	}
+
+	ddebug(1, "Random number generator: %s",
+	       crypto_tfm_alg_driver_name(crypto_rng_tfm(rng)));
+	return rng;
+}
+
+/* Public key operations. Numbers are big endian. */
+
+/* strips the leading zeros of a number */
+static const uint8_t *pk_strip(const uint8_t *v, size_t *len)
+{
+	while (*len && *v == 0) {
+		v++;
+		(*len)--;
+	}
+	return v;
+}
+
+/* stores a result right-aligned in out_len bytes */
+static int pk_copy_result(uint8_t *out, size_t out_len,
+			  const uint8_t *res, size_t res_len)
+{
+	res = pk_strip(res, &res_len);
+	if (unlikely(res_len > out_len))
+		return -EOVERFLOW;
+
+	memset(out, 0, out_len - res_len);
+	memcpy(out + out_len - res_len, res, res_len);
+	return 0;
+}
+
+static unsigned int ber_put_len(uint8_t *p, size_t len)
+{
+	if (len < 0x80) {
+		p[0] = len;
+		return 1;
+	} else if (len < 0x100) {
+		p[0] = 0x81;
+		p[1] = len;
+		return 2;
+	}
+	p[0] = 0x82;
+	p[1] = len >> 8;
+	p[2] = len;
+	return 3;
+}
+
+/* Encodes a positive INTEGER; with p NULL it only returns the size. */
+static unsigned int ber_put_int(uint8_t *p, const uint8_t *v, size_t len)
+{
+	unsigned int pad, hdr;
+	uint8_t tmp[3];
+
+	v = pk_strip(v, &len);
+	pad = (len == 0 || v[0] & 0x80) ? 1 : 0;
+	hdr = 1 + ber_put_len(tmp, len + pad);
+	if (p) {
+		p[0] = 0x02;
+		ber_put_len(p + 1, len + pad);
+		if (pad)
+			p[hdr] = 0;
+		memcpy(p + hdr + pad, v, len);
+	}
+	return hdr + pad + len;
+}
+
+/* The RSAPublicKey structure of the kernel's "rsa" akcipher. It needs
+ * at most mod_len + exp_len + 16 bytes.
+ */
+static unsigned int rsa_pub_key_encode(uint8_t *key,
+				const uint8_t *mod, size_t mod_len,
+				const uint8_t *exp, size_t exp_len)
+{
+	unsigned int len, pos;
+
+	len = ber_put_int(NULL, mod, mod_len) + ber_put_int(NULL, exp, exp_len);
+	key[0] = 0x30;
+	pos = 1 + ber_put_len(key + 1, len);
+	pos += ber_put_int(key + pos, mod, mod_len);
+	pos += ber_put_int(key + pos, exp, exp_len);
+	return pos;
+}
+
+/*
+ * Computes out = base^exp mod mod with the "rsa" akcipher, so that an RSA
+ * engine is used when there is one: the modulus and exponent are set as
+ * a public key and the base is encrypted. The modulus must be of a size
+ * supported for RSA keys and base smaller than it. The result is stored
+ * right-aligned in out_len bytes.
+ */
+int cryptodev_pk_mod_exp(const uint8_t *base, size_t base_len,
+			const uint8_t *exp, size_t exp_len,
+			const uint8_t *mod, size_t mod_len,
+			uint8_t *out, size_t out_len)
+{
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(4, 8, 0))
+	return -EOPNOTSUPP;
+#else
+	struct crypto_akcipher *tfm;
+	struct akcipher_request *req = NULL;
+	struct cryptodev_result result;
+	struct scatterlist src, dst;
+	uint8_t *key, *in = NULL, *res = NULL;
+	unsigned int size;
+	int ret;
+
+	tfm = crypto_alloc_akcipher("rsa", 0, 0);
+	if (unlikely(IS_ERR(tfm))) {
+		ddebug(1, "Failed to load transform for rsa");
+		return PTR_ERR(tfm);
+	}
+
+	key = kmalloc(mod_len + exp_len + 16, GFP_KERNEL);
+	if (unlikely(!key)) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = crypto_akcipher_set_pub_key(tfm, key,
+			rsa_pub_key_encode(key, mod, mod_len, exp, exp_len));
+	kzfree(key);
+	if (unlikely(ret)) {
+		ddebug(1, "Setting the key failed: %d", ret);
+		goto out;
+	}
+
+	size = crypto_akcipher_maxsize(tfm);
+	base = pk_strip(base, &base_len);
+	if (unlikely(base_len > size)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	in = kzalloc(size, GFP_KERNEL);
+	res = kmalloc(size, GFP_KERNEL);
+	req = akcipher_request_alloc(tfm, GFP_KERNEL);
+	if (unlikely(!in || !res || !req)) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	memcpy(in + size - base_len, base, base_len);
+
+	sg_init_one(&src, in, size);
+	sg_init_one(&dst, res, size);
+	init_completion(&result.completion);
+	akcipher_request_set_callback(req, CRYPTO_TFM_REQ_MAY_BACKLOG,
+				      cryptodev_complete, &result);
+	akcipher_request_set_crypt(req, &src, &dst, size, size);
+
+	ret = waitfor(&result, crypto_akcipher_encrypt(req));
+	if (unlikely(ret))
+		goto out;
+
+	ret = pk_copy_result(out, out_len, res, req->dst_len);
+
+out:
+	if (req)
+		akcipher_request_free(req);
+	kzfree(in);
+	kzfree(res);
+	crypto_free_akcipher(tfm);
+	return ret;
+#endif
+}
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 8, 0))
+/* Computes a shared secret with a kpp transform, given its packed secret
+ * and the public key of the peer.
+ */
+static int pk_kpp_compute(const char *alg_name, const void *secret,
+			unsigned int secret_len, const uint8_t *pub,
+			size_t pub_len, uint8_t *out, size_t out_len)
+{
+	struct crypto_kpp *tfm;
+	struct kpp_request *req = NULL;
+	struct cryptodev_result result;
+	struct scatterlist src, dst;
+	uint8_t *in = NULL, *res = NULL;
+	unsigned int size;
+	int ret;
+
+	tfm = crypto_alloc_kpp(alg_name, 0, 0);
+	if (unlikely(IS_ERR(tfm))) {
+		ddebug(1, "Failed to load transform for %s", alg_name);
+		return PTR_ERR(tfm);
+	}
+
+	ret = crypto_kpp_set_secret(tfm, secret, secret_len);
+	if (unlikely(ret)) {
+		ddebug(1, "Setting the secret failed: %d", ret);
+		goto out;
+	}
+
+	size = crypto_kpp_maxsize(tfm);
+	in = kmemdup(pub, pub_len, GFP_KERNEL);
+	res = kmalloc(size, GFP_KERNEL);
+	req = kpp_request_alloc(tfm, GFP_KERNEL);
+	if (unlikely(!in || !res || !req)) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	sg_init_one(&src, in, pub_len);
+	sg_init_one(&dst, res, size);
+	init_completion(&result.completion);
+	kpp_request_set_callback(req, CRYPTO_TFM_REQ_MAY_BACKLOG,
+				 cryptodev_complete, &result);
+	kpp_request_set_input(req, &src, pub_len);
+	kpp_request_set_output(req, &dst, size);
+
+	ret = waitfor(&result, crypto_kpp_compute_shared_secret(req));
+	if (likely(ret == 0))
+		ret = pk_copy_result(out, out_len, res, req->dst_len);
+
+out:
+	if (req)
+		kpp_request_free(req);
+	kfree(in);
+	kzfree(res);
+	crypto_free_kpp(tfm);
+	return ret;
+}
+#endif
+
+/* Finite field Diffie-Hellman: out = pub^priv mod p */
+int cryptodev_pk_dh(const uint8_t *priv, size_t priv_len,
+			const uint8_t *pub, size_t pub_len,
+			const uint8_t *p, size_t p_len,
+			uint8_t *out, size_t out_len)
+{
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(4, 8, 0))
+	return -EOPNOTSUPP;
+#else
+	/* the generator is only needed to generate public keys */
+	static const uint8_t g = 2;
+	struct dh params;
+	unsigned int len;
+	uint8_t *secret;
+	int ret;
+
+	memset(&params, 0, sizeof(params));
+	params.key = (void *)pk_strip(priv, &priv_len);
+	params.key_size = priv_len;
+	params.p = (void *)pk_strip(p, &p_len);
+	params.p_size = p_len;
+	params.g = (void *)&g;
+	params.g_size = 1;
+	pub = pk_strip(pub, &pub_len);
+
+	len = crypto_dh_key_len(&params);
+	secret = kmalloc(len, GFP_KERNEL);
+	if (unlikely(!secret))
+		return -ENOMEM;
+
+	ret = crypto_dh_encode_key(secret, len, &params);
+	if (likely(ret == 0))
+		ret = pk_kpp_compute("dh", secret, len, pub, pub_len,
+				     out, out_len);
+
+	kzfree(secret);
+	return ret;
+#endif
+}
+
+/*
+ * Elliptic curve Diffie-Hellman on P-256 or P-384, chosen by the size of
+ * the private key. The public key of the peer is x || y and the output
+ * is the x coordinate of the shared point. Kernels before 5.12 only
+ * provide P-256.
+ */
+int cryptodev_pk_ecdh(const uint8_t *priv, size_t priv_len,
+			const uint8_t *pub, size_t pub_len,
+			uint8_t *out, size_t out_len)
+{
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(4, 8, 0))
+	return -EOPNOTSUPP;
+#else
+	struct ecdh params;
+	const char *alg_name;
+	unsigned int len;
+	uint8_t *secret;
+	int ret;
+
+	if (unlikely(pub_len != 2 * priv_len))
+		return -EINVAL;
+
+	memset(&params, 0, sizeof(params));
+	switch (priv_len) {
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 12, 0))
+	case 32:
+		alg_name = "ecdh-nist-p256";
+		break;
+	case 48:
+		alg_name = "ecdh-nist-p384";
+		break;
+#else
+	case 32:
+		alg_name = "ecdh";
+		params.curve_id = ECC_CURVE_NIST_P256;
+		break;
+#endif
+	default:
+		ddebug(1, "unsupported curve size %zu", priv_len * 8);
+		return -EOPNOTSUPP;
+	}
+
+	params.key = (void *)priv;
+	params.key_size = priv_len;
+
+	len = crypto_ecdh_key_len(&params);
+	secret = kmalloc(len, GFP_KERNEL);
+	if (unlikely(!secret))
+		return -ENOMEM;
+
+	ret = crypto_ecdh_encode_key(secret, len, &params);
+	if (likely(ret == 0))
+		ret = pk_kpp_compute(alg_name, secret, len, pub, pub_len,
+				     out, out_len);
+
+	kzfree(secret);
+	return ret;
+#endif
+}
@@ -44,6 +44,30 @@ ssize_t cryptodev_cipher_encrypt(struct cipher_data *cdata,
 				const struct scatterlist *sg1,
 				struct scatterlist *sg2, size_t len);
 
+/* maximum number of data units cryptodev_cipher_crypt_units() keeps in flight */
+#define CIPHER_UNIT_WINDOW 16
+
+int cryptodev_cipher_crypt_units(struct cipher_data *cdata, int encrypt,
+			struct scatterlist *src, struct scatterlist *dst,
+			size_t len, size_t du_size, u64 du_index);
+
+/* maximum number of requests cryptodev_cipher_aead_many() takes at once */
+#define CIPHER_AEAD_WINDOW 16
+
+/* an in-place AEAD request of cryptodev_cipher_aead_many() */
+struct cipher_aead_req {
+	struct scatterlist *sg;		/* the additional data, then the data */
+	unsigned int ad_len;
+	size_t len;			/* of the data, with the tag on decryption */
+	uint8_t iv[EALG_MAX_BLOCK_LEN];
+	uint8_t ad[16];			/* room for the additional data */
+	struct scatterlist ad_sg[2], data_sg[2];	/* room for sg */
+	int rc;				/* on return, the outcome */
+};
+
+int cryptodev_cipher_aead_many(struct cipher_data *cdata, int encrypt,
+			struct cipher_aead_req *reqs, unsigned int count);
+
 /* AEAD */
 static inline void cryptodev_cipher_auth(struct cipher_data *cdata,
 					 struct scatterlist *sg1, size_t len)
@@ -86,6 +110,7 @@ static inline void cryptodev_cipher_get_iv(struct cipher_data *cdata,
 struct hash_data {
 	int init; /* 0 uninitialized */
 	int digestsize;
+	int statesize;
 	int alignmask;
 	struct {
 		struct crypto_ahash *s;
@@ -95,12 +120,55 @@ struct hash_data {
 };
 
 int cryptodev_hash_final(struct hash_data *hdata, void *output);
+int cryptodev_hash_digest(struct hash_data *hdata, struct scatterlist *sg,
+			  size_t len, void *output);
 ssize_t cryptodev_hash_update(struct hash_data *hdata,
 			struct scatterlist *sg, size_t len);
 int cryptodev_hash_reset(struct hash_data *hdata);
+int cryptodev_hash_export(struct hash_data *hdata, void *out);
+int cryptodev_hash_import(struct hash_data *hdata, const void *in);
 void cryptodev_hash_deinit(struct hash_data *hdata);
 int cryptodev_hash_init(struct hash_data *hdata, const char *alg_name,
 			int hmac_mode, void *mackey, size_t mackeylen);
 
+/* maximum number of requests cryptodev_hash_digest_many() keeps in flight */
+#define HASH_BATCH_WINDOW 16
+
+int cryptodev_hash_digest_many(struct hash_data *hdata,
+			struct scatterlist **sg, const uint32_t *len,
+			int count, uint8_t *output);
+
+/* Compression */
+struct compress_data {
+	int init; /* 0 uninitialized */
+	struct {
+		struct crypto_acomp *s;
+		struct acomp_req *request;
+		struct cryptodev_result result;
+	} async;
+};
+
+int cryptodev_compress_init(struct compress_data *zdata, const char *alg_name);
+void cryptodev_compress_deinit(struct compress_data *zdata);
+ssize_t cryptodev_compress(struct compress_data *zdata, int compress,
+			struct scatterlist *src, size_t src_len,
+			struct scatterlist *dst, size_t dst_len);
+
+/* Random numbers */
+struct crypto_rng *cryptodev_rng_alloc(void);
+
+/* Public key */
+int cryptodev_pk_mod_exp(const uint8_t *base, size_t base_len,
+			const uint8_t *exp, size_t exp_len,
+			const uint8_t *mod, size_t mod_len,
+			uint8_t *out, size_t out_len);
+int cryptodev_pk_dh(const uint8_t *priv, size_t priv_len,
+			const uint8_t *pub, size_t pub_len,
+			const uint8_t *p, size_t p_len,
+			uint8_t *out, size_t out_len);
+int cryptodev_pk_ecdh(const uint8_t *priv, size_t priv_len,
+			const uint8_t *pub, size_t pub_len,
+			uint8_t *out, size_t out_len);
+
 
 #endif
@@ -50,6 +50,22 @@ enum cryptodev_crypto_op_t {
 	CRYPTO_SHA2_384,
 	CRYPTO_SHA2_512,
 	CRYPTO_SHA2_224_HMAC,
+	CRYPTO_CHACHA20, /* IV: 32-bit LE block counter || 96-bit nonce */
+	CRYPTO_CHACHA20_POLY1305,
+	CRYPTO_AES_CMAC,
+	CRYPTO_AES_XCBC_MAC,
+	CRYPTO_POLY1305, /* the one-time key is the first 32 bytes of data */
+	CRYPTO_AES_GMAC, /* cipher; CIOCAUTHCRYPT with the data in auth_src
+			  * and len 0 writes the tag to dst */
+	CRYPTO_SHA3_256,
+	CRYPTO_SHA3_384,
+	CRYPTO_SHA3_512,
+	CRYPTO_SHA3_256_HMAC,
+	CRYPTO_SHA3_384_HMAC,
+	CRYPTO_SHA3_512_HMAC,
+	CRYPTO_BLAKE2B_256, /* BLAKE2 is keyed natively if a mackey is given */
+	CRYPTO_BLAKE2B_512,
+	CRYPTO_BLAKE2S_256,
 	CRYPTO_ALGORITHM_ALL, /* Keep updated - see below */
 };
 
@@ -116,6 +132,10 @@ struct session_info_op {
 #define	COP_ENCRYPT	0
 #define COP_DECRYPT	1
 
+/* ops of compression sessions */
+#define COP_COMPRESS	0
+#define COP_DECOMPRESS	1
+
 /* input of CIOCCRYPT */
 struct crypt_op {
 	__u32	ses;		/* session identifier */
@@ -158,9 +178,11 @@ struct crypt_auth_op {
 
 /* In plain AEAD mode the following are required:
  *  flags   : 0
- *  iv      : the initialization vector (12 bytes)
+ *  iv      : the initialization vector (12 bytes for GCM and
+ *            ChaCha20-Poly1305)
  *  auth_len: the length of the data to be authenticated
- *  auth_src: the data to be authenticated
+ *  auth_src: the data to be authenticated. Large auth data are mapped
+ *            instead of copied when the operation is in-place.
  *  len     : length of data to be encrypted
  *  src     : the data to be encrypted
  *  dst     : space to hold encrypted data. It must have
@@ -185,7 +207,28 @@ struct crypt_auth_op {
  *  tag_size: the size of the desired authentication tag or zero to use
  *            the default mac output.
  *
- * Note that the padding used is the minimum padding.
+ * Note that the padding used is the minimum padding. If the kernel provides
+ * a fused tls10() transform for the session's cipher and MAC (e.g., by an
+ * engine driver) the record is processed in a single pass.
+ */
+
+/* With COP_FLAG_TLS_ETM (RFC 7366) the MAC is computed over the ciphertext
+ * and follows the padding, and with COP_FLAG_DTLS the record has a DTLS
+ * header (RFC 6347). In both cases the kernel completes the MAC header:
+ *  auth_len: 13
+ *  auth_src: the sequence number, type, version and length that the MAC
+ *            covers or, with COP_FLAG_DTLS, the DTLS record header (type,
+ *            version, epoch, sequence number and length). The kernel
+ *            sets the length; on encryption it writes it back, which for
+ *            DTLS is the length of the record.
+ *  iv      : the explicit IV of the record (TLS 1.1 and later, DTLS),
+ *            which precedes the ciphertext on the wire, or NULL to chain
+ *            the IV as in TLS 1.0. Encrypt-then-MAC authenticates it and
+ *            the DTLS length includes it.
+ *  dst     : with encrypt-then-MAC it must have room for len rounded up
+ *            to the next block, plus tag_size bytes.
+ * Records with a wrong MAC are rejected before being decrypted with
+ * encrypt-then-MAC.
  */
 
 /* In SRTP mode the following are required:
@@ -201,8 +244,322 @@ struct crypt_auth_op {
  *  tag_size: the size of the desired authentication tag or zero to use
  *            the default mac output.
  *  tag     : Pointer to an address where the authentication tag will be copied.
+ *
+ * With an AEAD cipher (AES-GCM, RFC 7714) the tag is not copied but follows
+ * the encrypted payload, as in the packet:
+ *  iv      : the 12-byte IV, (0 || SSRC || ROC || SEQ) XOR salt for SRTP or
+ *            (0 || SSRC || 0 || index) XOR salt for SRTCP
+ *  auth_len: the length of the header, the payload and, for SRTCP, the
+ *            E flag and index that follow the tag, i.e., the packet without
+ *            the tag. The header and the trailer are the additional data.
+ *  len     : length of the plaintext, or of the ciphertext and the tag
+ *  tag_size: zero or 16
+ */
+
+/* The kernel derives the IV of SRTP packets (not SRTCP) if iv is NULL and
+ * the session salt was set with CIOCRECORD: 14 bytes for AES-CM or 12 for
+ * AES-GCM (the sequence number is not used). The session tracks the
+ * rollover counter and highest sequence number of up to 16 SSRCs, as in
+ * RFC 3711, appendix A, and updates them once a packet is authenticated.
+ * A packet then needs:
+ *  iv      : NULL
+ *  auth_src: the packet, starting with the RTP header
+ *  auth_len: the length of the packet without the tag
+ *  tag_size: the size of the tag, which follows the packet
+ * The kernel sets src, dst and len to the payload after the header, its
+ * CSRCs and extension, and authenticates the rollover counter with
+ * HMAC; it must not be appended to the packet.
+ */
+
+/* input of CIOCSRTPBATCH */
+struct srtp_batch_op {
+	__u32	count;		/* number of packets */
+	struct crypt_auth_op __user *caops;	/* packets in SRTP mode */
+	__s32	__user *status;	/* outcome of each packet, 0 or a negative
+				 * error code such as -EBADMSG */
+};
+
+/* CIOCSRTPBATCH processes many packets with a single call, each one as if
+ * it were given to CIOCAUTHCRYPT with COP_FLAG_AEAD_SRTP_TYPE: they may use
+ * different sessions and each has its own IV and tag. The len of each
+ * successful packet is updated; the ioctl only fails if the batch itself
+ * cannot be accessed.
+ */
+
+/* In TLS 1.3 mode (AEAD sessions with a 12-byte IV, e.g., AES-GCM or
+ * ChaCha20-Poly1305) the kernel builds the nonce and the additional data
+ * of each record. The static IV and the sequence number are set with
+ * CIOCRECORD and the sequence number is increased after every record.
+ *  flags   : COP_FLAG_AEAD_TLS13_TYPE
+ *  iv      : NULL
+ *  auth_len: 5
+ *  auth_src: the record header. On encryption its first byte is the
+ *            content type of the record and the kernel writes the complete
+ *            header (application_data, 0x0303, length) back. On decryption
+ *            it is the received header and the inner content type is
+ *            written to its first byte.
+ *  len     : length of the plaintext, or of the received ciphertext
+ *            including the tag
+ *  src     : the data, which must be the same as dst (in-place only)
+ *  dst     : on encryption it must have room for len + 1 + tag_size
+ *            bytes, for the content type and the tag. On return len is
+ *            the length of the ciphertext, or of the plaintext without
+ *            the content type and padding.
+ *  tag_size: zero
+ */
+
+/* In TLS 1.2 GCM mode (AES-GCM sessions, RFC 5288) the kernel builds the
+ * explicit nonce and the additional data of each record. The 4-byte salt
+ * (the implicit part of the nonce) and the sequence number are set with
+ * CIOCRECORD and the sequence number is increased after every record.
+ *  flags   : COP_FLAG_AEAD_TLS12_GCM_TYPE
+ *  iv      : NULL
+ *  auth_len: 5
+ *  auth_src: the record header. On encryption the type and version are
+ *            given and the kernel writes the length back.
+ *  len     : length of the plaintext, or of the received record body
+ *            (explicit nonce, ciphertext and tag)
+ *  src     : the record body, which must be the same as dst (in-place only)
+ *  dst     : on encryption it must have room for 8 + len + tag_size bytes;
+ *            the plaintext is read from dst + 8 and the kernel writes the
+ *            sequence number as explicit nonce in front of it. On return len
+ *            is the length of the record body, or of the plaintext, which
+ *            is left at dst + 8.
+ *  tag_size: zero
+ * With COP_FLAG_DTLS auth_len is 13 and auth_src the DTLS header. On
+ * encryption the kernel writes the epoch and sequence number of the session
+ * (epoch << 48 | seq) into it, and fails with EOVERFLOW once the 48-bit
+ * sequence number is exhausted; on decryption they are read from it.
+ */
+
+/* input of CIOCTLSBATCH */
+struct tls_batch_op {
+	__u32	ses;		/* session identifier */
+	__u16	flags;		/* COP_FLAG_AEAD_TLS13_TYPE or
+				 * COP_FLAG_AEAD_TLS12_GCM_TYPE */
+	__u8	type;		/* content type of the records */
+	__u8	__pad;
+	__u32	len;		/* length of the plaintext; on return, of
+				 * the records */
+	__u32	max_record;	/* maximum plaintext of a record, or zero
+				 * for 2^14 */
+	__u32	records;	/* on return, the number of records */
+	__u8	__user *src;	/* the plaintext */
+	__u8	__user *dst;	/* the records, may be the same as src */
+};
+
+/* CIOCTLSBATCH splits a plaintext into records of max_record bytes (the
+ * last one may be shorter) and seals them with a TLS 1.3 or TLS 1.2 GCM
+ * session, as CIOCAUTHCRYPT would, using consecutive sequence numbers.
+ * The records, each with its header, are written one after another to
+ * dst, which must have room for len + records * 22 (TLS 1.3) or 29 (TLS
+ * 1.2 GCM) bytes; at most 64 records are produced per call. With src
+ * equal to dst the plaintext is moved in place. The records are sealed
+ * 16 at a time, all of them submitted to the driver before waiting.
+ * If a record fails, the call fails but still returns in records the
+ * number of records sealed before it, at the start of dst, and in len
+ * their length. Their sequence numbers are used up, as is that of the
+ * failed record and possibly those after it in its group of 16; the rest
+ * of dst, and in place of the plaintext, is undefined.
+ */
+
+/* In ESP mode (RFC 4303) the kernel builds and parses complete ESP packets
+ * of the SA set with CIOCESPSA: header, IV, padding, trailer and ICV.
+ *  flags   : COP_FLAG_AEAD_ESP_TYPE
+ *  iv      : NULL
+ *  auth_len: 1
+ *  auth_src: the next header. It is given on encryption and written back
+ *            on decryption.
+ *  len     : length of the payload, or of the received ESP packet
+ *  src     : the ESP packet, which must be the same as dst (in-place only)
+ *  dst     : on encryption the payload is read from dst + 8 + IV size
+ *            (8 with AES-GCM, the block size with CBC) and the packet
+ *            must have room for the padding, the 2-byte trailer and the
+ *            ICV. On return len is the length of the packet, or of the
+ *            payload, which is left at dst + 8 + IV size.
+ *  tag_size: the ICV size, or zero for 16 with AES-GCM and half the HMAC
+ *            output (RFC 4868) otherwise
+ * Inbound packets for another SPI, with a replayed sequence number or a
+ * wrong ICV fail with EBADMSG. The sequence number of outbound packets
+ * is generated by the kernel; the SA expires (EOVERFLOW) when it would
+ * cycle.
+ */
+
+
+/* a message of struct hash_batch_op */
+struct hash_batch_msg {
+	__u8	__user *src;	/* message data */
+	__u32	len;		/* length of message */
+};
+
+/* input of CIOCHASHBATCH */
+struct hash_batch_op {
+	__u32	ses;		/* session identifier (hash or MAC only) */
+	__u32	count;		/* number of messages */
+	struct hash_batch_msg __user *msgs;
+	/* the digests of the messages, stored back to back. Must have
+	 * space for count times the digest size. */
+	__u8	__user *mac;
+};
+
+/* In batch hashing mode each message is hashed independently (the
+ * session's multi-update state is not used nor affected), as if a
+ * separate CIOCCRYPT were issued for each one. The messages are taken
+ * 16 at a time: with an asynchronous driver they are all submitted to
+ * it before waiting, and with a software one they are hashed in
+ * parallel by kernel workers on other CPUs.
+ */
+
+/* input of CIOCHASHEXPORT and CIOCHASHIMPORT */
+struct hash_state_op {
+	__u32	ses;		/* session identifier (hash or MAC only) */
+	__u32	len;		/* size of state. Set on export to the size
+				 * of the session's state. */
+	__u8	__user *state;	/* the exported (or to be imported) state */
+};
+
+/* The state of a multi-update hash (see COP_FLAG_UPDATE) can be exported
+ * from a session and later imported into the same or another session
+ * of the same algorithm and key, to continue from that point. That way
+ * many streams can share a few sessions. The state is opaque and
+ * specific to the driver; an export with state NULL returns its size.
+ * It is authenticated with a key that lasts until the module is
+ * unloaded: importing a state that was not exported since then, or that
+ * comes from another driver, fails with EBADMSG.
+ */
+
+/* input of CIOCKDF */
+struct kdf_op {
+	__u32	ses;		/* session identifier (HMAC only) */
+	__u16	op;		/* KDF_HKDF_EXTRACT, KDF_HKDF_EXPAND, ... */
+	__u16	flags;		/* reserved, set to zero */
+	__u32	in_len;		/* length of in */
+	__u32	info_len;	/* length of info, KDF_HKDF only */
+	__u32	out_len;	/* number of bytes to derive */
+	__u8	__user *in;	/* input keying material, info or label||seed */
+	__u8	__user *info;	/* KDF_HKDF only */
+	__u8	__user *out;	/* derived bytes */
+};
+
+/* Key derivation with the key of an HMAC session:
+ *  KDF_HKDF_EXTRACT: key is the salt, in the input keying material; out
+ *                    gets the pseudorandom key (out_len is the digest size).
+ *  KDF_HKDF_EXPAND:  key is the pseudorandom key, in the info (RFC 5869).
+ *  KDF_HKDF:         extract then expand: key is the salt, in the input
+ *                    keying material and info the info.
+ *  KDF_TLS12_PRF:    key is the secret, in is label || seed (RFC 5246).
+ * The session's multi-update state is not preserved.
+ */
+enum cryptodev_kdf_op_t {
+	KDF_HKDF_EXTRACT = 0,
+	KDF_HKDF_EXPAND = 1,
+	KDF_HKDF = 2,
+	KDF_TLS12_PRF = 3,
+};
+
+/* input of CIOCCRYPTDU */
+struct crypt_du_op {
+	__u32	ses;		/* session identifier (cipher only) */
+	__u16	op;		/* COP_ENCRYPT or COP_DECRYPT */
+	__u16	flags;		/* reserved, set to zero */
+	__u32	len;		/* length of data, a multiple of du_size */
+	__u32	du_size;	/* size of a data unit, e.g. 512 or 4096 */
+	__u64	du_index;	/* number of the first data unit */
+	__u8	__user *src;	/* source data */
+	__u8	__user *dst;	/* pointer to output data */
+};
+
+/* A data unit operation processes a buffer of consecutive data units
+ * (disk sectors) in one call, each one with its own IV: the number of
+ * the unit as a 64-bit little endian integer padded with zeros, the
+ * first unit being du_index. That is the tweak storage encryption uses
+ * with XTS (CRYPTO_AES_XTS) and matches dm-crypt's "plain64".
+ */
+
+/* input of CIOCIVCOUNTER */
+struct iv_counter_op {
+	__u32	ses;		/* session identifier */
+	__u32	salt_len;	/* length of salt */
+	__u8	__user *salt;	/* fixed leading part of the IVs */
+	__u64	counter;	/* counter value of the next IV */
+};
+
+/* A session of a stream cipher or AEAD (e.g., CTR, GCM, ChaCha20-Poly1305)
+ * can be switched with CIOCIVCOUNTER to kernel-generated IVs. The IV of
+ * each encryption is then salt || counter (64-bit big endian), followed
+ * by zeros up to the IV size of the cipher, and the counter is increased
+ * by one after every use. With CTR the last 32 bits of the IV are left
+ * to the block counter, and with ChaCha20 the first 32 bits are: there
+ * the IV is zeros || salt || counter. The salt must fit next to them. The iv given with CIOCCRYPT or CIOCAUTHCRYPT
+ * is not read when encrypting; if not NULL the IV used is written there.
+ * Decryption still uses the IV given by the caller. Once the counter
+ * reaches its maximum value encryption fails with EOVERFLOW.
+ */
+
+/* input of CIOCRECORD */
+struct record_state_op {
+	__u32	ses;		/* session identifier */
+	__u32	iv_len;		/* length of iv */
+	__u8	__user *iv;	/* static IV of the records */
+	__u64	seq;		/* sequence number of the next record */
+};
+
+/* The record modes of CIOCAUTHCRYPT (e.g., COP_FLAG_AEAD_TLS13_TYPE) keep
+ * their IV and sequence number in the session, so each direction of a
+ * connection uses its own session. The state is set once per session, so
+ * that the sequence number cannot be rewound; setting it again (or with
+ * CIOCESPSA) fails with EBUSY.
+ */
+
+/* input of CIOCESPSA */
+struct esp_sa_op {
+	__u32	ses;		/* session identifier */
+	__u32	spi;		/* security parameter index */
+	__u32	flags;		/* see ESP_SA_* */
+	__u32	replay_window;	/* anti-replay window of an inbound SA, up
+				 * to 64 packets, or zero to disable it */
+	__u32	salt_len;	/* 4 for AES-GCM, otherwise zero */
+	__u8	__user *salt;	/* the salt of an AES-GCM key (RFC 4106) */
+	__u64	seq;		/* sequence number of the next outbound
+				 * packet, usually 1 */
+};
+
+#define ESP_SA_ESN	(1 << 0) /* 64-bit extended sequence numbers */
+
+/* CIOCESPSA turns a session into one direction of an IPsec SA for the ESP
+ * mode of CIOCAUTHCRYPT. The session is either AES-GCM, or a CBC cipher
+ * with an HMAC. Like CIOCRECORD it is only accepted once per session.
+ */
+
+/* input of CIOCCOMPRESS */
+struct compress_op {
+	__u32	ses;		/* session identifier (compression) */
+	__u16	op;		/* COP_COMPRESS or COP_DECOMPRESS */
+	__u16	flags;		/* reserved, set to zero */
+	__u32	src_len;	/* length of source data */
+	__u32	dst_len;	/* size of dst. Set to the length of the
+				 * output on return */
+	__u8	__user *src;	/* source data */
+	__u8	__user *dst;	/* pointer to output data, not overlapping src */
+};
+
+/* Compression sessions are created with CIOCGSESSION by setting cipher
+ * to CRYPTO_DEFLATE_COMP (raw deflate, RFC 1951) or CRYPTO_LZS_COMP (only
+ * if a driver provides "lzs") and no key. Each CIOCCOMPRESS is a complete
+ * stream; if the output does not fit in dst_len the call fails.
  */
 
+/* input of CIOCRANDOM */
+struct random_op {
+	__u32	len;		/* number of random bytes */
+	__u8	__user *dst;	/* output buffer */
+};
+
+/* CIOCRANDOM fills dst from a random number generator of the open file
+ * ("stdrng", the highest priority DRBG or hardware generator), instantiated
+ * and seeded on first use. A descriptor from CRIOGET refers to the same
+ * open file and so shares the generator, as it shares the sessions.
+ */
 
 /* struct crypt_op flags */
 
@@ -218,11 +575,32 @@ struct crypt_auth_op {
 #define COP_FLAG_RESET		(1 << 6) /* multi-update reset the state.
                                           * should be used in combination
                                           * with COP_FLAG_UPDATE */
+#define COP_FLAG_AEAD_TLS13_TYPE (1 << 7) /* TLS 1.3 records, see
+                                           * CIOCRECORD */
+#define COP_FLAG_AEAD_TLS12_GCM_TYPE (1 << 8) /* TLS 1.2 AES-GCM records,
+                                               * see CIOCRECORD */
+#define COP_FLAG_AEAD_ESP_TYPE	(1 << 9) /* IPsec ESP packets, see
+                                          * CIOCESPSA */
+#define COP_FLAG_TLS_ETM	(1 << 10) /* TLS CBC records with
+                                           * encrypt-then-MAC (RFC 7366) */
+#define COP_FLAG_DTLS		(1 << 11) /* DTLS record headers, with
+                                           * COP_FLAG_AEAD_TLS_TYPE or
+                                           * COP_FLAG_AEAD_TLS12_GCM_TYPE */
 
 
 /* Stuff for bignum arithmetic and public key
- * cryptography - not supported yet by linux
- * cryptodev.
+ * cryptography. The numbers in crk_param are little endian, crp_nbits
+ * giving the size of their buffers. Only the operations reported by
+ * CIOCASYMFEAT are supported:
+ *  CRK_MOD_EXP: base, exponent, modulus -> base^exponent mod modulus.
+ *               The modulus must be of an RSA key size (e.g., 1024, 2048
+ *               or 4096 bits) and larger than the base.
+ *  CRK_DH_COMPUTE_KEY: private key, public key of the peer, prime ->
+ *               shared secret (finite field Diffie-Hellman).
+ *  CRK_ECDH_COMPUTE_KEY: private key, public key of the peer -> shared
+ *               secret (x coordinate). The curve is P-256 or P-384 as
+ *               given by the size of the private key (256 or 384 bits);
+ *               the public key is x || y (512 or 768 bits).
  */
 
 #define	CRYPTO_ALG_FLAG_SUPPORTED	1
@@ -252,6 +630,7 @@ enum cryptodev_crk_op_t {
 	CRK_DSA_SIGN = 2,
 	CRK_DSA_VERIFY = 3,
 	CRK_DH_COMPUTE_KEY = 4,
+	CRK_ECDH_COMPUTE_KEY = 5,
 	CRK_ALGORITHM_ALL
 };
 
@@ -264,6 +643,18 @@ enum cryptodev_crk_op_t {
 #define CRF_DSA_SIGN		(1 << CRK_DSA_SIGN)
 #define CRF_DSA_VERIFY		(1 << CRK_DSA_VERIFY)
 #define CRF_DH_COMPUTE_KEY	(1 << CRK_DH_COMPUTE_KEY)
+#define CRF_ECDH_COMPUTE_KEY	(1 << CRK_ECDH_COMPUTE_KEY)
+
+/* input of CIOCKEYBATCH */
+struct crypt_kop_batch {
+	__u32	count;		/* number of requests */
+	struct crypt_kop __user *kops;
+};
+
+/* The requests of a batch are processed concurrently, so that engines
+ * can work on several of them at once. The outcome of each one is in its
+ * crk_status; the ioctl only fails if the batch itself is invalid.
+ */
 
 
 /* ioctl's. Compatible with old linux cryptodev.h
@@ -289,4 +680,47 @@ enum cryptodev_crk_op_t {
 #define CIOCASYNCCRYPT    _IOW('c', 110, struct crypt_op)
 #define CIOCASYNCFETCH    _IOR('c', 111, struct crypt_op)
 
+/* hash many independent messages at once */
+#define CIOCHASHBATCH     _IOW('c', 112, struct hash_batch_op)
+
+/* save and restore the state of multi-update hashes */
+#define CIOCHASHEXPORT    _IOWR('c', 113, struct hash_state_op)
+#define CIOCHASHIMPORT    _IOW('c', 114, struct hash_state_op)
+
+/* encrypt or decrypt many sectors at once */
+#define CIOCCRYPTDU       _IOW('c', 115, struct crypt_du_op)
+
+/* let the kernel generate the IVs of a session */
+#define CIOCIVCOUNTER     _IOW('c', 116, struct iv_counter_op)
+
+/* compress or decompress with a compression session */
+#define CIOCCOMPRESS      _IOWR('c', 117, struct compress_op)
+
+/* asynchronous CIOCKEY; the outcome of each fetched request is in its
+ * crk_status. These are conditionally enabled, like CIOCASYNCCRYPT.
+ */
+#define CIOCASYNCKEY      _IOW('c', 118, struct crypt_kop)
+#define CIOCASYNCKEYFETCH _IOR('c', 119, struct crypt_kop)
+
+/* run many CIOCKEY requests at once */
+#define CIOCKEYBATCH      _IOW('c', 120, struct crypt_kop_batch)
+
+/* fill a buffer with random bytes */
+#define CIOCRANDOM        _IOW('c', 121, struct random_op)
+
+/* derive keys in the kernel with an HMAC session */
+#define CIOCKDF           _IOW('c', 122, struct kdf_op)
+
+/* set the IV and sequence number of the record modes */
+#define CIOCRECORD        _IOW('c', 123, struct record_state_op)
+
+/* protect or unprotect many SRTP packets at once */
+#define CIOCSRTPBATCH     _IOW('c', 124, struct srtp_batch_op)
+
+/* set the SA of the ESP mode */
+#define CIOCESPSA         _IOW('c', 125, struct esp_sa_op)
+
+/* seal a plaintext as many TLS records at once */
+#define CIOCTLSBATCH      _IOWR('c', 126, struct tls_batch_op)
+
 #endif /* L_CRYPTODEV_H */
@@ -36,10 +36,15 @@
 
 
 extern int cryptodev_verbosity;
+extern unsigned int cryptodev_poll_usecs;
+extern unsigned int cryptodev_chunk_size;
 
 struct fcrypt {
 	struct list_head list;
 	struct mutex sem;
+	/* generator of CIOCRANDOM, allocated on first use */
+	struct mutex rng_sem;
+	struct crypto_rng *rng;
 };
 
 /* compatibility stuff */
@@ -87,6 +92,7 @@ struct kernel_crypt_op {
 
 	int ivlen;
 	__u8 iv[EALG_MAX_BLOCK_LEN];
+	int iv_generated; /* iv was produced by the session's counter */
 
 	int digestsize;
 	uint8_t hash_output[AALG_MAX_RESULT_LEN];
@@ -101,11 +107,38 @@ struct kernel_crypt_auth_op {
 	int dst_len; /* based on src_len + pad + tag */
 	int ivlen;
 	__u8 iv[EALG_MAX_BLOCK_LEN];
+	int iv_generated; /* iv was produced by the session's counter */
+
+	/* SRTP packet whose IV and rollover counter the kernel derives */
+	int srtp_kernel_iv;
+	uint32_t srtp_ssrc;
+	uint16_t srtp_seq;
+	uint32_t srtp_roc;
 
 	struct task_struct *task;
 	struct mm_struct *mm;
 };
 
+/* the largest public key parameter accepted, enough for 8192-bit DH */
+#define CRK_MAX_PARAM_BYTES 1024
+
+/* kernel-internal extension to struct crypt_kop */
+struct kernel_crypt_kop {
+	struct crypt_kop kop;
+
+	/* kernel copies of the parameters, big endian */
+	uint8_t *param[CRK_MAXPARAM];
+	unsigned int param_len[CRK_MAXPARAM];
+};
+
+/* public key */
+
+int kkop_from_user(struct kernel_crypt_kop *kkop, void __user *arg);
+int kkop_to_user(struct kernel_crypt_kop *kkop, void __user *arg);
+void kkop_free(struct kernel_crypt_kop *kkop);
+int crypto_kop_run(struct kernel_crypt_kop *kkop);
+int crypto_kop_features(void);
+
 /* auth */
 
 int kcaop_from_user(struct kernel_crypt_auth_op *kcop,
@@ -114,15 +147,49 @@ int kcaop_to_user(struct kernel_crypt_auth_op *kcaop,
 		struct fcrypt *fcr, void __user *arg);
 int crypto_auth_run(struct fcrypt *fcr, struct kernel_crypt_auth_op *kcaop);
 int crypto_run(struct fcrypt *fcr, struct kernel_crypt_op *kcop);
+int crypto_hash_batch_run(struct fcrypt *fcr, struct hash_batch_op *hbop);
+int crypto_srtp_batch_run(struct fcrypt *fcr, struct srtp_batch_op *sbop);
+int crypto_tls_batch_run(struct fcrypt *fcr, struct tls_batch_op *tbop);
+int crypto_du_run(struct fcrypt *fcr, struct crypt_du_op *duop);
+int crypto_compress_run(struct fcrypt *fcr, struct compress_op *zop);
+int crypto_random_run(struct fcrypt *fcr, struct random_op *rop);
+int crypto_kdf_run(struct fcrypt *fcr, struct kdf_op *kop);
 
 #include <cryptlib.h>
 
+/* the SRTP streams (SSRCs) whose rollover counter a session tracks */
+#define SRTP_MAX_STREAMS 16
+
+struct srtp_stream {
+	uint32_t ssrc;
+	uint32_t roc;	/* rollover counter */
+	uint16_t seq;	/* highest sequence number */
+	uint16_t valid;
+};
+
+/* the modes of a session's cipher that some operations depend on */
+enum cipher_mode {
+	CIPHER_MODE_OTHER = 0,
+	CIPHER_MODE_CBC,
+	CIPHER_MODE_CTR,
+	CIPHER_MODE_CHACHA20,
+	CIPHER_MODE_GCM,
+};
+
+/* CTR counts its blocks in the last 32 bits of the IV, ChaCha20 in the
+ * first (little endian); counter IVs leave them zero */
+#define IV_BLOCK_COUNTER_SIZE 4
+
 /* other internal structs */
 struct csession {
 	struct list_head entry;
 	struct mutex sem;
 	struct cipher_data cdata;
 	struct hash_data hdata;
+	/* fused MAC-then-encrypt transform for TLS records, if available */
+	struct cipher_data tdata;
+	struct compress_data zdata;
+	enum cipher_mode mode;	/* of cdata */
 	uint32_t sid;
 	uint32_t alignmask;
 
@@ -132,6 +199,37 @@ struct csession {
 	unsigned int readonly_pages;
 	struct page **pages;
 	struct scatterlist *sg;
+
+	/* cached buffer for small auth data, allocated on first use */
+	uint8_t *auth_buf;
+
+	/* kernel-generated IVs, see CIOCIVCOUNTER */
+	struct {
+		int enabled;
+		unsigned int salt_len;
+		uint8_t salt[EALG_MAX_BLOCK_LEN];
+		u64 counter;
+	} ivgen;
+
+	/* state of the record modes, see CIOCRECORD */
+	struct {
+		int enabled;
+		unsigned int iv_len;
+		uint8_t iv[EALG_MAX_BLOCK_LEN];
+		u64 seq;
+		struct srtp_stream srtp[SRTP_MAX_STREAMS];
+	} record;
+
+	/* IPsec SA of the ESP mode, see CIOCESPSA. The salt and the next
+	 * outbound sequence number are kept in the record state. */
+	struct {
+		int enabled;
+		uint32_t spi;
+		int esn;
+		unsigned int window;
+		u64 top;	/* highest authenticated sequence number */
+		u64 bitmap;	/* bit i is set if top - i was received */
+	} esp;
 };
 
 struct csession *crypto_get_session_by_sid(struct fcrypt *fcr, uint32_t sid);
@@ -141,5 +239,13 @@ static inline void crypto_put_session(struct csession *ses_ptr)
 	mutex_unlock(&ses_ptr->sem);
 }
 int adjust_sg_array(struct csession *ses, int pagecount);
+int crypto_next_iv(struct csession *ses_ptr, uint8_t *iv);
+int crypto_record_seq(struct csession *ses_ptr, u64 *seq);
+
+/* whether an operation uses an IV generated by the kernel */
+static inline int crypto_iv_generated(struct csession *ses_ptr, int op)
+{
+	return ses_ptr->ivgen.enabled && op == COP_ENCRYPT;
+}
 
 #endif /* CRYPTODEV_INT_H */
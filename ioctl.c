@@ -33,7 +33,9 @@
  *
  */
 
+#include <crypto/algapi.h>
 #include <crypto/hash.h>
+#include <crypto/rng.h>
 #include <linux/mm.h>
 #include <linux/highmem.h>
 #include <linux/ioctl.h>
@@ -46,6 +48,9 @@
 #include <linux/scatterlist.h>
 #include <linux/rtnetlink.h>
 #include <crypto/authenc.h>
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 10, 0))
+#include <crypto/acompress.h>
+#endif
 
 #include <linux/sysctl.h>
 
@@ -71,6 +76,16 @@ int cryptodev_verbosity;
 module_param(cryptodev_verbosity, int, 0644);
 MODULE_PARM_DESC(cryptodev_verbosity, "0: normal, 1: verbose, 2: debug");
 
+unsigned int cryptodev_poll_usecs;
+module_param(cryptodev_poll_usecs, uint, 0644);
+MODULE_PARM_DESC(cryptodev_poll_usecs,
+		 "time in usecs to busy-poll for a request before sleeping (0: disabled)");
+
+unsigned int cryptodev_chunk_size = 8192;
+module_param(cryptodev_chunk_size, uint, 0644);
+MODULE_PARM_DESC(cryptodev_chunk_size,
+		 "bytes hashed and encrypted at a time by the software TLS and SRTP modes (0: whole records)");
+
 /* ====== CryptoAPI ====== */
 struct todo_list_item {
 	struct list_head __hook;
@@ -78,6 +93,11 @@ struct todo_list_item {
 	int result;
 };
 
+struct kop_list_item {
+	struct list_head __hook;
+	struct kernel_crypt_kop kkop;
+};
+
 struct locked_list {
 	struct list_head list;
 	struct mutex lock;
@@ -88,6 +108,10 @@ struct crypt_priv {
 	struct locked_list free, todo, done;
 	int itemcount;
 	struct work_struct cryptask;
+	/* asynchronous public key operations */
+	struct locked_list ktodo, kdone;
+	int kitemcount; /* protected by ktodo.lock */
+	struct work_struct keytask;
 	wait_queue_head_t user_waiter;
 };
 
@@ -102,6 +126,58 @@ struct crypt_priv {
 /* cryptodev's own workqueue, keeps crypto tasks from disturbing the force */
 static struct workqueue_struct *cryptodev_wq;
 
+/* The cipher and MAC pairs whose fused TLS transform was looked up and
+ * not found, so that we don't look it up (and try to load modules) for
+ * every session. Bit cipher * CRYPTO_ALGORITHM_ALL + mac.
+ */
+static DECLARE_BITMAP(tls_fused_missing,
+		      CRYPTO_ALGORITHM_ALL * CRYPTO_ALGORITHM_ALL);
+
+/* Sets up a fused MAC-then-encrypt transform for TLS records, if the
+ * kernel provides one for the session's cipher and MAC. Failing to do
+ * so is not an error; TLS records are then handled in two passes.
+ */
+static void
+crypto_init_tls_fused(struct csession *ses, struct session_op *sop,
+		      const char *alg_name, const char *hash_name, uint8_t *key)
+{
+	char tls_name[CRYPTO_MAX_ALG_NAME];
+	unsigned int pair = sop->cipher * CRYPTO_ALGORITHM_ALL + sop->mac;
+	unsigned int keylen;
+	int ret;
+
+	/* the fused transforms only exist for HMAC */
+	if (test_bit(pair, tls_fused_missing) || sop->mackeylen == 0 ||
+	    strncmp(hash_name, "hmac(", 5) != 0)
+		return;
+
+	if (snprintf(tls_name, sizeof(tls_name), "tls10(%s,%s)",
+		     hash_name, alg_name) >= sizeof(tls_name))
+		return;
+
+	if (!crypto_has_alg(tls_name, CRYPTO_ALG_TYPE_AEAD, CRYPTO_ALG_TYPE_MASK)) {
+		ddebug(2, "no fused transform for %s", tls_name);
+		set_bit(pair, tls_fused_missing);
+		return;
+	}
+
+	ret = cryptodev_get_cipher_keylen(&keylen, sop, 1);
+	if (unlikely(ret < 0))
+		return;
+
+	ret = cryptodev_get_cipher_key(key, sop, 1);
+	if (unlikely(ret < 0))
+		return;
+
+	ret = cryptodev_cipher_init(&ses->tdata, tls_name, key, keylen, 0, 1);
+	if (ret < 0) {
+		ddebug(1, "Failed to load %s", tls_name);
+		return;
+	}
+
+	ddebug(2, "using %s for TLS records", tls_name);
+}
+
 /* Prepare session for future use. */
 static int
 crypto_create_session(struct fcrypt *fcr, struct session_op *sop)
@@ -110,7 +186,9 @@ crypto_create_session(struct fcrypt *fcr, struct session_op *sop)
 	int ret = 0;
 	const char *alg_name = NULL;
 	const char *hash_name = NULL;
+	const char *comp_name = NULL;
 	int hmac_mode = 1, stream = 0, aead = 0;
+	enum cipher_mode mode = CIPHER_MODE_OTHER;
 	/*
 	 * With composite aead ciphers, only ckey is used and it can cover all the
 	 * structure space; otherwise both keys may be used simultaneously but they
@@ -134,35 +212,68 @@ crypto_create_session(struct fcrypt *fcr, struct session_op *sop)
 		break;
 	case CRYPTO_DES_CBC:
 		alg_name = "cbc(des)";
+		mode = CIPHER_MODE_CBC;
 		break;
 	case CRYPTO_3DES_CBC:
 		alg_name = "cbc(des3_ede)";
+		mode = CIPHER_MODE_CBC;
 		break;
 	case CRYPTO_BLF_CBC:
 		alg_name = "cbc(blowfish)";
+		mode = CIPHER_MODE_CBC;
 		break;
 	case CRYPTO_AES_CBC:
 		alg_name = "cbc(aes)";
+		mode = CIPHER_MODE_CBC;
 		break;
 	case CRYPTO_AES_ECB:
 		alg_name = "ecb(aes)";
 		break;
+	case CRYPTO_AES_XTS:
+		alg_name = "xts(aes)";
+		break;
 	case CRYPTO_CAMELLIA_CBC:
 		alg_name = "cbc(camellia)";
+		mode = CIPHER_MODE_CBC;
 		break;
 	case CRYPTO_AES_CTR:
 		alg_name = "ctr(aes)";
 		stream = 1;
+		mode = CIPHER_MODE_CTR;
 		break;
 	case CRYPTO_AES_GCM:
 		alg_name = "gcm(aes)";
 		stream = 1;
 		aead = 1;
+		mode = CIPHER_MODE_GCM;
+		break;
+	case CRYPTO_CHACHA20:
+		alg_name = "chacha20";
+		stream = 1;
+		mode = CIPHER_MODE_CHACHA20;
+		break;
+	case CRYPTO_CHACHA20_POLY1305:
+		alg_name = "rfc7539(chacha20,poly1305)";
+		stream = 1;
+		aead = 1;
+		break;
+	case CRYPTO_AES_GMAC:
+		/* GCM with all of the data authenticated only */
+		alg_name = "gcm(aes)";
+		stream = 1;
+		aead = 1;
+		mode = CIPHER_MODE_GCM;
 		break;
 	case CRYPTO_NULL:
 		alg_name = "ecb(cipher_null)";
 		stream = 1;
 		break;
+	case CRYPTO_DEFLATE_COMP:
+		comp_name = "deflate";
+		break;
+	case CRYPTO_LZS_COMP:
+		comp_name = "lzs";
+		break;
 	default:
 		ddebug(1, "bad cipher: %d", sop->cipher);
 		return -EINVAL;
@@ -193,6 +304,21 @@ crypto_create_session(struct fcrypt *fcr, struct session_op *sop)
 	case CRYPTO_SHA2_512_HMAC:
 		hash_name = "hmac(sha512)";
 		break;
+	case CRYPTO_AES_CMAC:
+		hash_name = "cmac(aes)";
+		break;
+	case CRYPTO_AES_XCBC_MAC:
+		hash_name = "xcbc(aes)";
+		break;
+	case CRYPTO_SHA3_256_HMAC:
+		hash_name = "hmac(sha3-256)";
+		break;
+	case CRYPTO_SHA3_384_HMAC:
+		hash_name = "hmac(sha3-384)";
+		break;
+	case CRYPTO_SHA3_512_HMAC:
+		hash_name = "hmac(sha3-512)";
+		break;
 
 	/* non-hmac cases */
 	case CRYPTO_MD5:
@@ -223,16 +349,53 @@ crypto_create_session(struct fcrypt *fcr, struct session_op *sop)
 		hash_name = "sha512";
 		hmac_mode = 0;
 		break;
+	case CRYPTO_POLY1305:
+		/* keyed through the data, it has no setkey */
+		hash_name = "poly1305";
+		hmac_mode = 0;
+		break;
+	case CRYPTO_SHA3_256:
+		hash_name = "sha3-256";
+		hmac_mode = 0;
+		break;
+	case CRYPTO_SHA3_384:
+		hash_name = "sha3-384";
+		hmac_mode = 0;
+		break;
+	case CRYPTO_SHA3_512:
+		hash_name = "sha3-512";
+		hmac_mode = 0;
+		break;
+
+	/* BLAKE2 has its own keyed mode instead of HMAC */
+	case CRYPTO_BLAKE2B_256:
+		hash_name = "blake2b-256";
+		hmac_mode = sop->mackeylen != 0;
+		break;
+	case CRYPTO_BLAKE2B_512:
+		hash_name = "blake2b-512";
+		hmac_mode = sop->mackeylen != 0;
+		break;
+	case CRYPTO_BLAKE2S_256:
+		hash_name = "blake2s-256";
+		hmac_mode = sop->mackeylen != 0;
+		break;
 	default:
 		ddebug(1, "bad mac: %d", sop->mac);
 		return -EINVAL;
 	}
 
+	if (unlikely(comp_name && hash_name)) {
+		ddebug(1, "compression cannot be combined with a mac");
+		return -EINVAL;
+	}
+
 	/* Create a session and put it to the list. Zeroing the structure helps
 	 * also with a single exit point in case of errors */
 	ses_new = kzalloc(sizeof(*ses_new), GFP_KERNEL);
 	if (!ses_new)
 		return -ENOMEM;
+	ses_new->mode = mode;
 
 	/* Set-up crypto transform. */
 	if (alg_name) {
@@ -257,6 +420,14 @@ crypto_create_session(struct fcrypt *fcr, struct session_op *sop)
 		}
 	}
 
+	if (comp_name) {
+		ret = cryptodev_compress_init(&ses_new->zdata, comp_name);
+		if (ret < 0) {
+			ddebug(1, "Failed to load compression for %s", comp_name);
+			goto session_error;
+		}
+	}
+
 	if (hash_name && aead == 0) {
 		if (unlikely(sop->mackeylen > CRYPTO_HMAC_MAX_KEY_LEN)) {
 			ddebug(1, "Setting key failed for %s-%zu.",
@@ -283,10 +454,16 @@ crypto_create_session(struct fcrypt *fcr, struct session_op *sop)
 		if (ret != 0) {
 			goto session_error;
 		}
+
+		/* the keys are not needed anymore; reuse their space */
+		if (alg_name && hmac_mode && stream == 0)
+			crypto_init_tls_fused(ses_new, sop, alg_name, hash_name,
+					      keys.ckey);
 	}
 
 	ses_new->alignmask = max(ses_new->cdata.alignmask,
 	                                          ses_new->hdata.alignmask);
+	ses_new->alignmask = max(ses_new->alignmask, ses_new->tdata.alignmask);
 	ddebug(2, "got alignmask %d", ses_new->alignmask);
 
 	ses_new->array_size = DEFAULT_PREALLOC_PAGES;
@@ -331,6 +508,8 @@ restart:
 session_error:
 	cryptodev_hash_deinit(&ses_new->hdata);
 	cryptodev_cipher_deinit(&ses_new->cdata);
+	cryptodev_cipher_deinit(&ses_new->tdata);
+	cryptodev_compress_deinit(&ses_new->zdata);
 	kfree(ses_new->sg);
 	kfree(ses_new->pages);
 	kfree(ses_new);
@@ -347,10 +526,13 @@ crypto_destroy_session(struct csession *ses_ptr)
 	}
 	ddebug(2, "Removed session 0x%08X", ses_ptr->sid);
 	cryptodev_cipher_deinit(&ses_ptr->cdata);
+	cryptodev_cipher_deinit(&ses_ptr->tdata);
+	cryptodev_compress_deinit(&ses_ptr->zdata);
 	cryptodev_hash_deinit(&ses_ptr->hdata);
 	ddebug(2, "freeing space for %d user pages", ses_ptr->array_size);
 	kfree(ses_ptr->pages);
 	kfree(ses_ptr->sg);
+	kfree(ses_ptr->auth_buf);
 	mutex_unlock(&ses_ptr->sem);
 	mutex_destroy(&ses_ptr->sem);
 	kfree(ses_ptr);
@@ -451,6 +633,100 @@ static void cryptask_routine(struct work_struct *work)
 	wake_up_interruptible(&pcr->user_waiter);
 }
 
+static void keytask_routine(struct work_struct *work)
+{
+	struct crypt_priv *pcr = container_of(work, struct crypt_priv, keytask);
+	struct kop_list_item *item;
+	LIST_HEAD(tmp);
+
+	mutex_lock(&pcr->ktodo.lock);
+	list_cut_position(&tmp, &pcr->ktodo.list, pcr->ktodo.list.prev);
+	mutex_unlock(&pcr->ktodo.lock);
+
+	/* the outcome of each job is kept in its crk_status */
+	list_for_each_entry(item, &tmp, __hook) {
+		if (unlikely(crypto_kop_run(&item->kkop)))
+			derr(1, "crypto_kop_run() failed: %u",
+			     item->kkop.kop.crk_status);
+	}
+
+	mutex_lock(&pcr->kdone.lock);
+	list_splice_tail(&tmp, &pcr->kdone.list);
+	mutex_unlock(&pcr->kdone.lock);
+
+	wake_up_interruptible(&pcr->user_waiter);
+}
+
+/* maximum number of CIOCKEYBATCH requests in flight */
+#define KOP_BATCH_WINDOW 16
+
+struct kop_batch_work {
+	struct work_struct work;
+	struct kernel_crypt_kop kkop;
+};
+
+static void kop_batch_routine(struct work_struct *work)
+{
+	struct kop_batch_work *w = container_of(work, struct kop_batch_work, work);
+
+	/* the outcome is kept in crk_status */
+	crypto_kop_run(&w->kkop);
+}
+
+/* Runs the requests of a batch, KOP_BATCH_WINDOW at a time. Each one is a
+ * separate work item on the unbound system workqueue, so that requests
+ * waiting for an engine do not hold up the others.
+ */
+static int crypto_kop_batch_run(struct crypt_kop_batch *kbop)
+{
+	struct kop_batch_work *w;
+	unsigned int i, j, n;
+	int ret = 0, err;
+
+	w = kcalloc(KOP_BATCH_WINDOW, sizeof(*w), GFP_KERNEL);
+	if (unlikely(!w))
+		return -ENOMEM;
+
+	for (i = 0; i < kbop->count && ret == 0; i += n) {
+		n = min_t(unsigned int, kbop->count - i, KOP_BATCH_WINDOW);
+
+		for (j = 0; j < n; j++) {
+			ret = kkop_from_user(&w[j].kkop, kbop->kops + i + j);
+			if (unlikely(ret)) {
+				derr(1, "invalid request %u in batch", i + j);
+				break;
+			}
+
+			INIT_WORK(&w[j].work, kop_batch_routine);
+			queue_work(system_unbound_wq, &w[j].work);
+		}
+		n = j;
+
+		/* wait for everything in flight, even on error */
+		for (j = 0; j < n; j++) {
+			flush_work(&w[j].work);
+
+			err = kkop_to_user(&w[j].kkop, kbop->kops + i + j);
+			if (unlikely(err) && ret == 0)
+				ret = err;
+		}
+	}
+
+	kfree(w);
+	return ret;
+}
+
+static void free_kop_list(struct list_head *list)
+{
+	struct kop_list_item *item, *item_safe;
+
+	list_for_each_entry_safe(item, item_safe, list, __hook) {
+		list_del(&item->__hook);
+		kkop_free(&item->kkop);
+		kfree(item);
+	}
+}
+
 /* ====== /dev/crypto ====== */
 
 static int
@@ -466,16 +742,22 @@ cryptodev_open(struct inode *inode, struct file *filp)
 	filp->private_data = pcr;
 
 	mutex_init(&pcr->fcrypt.sem);
+	mutex_init(&pcr->fcrypt.rng_sem);
 	mutex_init(&pcr->free.lock);
 	mutex_init(&pcr->todo.lock);
 	mutex_init(&pcr->done.lock);
+	mutex_init(&pcr->ktodo.lock);
+	mutex_init(&pcr->kdone.lock);
 
 	INIT_LIST_HEAD(&pcr->fcrypt.list);
 	INIT_LIST_HEAD(&pcr->free.list);
 	INIT_LIST_HEAD(&pcr->todo.list);
 	INIT_LIST_HEAD(&pcr->done.list);
+	INIT_LIST_HEAD(&pcr->ktodo.list);
+	INIT_LIST_HEAD(&pcr->kdone.list);
 
 	INIT_WORK(&pcr->cryptask, cryptask_routine);
+	INIT_WORK(&pcr->keytask, keytask_routine);
 
 	init_waitqueue_head(&pcr->user_waiter);
 
@@ -498,9 +780,12 @@ err_ringalloc:
 		list_del(&tmp->__hook);
 		kfree(tmp);
 	}
+	mutex_destroy(&pcr->kdone.lock);
+	mutex_destroy(&pcr->ktodo.lock);
 	mutex_destroy(&pcr->done.lock);
 	mutex_destroy(&pcr->todo.lock);
 	mutex_destroy(&pcr->free.lock);
+	mutex_destroy(&pcr->fcrypt.rng_sem);
 	mutex_destroy(&pcr->fcrypt.sem);
 	kfree(pcr);
 	filp->private_data = NULL;
@@ -518,6 +803,10 @@ cryptodev_release(struct inode *inode, struct file *filp)
 		return 0;
 
 	cancel_work_sync(&pcr->cryptask);
+	cancel_work_sync(&pcr->keytask);
+
+	free_kop_list(&pcr->ktodo.list);
+	free_kop_list(&pcr->kdone.list);
 
 	list_splice_tail(&pcr->todo.list, &pcr->free.list);
 	list_splice_tail(&pcr->done.list, &pcr->free.list);
@@ -535,10 +824,15 @@ cryptodev_release(struct inode *inode, struct file *filp)
 	}
 
 	crypto_finish_all_sessions(&pcr->fcrypt);
+	if (pcr->fcrypt.rng)
+		crypto_free_rng(pcr->fcrypt.rng);
 
+	mutex_destroy(&pcr->kdone.lock);
+	mutex_destroy(&pcr->ktodo.lock);
 	mutex_destroy(&pcr->done.lock);
 	mutex_destroy(&pcr->todo.lock);
 	mutex_destroy(&pcr->free.lock);
+	mutex_destroy(&pcr->fcrypt.rng_sem);
 	mutex_destroy(&pcr->fcrypt.sem);
 
 	kfree(pcr);
@@ -639,6 +933,66 @@ static int crypto_async_fetch(struct crypt_priv *pcr,
 
 	return retval;
 }
+
+/* enqueue a public key job; it takes over the parameters of kkop
+ *
+ * returns:
+ * -EBUSY when MAX_COP_RINGSIZE jobs are already pending
+ * 0 on success */
+static int crypto_async_kop_run(struct crypt_priv *pcr,
+		struct kernel_crypt_kop *kkop)
+{
+	struct kop_list_item *item;
+
+	item = kmalloc(sizeof(*item), GFP_KERNEL);
+	if (unlikely(!item))
+		return -ENOMEM;
+
+	mutex_lock(&pcr->ktodo.lock);
+	if (unlikely(pcr->kitemcount >= MAX_COP_RINGSIZE)) {
+		mutex_unlock(&pcr->ktodo.lock);
+		kfree(item);
+		return -EBUSY;
+	}
+	pcr->kitemcount++;
+	memcpy(&item->kkop, kkop, sizeof(*kkop));
+	list_add_tail(&item->__hook, &pcr->ktodo.list);
+	mutex_unlock(&pcr->ktodo.lock);
+
+	queue_work(cryptodev_wq, &pcr->keytask);
+	return 0;
+}
+
+/* get the first completed public key job
+ *
+ * returns:
+ * -EBUSY if no completed jobs are ready (yet)
+ * 0 otherwise; the outcome of the job is in its crk_status */
+static int crypto_async_kop_fetch(struct crypt_priv *pcr,
+		struct kernel_crypt_kop *kkop)
+{
+	struct kop_list_item *item;
+
+	mutex_lock(&pcr->kdone.lock);
+	if (list_empty(&pcr->kdone.list)) {
+		mutex_unlock(&pcr->kdone.lock);
+		return -EBUSY;
+	}
+	item = list_first_entry(&pcr->kdone.list, struct kop_list_item, __hook);
+	list_del(&item->__hook);
+	mutex_unlock(&pcr->kdone.lock);
+
+	memcpy(kkop, &item->kkop, sizeof(*kkop));
+	kfree(item);
+
+	mutex_lock(&pcr->ktodo.lock);
+	pcr->kitemcount--;
+	mutex_unlock(&pcr->ktodo.lock);
+
+	/* wake for POLLOUT */
+	wake_up_interruptible(&pcr->user_waiter);
+	return 0;
+}
 #endif
 
 /* this function has to be called from process context */
@@ -655,6 +1009,7 @@ static int fill_kcop_from_cop(struct kernel_crypt_op *kcop, struct fcrypt *fcr)
 		return -EINVAL;
 	}
 	kcop->ivlen = cop->iv ? ses_ptr->cdata.ivsize : 0;
+	kcop->iv_generated = crypto_iv_generated(ses_ptr, cop->op);
 	kcop->digestsize = 0; /* will be updated during operation */
 
 	crypto_put_session(ses_ptr);
@@ -662,7 +1017,8 @@ static int fill_kcop_from_cop(struct kernel_crypt_op *kcop, struct fcrypt *fcr)
 	kcop->task = current;
 	kcop->mm = current->mm;
 
-	if (cop->iv) {
+	/* the IV is filled in by crypto_run() */
+	if (cop->iv && !kcop->iv_generated) {
 		rc = copy_from_user(kcop->iv, cop->iv, kcop->ivlen);
 		if (unlikely(rc)) {
 			derr(1, "error copying IV (%d bytes), copy_from_user returned %d for address %p",
@@ -685,7 +1041,8 @@ static int fill_cop_from_kcop(struct kernel_crypt_op *kcop, struct fcrypt *fcr)
 		if (unlikely(ret))
 			return -EFAULT;
 	}
-	if (kcop->ivlen && kcop->cop.flags & COP_FLAG_WRITE_IV) {
+	if (kcop->ivlen &&
+	    (kcop->cop.flags & COP_FLAG_WRITE_IV || kcop->iv_generated)) {
 		ret = copy_to_user(kcop->cop.iv,
 				kcop->iv, kcop->ivlen);
 		if (unlikely(ret))
@@ -795,6 +1152,19 @@ static int get_session_info(struct fcrypt *fcr, struct session_info_op *siop)
 			siop->flags |= SIOP_FLAG_KERNEL_DRIVER_ONLY;
 #endif
 	}
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 10, 0))
+	if (ses_ptr->zdata.init) {
+		tfm = crypto_acomp_tfm(ses_ptr->zdata.async.s);
+		tfm_info_to_alg_info(&siop->cipher_info, tfm);
+#ifdef CRYPTO_ALG_KERN_DRIVER_ONLY
+		if (tfm->__crt_alg->cra_flags & CRYPTO_ALG_KERN_DRIVER_ONLY)
+			siop->flags |= SIOP_FLAG_KERNEL_DRIVER_ONLY;
+#else
+		if (is_known_accelerated(tfm))
+			siop->flags |= SIOP_FLAG_KERNEL_DRIVER_ONLY;
+#endif
+	}
+#endif
 
 	siop->alignmask = ses_ptr->alignmask;
 
@@ -802,17 +1172,374 @@ static int get_session_info(struct fcrypt *fcr, struct session_info_op *siop)
 	return 0;
 }
 
+/* Exported hash states carry an HMAC under a key chosen when the module
+ * is loaded, bound to the driver and the size of the state, so that only
+ * states exported by this module for the same driver are imported.
+ */
+#define HASH_STATE_TAG_SIZE 32
+
+static struct crypto_shash *hash_state_tfm;
+
+static int hash_state_key_init(void)
+{
+	uint8_t key[HASH_STATE_TAG_SIZE];
+	int ret;
+
+	hash_state_tfm = crypto_alloc_shash("hmac(sha256)", 0, 0);
+	if (IS_ERR(hash_state_tfm)) {
+		ret = PTR_ERR(hash_state_tfm);
+		hash_state_tfm = NULL;
+		return ret;
+	}
+
+	get_random_bytes(key, sizeof(key));
+	ret = crypto_shash_setkey(hash_state_tfm, key, sizeof(key));
+	memzero_explicit(key, sizeof(key));
+	if (unlikely(ret)) {
+		crypto_free_shash(hash_state_tfm);
+		hash_state_tfm = NULL;
+	}
+	return ret;
+}
+
+static int hash_state_tag(struct hash_data *hdata, const uint8_t *state,
+			  uint8_t *tag)
+{
+	SHASH_DESC_ON_STACK(desc, hash_state_tfm);
+	const char *driver =
+		crypto_tfm_alg_driver_name(crypto_ahash_tfm(hdata->async.s));
+	__le32 size = cpu_to_le32(hdata->statesize);
+	int ret;
+
+	desc->tfm = hash_state_tfm;
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(5, 2, 0))
+	desc->flags = 0;
+#endif
+	ret = crypto_shash_init(desc);
+	if (likely(ret == 0))
+		ret = crypto_shash_update(desc, driver, strlen(driver) + 1);
+	if (likely(ret == 0))
+		ret = crypto_shash_update(desc, (uint8_t *)&size, sizeof(size));
+	if (likely(ret == 0))
+		ret = crypto_shash_finup(desc, state, hdata->statesize, tag);
+	shash_desc_zero(desc);
+	return ret;
+}
+
+static int hash_export_state(struct fcrypt *fcr, struct hash_state_op *hsop)
+{
+	struct csession *ses_ptr;
+	uint8_t *state;
+	unsigned int size;
+	int ret;
+
+	/* this also enters ses_ptr->sem */
+	ses_ptr = crypto_get_session_by_sid(fcr, hsop->ses);
+	if (unlikely(!ses_ptr)) {
+		derr(1, "invalid session ID=0x%08X", hsop->ses);
+		return -EINVAL;
+	}
+
+	if (unlikely(ses_ptr->hdata.init == 0)) {
+		derr(1, "hash context not initialized");
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	if (unlikely(!hash_state_tfm)) {
+		ret = -EOPNOTSUPP;
+		goto out_unlock;
+	}
+
+	size = ses_ptr->hdata.statesize + HASH_STATE_TAG_SIZE;
+	if (hsop->state == NULL) {
+		hsop->len = size;
+		ret = 0;
+		goto out_unlock;
+	}
+
+	if (unlikely(hsop->len < size)) {
+		derr(1, "state buffer too small (%u < %u)", hsop->len, size);
+		hsop->len = size;
+		ret = -ENOSPC;
+		goto out_unlock;
+	}
+
+	state = kmalloc(size, GFP_KERNEL);
+	if (unlikely(!state)) {
+		ret = -ENOMEM;
+		goto out_unlock;
+	}
+
+	ret = cryptodev_hash_export(&ses_ptr->hdata, state);
+	if (likely(ret == 0))
+		ret = hash_state_tag(&ses_ptr->hdata, state,
+				     state + ses_ptr->hdata.statesize);
+	if (likely(ret == 0)) {
+		hsop->len = size;
+		if (unlikely(copy_to_user(hsop->state, state, size)))
+			ret = -EFAULT;
+	}
+
+	kzfree(state);
+out_unlock:
+	crypto_put_session(ses_ptr);
+	return ret;
+}
+
+static int set_iv_counter(struct fcrypt *fcr, struct iv_counter_op *ivop)
+{
+	struct csession *ses_ptr;
+	unsigned int room;
+	int ret = 0;
+
+	/* this also enters ses_ptr->sem */
+	ses_ptr = crypto_get_session_by_sid(fcr, ivop->ses);
+	if (unlikely(!ses_ptr)) {
+		derr(1, "invalid session ID=0x%08X", ivop->ses);
+		return -EINVAL;
+	}
+
+	/* a predictable IV is only safe with counter based modes */
+	if (unlikely(ses_ptr->cdata.init == 0 || ses_ptr->cdata.stream == 0)) {
+		derr(1, "counter IVs require a stream cipher or AEAD session");
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	if (unlikely(ivop->salt_len > sizeof(ses_ptr->ivgen.salt))) {
+		derr(1, "salt length %u too large", ivop->salt_len);
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	/* keep the block counter of the cipher out of the way */
+	room = ses_ptr->cdata.ivsize;
+	if (ses_ptr->mode == CIPHER_MODE_CTR ||
+	    ses_ptr->mode == CIPHER_MODE_CHACHA20)
+		room -= min_t(unsigned int, room, IV_BLOCK_COUNTER_SIZE);
+
+	if (unlikely(ivop->salt_len + sizeof(u64) > room)) {
+		derr(1, "salt length %u too large for IV size %d",
+		     ivop->salt_len, ses_ptr->cdata.ivsize);
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	if (unlikely(copy_from_user(ses_ptr->ivgen.salt, ivop->salt,
+				    ivop->salt_len))) {
+		ret = -EFAULT;
+		goto out_unlock;
+	}
+
+	ses_ptr->ivgen.salt_len = ivop->salt_len;
+	ses_ptr->ivgen.counter = ivop->counter;
+	ses_ptr->ivgen.enabled = 1;
+
+out_unlock:
+	crypto_put_session(ses_ptr);
+	return ret;
+}
+
+/* The IV is checked against each record mode when a record is processed */
+static int set_record_state(struct fcrypt *fcr, struct record_state_op *rsop)
+{
+	struct csession *ses_ptr;
+	int ret = 0;
+
+	/* this also enters ses_ptr->sem */
+	ses_ptr = crypto_get_session_by_sid(fcr, rsop->ses);
+	if (unlikely(!ses_ptr)) {
+		derr(1, "invalid session ID=0x%08X", rsop->ses);
+		return -EINVAL;
+	}
+
+	if (unlikely(ses_ptr->cdata.init == 0)) {
+		derr(1, "record state requires a cipher session");
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	/* rewinding the sequence number would reuse nonces */
+	if (unlikely(ses_ptr->record.enabled)) {
+		derr(1, "record state already set");
+		ret = -EBUSY;
+		goto out_unlock;
+	}
+
+	if (unlikely(rsop->iv_len > sizeof(ses_ptr->record.iv))) {
+		derr(1, "record IV length %u too large", rsop->iv_len);
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	if (unlikely(copy_from_user(ses_ptr->record.iv, rsop->iv,
+				    rsop->iv_len))) {
+		ret = -EFAULT;
+		goto out_unlock;
+	}
+
+	ses_ptr->record.iv_len = rsop->iv_len;
+	ses_ptr->record.seq = rsop->seq;
+	memset(ses_ptr->record.srtp, 0, sizeof(ses_ptr->record.srtp));
+	ses_ptr->record.enabled = 1;
+
+out_unlock:
+	crypto_put_session(ses_ptr);
+	return ret;
+}
+
+static int set_esp_sa(struct fcrypt *fcr, struct esp_sa_op *esop)
+{
+	struct csession *ses_ptr;
+	int ret = 0;
+
+	/* this also enters ses_ptr->sem */
+	ses_ptr = crypto_get_session_by_sid(fcr, esop->ses);
+	if (unlikely(!ses_ptr)) {
+		derr(1, "invalid session ID=0x%08X", esop->ses);
+		return -EINVAL;
+	}
+
+	if (ses_ptr->mode == CIPHER_MODE_GCM) {
+		if (unlikely(ses_ptr->cdata.ivsize != 12 || esop->salt_len != 4)) {
+			derr(1, "ESP with AES-GCM needs a 4-byte salt");
+			ret = -EINVAL;
+			goto out_unlock;
+		}
+	} else if (unlikely(ses_ptr->mode != CIPHER_MODE_CBC ||
+			    ses_ptr->cdata.ivsize != ses_ptr->cdata.blocksize ||
+			    ses_ptr->hdata.init == 0 || esop->salt_len != 0)) {
+		/* the IV of each packet is a random block, see RFC 2451 */
+		derr(1, "ESP needs AES-GCM or a CBC cipher with an HMAC");
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	if (unlikely(ses_ptr->record.enabled)) {
+		derr(1, "record state already set");
+		ret = -EBUSY;
+		goto out_unlock;
+	}
+
+	if (unlikely(esop->replay_window > 64 ||
+		     esop->flags & ~ESP_SA_ESN)) {
+		derr(1, "invalid ESP SA parameters");
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	if (unlikely(copy_from_user(ses_ptr->record.iv, esop->salt,
+				    esop->salt_len))) {
+		ret = -EFAULT;
+		goto out_unlock;
+	}
+
+	ses_ptr->record.iv_len = esop->salt_len;
+	ses_ptr->record.seq = esop->seq;
+	ses_ptr->record.enabled = 1;
+
+	ses_ptr->esp.spi = esop->spi;
+	ses_ptr->esp.esn = !!(esop->flags & ESP_SA_ESN);
+	ses_ptr->esp.window = esop->replay_window;
+	ses_ptr->esp.top = 0;
+	ses_ptr->esp.bitmap = 0;
+	ses_ptr->esp.enabled = 1;
+
+out_unlock:
+	crypto_put_session(ses_ptr);
+	return ret;
+}
+
+static int hash_import_state(struct fcrypt *fcr, struct hash_state_op *hsop)
+{
+	struct csession *ses_ptr;
+	uint8_t tag[HASH_STATE_TAG_SIZE];
+	uint8_t *state;
+	int ret;
+
+	/* this also enters ses_ptr->sem */
+	ses_ptr = crypto_get_session_by_sid(fcr, hsop->ses);
+	if (unlikely(!ses_ptr)) {
+		derr(1, "invalid session ID=0x%08X", hsop->ses);
+		return -EINVAL;
+	}
+
+	if (unlikely(ses_ptr->hdata.init == 0)) {
+		derr(1, "hash context not initialized");
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	if (unlikely(!hash_state_tfm)) {
+		ret = -EOPNOTSUPP;
+		goto out_unlock;
+	}
+
+	if (unlikely(hsop->len != ses_ptr->hdata.statesize + HASH_STATE_TAG_SIZE)) {
+		derr(1, "state size mismatch (%u != %d)", hsop->len,
+		     ses_ptr->hdata.statesize + HASH_STATE_TAG_SIZE);
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	state = kmalloc(hsop->len, GFP_KERNEL);
+	if (unlikely(!state)) {
+		ret = -ENOMEM;
+		goto out_unlock;
+	}
+
+	if (unlikely(copy_from_user(state, hsop->state, hsop->len))) {
+		ret = -EFAULT;
+		goto out_free;
+	}
+
+	/* never hand the driver a state it did not produce */
+	ret = hash_state_tag(&ses_ptr->hdata, state, tag);
+	if (unlikely(ret))
+		goto out_free;
+	if (crypto_memneq(tag, state + ses_ptr->hdata.statesize, sizeof(tag))) {
+		derr(1, "hash state not exported from this driver");
+		ret = -EBADMSG;
+		goto out_free;
+	}
+
+	ret = cryptodev_hash_import(&ses_ptr->hdata, state);
+out_free:
+	kzfree(state);
+out_unlock:
+	crypto_put_session(ses_ptr);
+	return ret;
+}
+
 static long
 cryptodev_ioctl(struct file *filp, unsigned int cmd, unsigned long arg_)
 {
 	void __user *arg = (void __user *)arg_;
 	int __user *p = arg;
-	struct session_op sop;
-	struct kernel_crypt_op kcop;
-	struct kernel_crypt_auth_op kcaop;
 	struct crypt_priv *pcr = filp->private_data;
 	struct fcrypt *fcr;
-	struct session_info_op siop;
+	/* a command only needs one of these; sharing the space keeps the
+	 * stack frame to the size of the largest */
+	union {
+		struct session_op sop;
+		struct kernel_crypt_op kcop;
+		struct kernel_crypt_auth_op kcaop;
+		struct session_info_op siop;
+		struct hash_batch_op hbop;
+		struct srtp_batch_op sbop;
+		struct tls_batch_op tbop;
+		struct hash_state_op hsop;
+		struct crypt_du_op duop;
+		struct iv_counter_op ivop;
+		struct compress_op zop;
+		struct kernel_crypt_kop kkop;
+		struct crypt_kop_batch kbop;
+		struct random_op rop;
+		struct kdf_op kdop;
+		struct record_state_op rsop;
+		struct esp_sa_op esop;
+	} op;
 	uint32_t ses;
 	int ret, fd;
 
@@ -823,7 +1550,45 @@ cryptodev_ioctl(struct file *filp, unsigned int cmd, unsigned long arg_)
 
 	switch (cmd) {
 	case CIOCASYMFEAT:
-		return put_user(0, p);
+		return put_user(crypto_kop_features(), p);
+	case CIOCKEY:
+		ret = kkop_from_user(&op.kkop, arg);
+		if (unlikely(ret))
+			return ret;
+
+		ret = crypto_kop_run(&op.kkop);
+		if (unlikely(ret)) {
+			dwarning(1, "Error in crypto_kop_run");
+			kkop_free(&op.kkop);
+			return ret;
+		}
+
+		return kkop_to_user(&op.kkop, arg);
+	case CIOCKEYBATCH:
+		if (unlikely(copy_from_user(&op.kbop, arg, sizeof(op.kbop))))
+			return -EFAULT;
+
+		return crypto_kop_batch_run(&op.kbop);
+	case CIOCRANDOM:
+		if (unlikely(copy_from_user(&op.rop, arg, sizeof(op.rop))))
+			return -EFAULT;
+
+		return crypto_random_run(fcr, &op.rop);
+	case CIOCKDF:
+		if (unlikely(copy_from_user(&op.kdop, arg, sizeof(op.kdop))))
+			return -EFAULT;
+
+		return crypto_kdf_run(fcr, &op.kdop);
+	case CIOCRECORD:
+		if (unlikely(copy_from_user(&op.rsop, arg, sizeof(op.rsop))))
+			return -EFAULT;
+
+		return set_record_state(fcr, &op.rsop);
+	case CIOCESPSA:
+		if (unlikely(copy_from_user(&op.esop, arg, sizeof(op.esop))))
+			return -EFAULT;
+
+		return set_esp_sa(fcr, &op.esop);
 	case CRIOGET:
 		fd = clonefd(filp);
 		ret = put_user(fd, p);
@@ -833,15 +1598,15 @@ cryptodev_ioctl(struct file *filp, unsigned int cmd, unsigned long arg_)
 		}
 		return ret;
 	case CIOCGSESSION:
-		if (unlikely(copy_from_user(&sop, arg, sizeof(sop))))
+		if (unlikely(copy_from_user(&op.sop, arg, sizeof(op.sop))))
 			return -EFAULT;
 
-		ret = crypto_create_session(fcr, &sop);
+		ret = crypto_create_session(fcr, &op.sop);
 		if (unlikely(ret))
 			return ret;
-		ret = copy_to_user(arg, &sop, sizeof(sop));
+		ret = copy_to_user(arg, &op.sop, sizeof(op.sop));
 		if (unlikely(ret)) {
-			crypto_finish_session(fcr, sop.ses);
+			crypto_finish_session(fcr, op.sop.ses);
 			return -EFAULT;
 		}
 		return ret;
@@ -852,50 +1617,134 @@ cryptodev_ioctl(struct file *filp, unsigned int cmd, unsigned long arg_)
 		ret = crypto_finish_session(fcr, ses);
 		return ret;
 	case CIOCGSESSINFO:
-		if (unlikely(copy_from_user(&siop, arg, sizeof(siop))))
+		if (unlikely(copy_from_user(&op.siop, arg, sizeof(op.siop))))
 			return -EFAULT;
 
-		ret = get_session_info(fcr, &siop);
+		ret = get_session_info(fcr, &op.siop);
 		if (unlikely(ret))
 			return ret;
-		return copy_to_user(arg, &siop, sizeof(siop));
+		return copy_to_user(arg, &op.siop, sizeof(op.siop));
 	case CIOCCRYPT:
-		if (unlikely(ret = kcop_from_user(&kcop, fcr, arg))) {
+		if (unlikely(ret = kcop_from_user(&op.kcop, fcr, arg))) {
 			dwarning(1, "Error copying from user");
 			return ret;
 		}
 
-		ret = crypto_run(fcr, &kcop);
+		ret = crypto_run(fcr, &op.kcop);
 		if (unlikely(ret)) {
 			dwarning(1, "Error in crypto_run");
 			return ret;
 		}
 
-		return kcop_to_user(&kcop, fcr, arg);
+		return kcop_to_user(&op.kcop, fcr, arg);
 	case CIOCAUTHCRYPT:
-		if (unlikely(ret = kcaop_from_user(&kcaop, fcr, arg))) {
+		if (unlikely(ret = kcaop_from_user(&op.kcaop, fcr, arg))) {
 			dwarning(1, "Error copying from user");
 			return ret;
 		}
 
-		ret = crypto_auth_run(fcr, &kcaop);
+		ret = crypto_auth_run(fcr, &op.kcaop);
 		if (unlikely(ret)) {
 			dwarning(1, "Error in crypto_auth_run");
 			return ret;
 		}
-		return kcaop_to_user(&kcaop, fcr, arg);
+		return kcaop_to_user(&op.kcaop, fcr, arg);
+	case CIOCHASHBATCH:
+		if (unlikely(copy_from_user(&op.hbop, arg, sizeof(op.hbop))))
+			return -EFAULT;
+
+		ret = crypto_hash_batch_run(fcr, &op.hbop);
+		if (unlikely(ret))
+			dwarning(1, "Error in crypto_hash_batch_run");
+		return ret;
+	case CIOCSRTPBATCH:
+		if (unlikely(copy_from_user(&op.sbop, arg, sizeof(op.sbop))))
+			return -EFAULT;
+
+		ret = crypto_srtp_batch_run(fcr, &op.sbop);
+		if (unlikely(ret))
+			dwarning(1, "Error in crypto_srtp_batch_run");
+		return ret;
+	case CIOCTLSBATCH:
+		if (unlikely(copy_from_user(&op.tbop, arg, sizeof(op.tbop))))
+			return -EFAULT;
+
+		/* on failure too, for the records sealed before it */
+		ret = crypto_tls_batch_run(fcr, &op.tbop);
+		if (unlikely(ret))
+			dwarning(1, "Error in crypto_tls_batch_run");
+		if (unlikely(copy_to_user(arg, &op.tbop, sizeof(op.tbop))))
+			return -EFAULT;
+		return ret;
+	case CIOCHASHEXPORT:
+		if (unlikely(copy_from_user(&op.hsop, arg, sizeof(op.hsop))))
+			return -EFAULT;
+
+		ret = hash_export_state(fcr, &op.hsop);
+		if (unlikely(ret && ret != -ENOSPC))
+			return ret;
+
+		if (unlikely(copy_to_user(arg, &op.hsop, sizeof(op.hsop))))
+			return -EFAULT;
+		return ret;
+	case CIOCHASHIMPORT:
+		if (unlikely(copy_from_user(&op.hsop, arg, sizeof(op.hsop))))
+			return -EFAULT;
+
+		return hash_import_state(fcr, &op.hsop);
+	case CIOCCRYPTDU:
+		if (unlikely(copy_from_user(&op.duop, arg, sizeof(op.duop))))
+			return -EFAULT;
+
+		ret = crypto_du_run(fcr, &op.duop);
+		if (unlikely(ret))
+			dwarning(1, "Error in crypto_du_run");
+		return ret;
+	case CIOCIVCOUNTER:
+		if (unlikely(copy_from_user(&op.ivop, arg, sizeof(op.ivop))))
+			return -EFAULT;
+
+		return set_iv_counter(fcr, &op.ivop);
+	case CIOCCOMPRESS:
+		if (unlikely(copy_from_user(&op.zop, arg, sizeof(op.zop))))
+			return -EFAULT;
+
+		ret = crypto_compress_run(fcr, &op.zop);
+		if (unlikely(ret)) {
+			dwarning(1, "Error in crypto_compress_run");
+			return ret;
+		}
+
+		if (unlikely(copy_to_user(arg, &op.zop, sizeof(op.zop))))
+			return -EFAULT;
+		return 0;
 #ifdef ENABLE_ASYNC
 	case CIOCASYNCCRYPT:
-		if (unlikely(ret = kcop_from_user(&kcop, fcr, arg)))
+		if (unlikely(ret = kcop_from_user(&op.kcop, fcr, arg)))
 			return ret;
 
-		return crypto_async_run(pcr, &kcop);
+		return crypto_async_run(pcr, &op.kcop);
 	case CIOCASYNCFETCH:
-		ret = crypto_async_fetch(pcr, &kcop);
+		ret = crypto_async_fetch(pcr, &op.kcop);
+		if (unlikely(ret))
+			return ret;
+
+		return kcop_to_user(&op.kcop, fcr, arg);
+	case CIOCASYNCKEY:
+		ret = kkop_from_user(&op.kkop, arg);
 		if (unlikely(ret))
 			return ret;
 
-		return kcop_to_user(&kcop, fcr, arg);
+		ret = crypto_async_kop_run(pcr, &op.kkop);
+		if (unlikely(ret))
+			kkop_free(&op.kkop);
+		return ret;
+	case CIOCASYNCKEYFETCH:
+		ret = crypto_async_kop_fetch(pcr, &op.kkop);
+		if (unlikely(ret))
+			return ret;
+
+		return kkop_to_user(&op.kkop, arg);
 #endif
 	default:
 		return -EINVAL;
@@ -1069,7 +1918,8 @@ static unsigned int cryptodev_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &pcr->user_waiter, wait);
 
-	if (!list_empty_careful(&pcr->done.list))
+	if (!list_empty_careful(&pcr->done.list) ||
+	    !list_empty_careful(&pcr->kdone.list))
 		ret |= POLLIN | POLLRDNORM;
 	if (!list_empty_careful(&pcr->free.list) || pcr->itemcount < MAX_COP_RINGSIZE)
 		ret |= POLLOUT | POLLWRNORM;
@@ -1146,8 +1996,13 @@ static int __init init_cryptodev(void)
 		return -EFAULT;
 	}
 
+	/* without it hash states cannot be exported or imported */
+	if (hash_state_key_init())
+		pr_warn(PFX "hmac(sha256) unavailable, hash states disabled\n");
+
 	rc = cryptodev_register();
 	if (unlikely(rc)) {
+		crypto_free_shash(hash_state_tfm);
 		destroy_workqueue(cryptodev_wq);
 		return rc;
 	}
@@ -1168,6 +2023,7 @@ static void __exit exit_cryptodev(void)
 		unregister_sysctl_table(verbosity_sysctl_header);
 
 	cryptodev_deregister();
+	crypto_free_shash(hash_state_tfm);
 	pr_info(PFX "driver unloaded.\n");
 }
 
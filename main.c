@@ -32,6 +32,7 @@
  *
  */
 #include <crypto/hash.h>
+#include <crypto/rng.h>
 #include <linux/crypto.h>
 #include <linux/mm.h>
 #include <linux/highmem.h>
@@ -41,8 +42,10 @@
 #include <linux/pagemap.h>
 #include <linux/poll.h>
 #include <linux/uaccess.h>
+#include <linux/uio.h>
 #include <crypto/cryptodev.h>
 #include <crypto/scatterwalk.h>
+#include <asm/unaligned.h>
 #include <linux/scatterlist.h>
 #include "cryptodev_int.h"
 #include "zc.h"
@@ -53,10 +56,23 @@
  * and hashing of /dev/crypto.
  */
 
+/* Hashes the data either as part of a multi-update hash or, if digest
+ * is set, as a complete message whose digest is stored there.
+ */
+static inline int
+hash_update_or_digest(struct hash_data *hdata, struct scatterlist *sg,
+		uint32_t len, uint8_t *digest)
+{
+	if (digest)
+		return cryptodev_hash_digest(hdata, sg, len, digest);
+	else
+		return cryptodev_hash_update(hdata, sg, len);
+}
+
 static int
 hash_n_crypt(struct csession *ses_ptr, struct crypt_op *cop,
 		struct scatterlist *src_sg, struct scatterlist *dst_sg,
-		uint32_t len)
+		uint32_t len, uint8_t *digest)
 {
 	int ret;
 
@@ -65,8 +81,7 @@ hash_n_crypt(struct csession *ses_ptr, struct crypt_op *cop,
 	 */
 	if (cop->op == COP_ENCRYPT) {
 		if (ses_ptr->hdata.init != 0) {
-			ret = cryptodev_hash_update(&ses_ptr->hdata,
-							src_sg, len);
+			ret = hash_update_or_digest(&ses_ptr->hdata, src_sg, len, digest);
 			if (unlikely(ret))
 				goto out_err;
 		}
@@ -87,8 +102,7 @@ hash_n_crypt(struct csession *ses_ptr, struct crypt_op *cop,
 		}
 
 		if (ses_ptr->hdata.init != 0) {
-			ret = cryptodev_hash_update(&ses_ptr->hdata,
-								dst_sg, len);
+			ret = hash_update_or_digest(&ses_ptr->hdata, dst_sg, len, digest);
 			if (unlikely(ret))
 				goto out_err;
 		}
@@ -102,7 +116,8 @@ out_err:
 /* This is the main crypto function - feed it with plaintext
    and get a ciphertext (or vice versa :-) */
 static int
-__crypto_run_std(struct csession *ses_ptr, struct crypt_op *cop)
+__crypto_run_std(struct csession *ses_ptr, struct crypt_op *cop,
+		uint8_t *digest)
 {
 	char *data;
 	char __user *src, *dst;
@@ -123,6 +138,13 @@ __crypto_run_std(struct csession *ses_ptr, struct crypt_op *cop)
 	src = cop->src;
 	dst = cop->dst;
 
+	/* data that don't fit in a page are hashed in several updates */
+	if (digest && nbytes > bufsize) {
+		ret = cryptodev_hash_reset(&ses_ptr->hdata);
+		if (unlikely(ret))
+			goto out;
+	}
+
 	while (nbytes > 0) {
 		size_t current_len = nbytes > bufsize ? bufsize : nbytes;
 
@@ -134,7 +156,8 @@ __crypto_run_std(struct csession *ses_ptr, struct crypt_op *cop)
 
 		sg_init_one(&sg, data, current_len);
 
-		ret = hash_n_crypt(ses_ptr, cop, &sg, &sg, current_len);
+		ret = hash_n_crypt(ses_ptr, cop, &sg, &sg, current_len,
+				   cop->len > bufsize ? NULL : digest);
 
 		if (unlikely(ret)) {
 		        derr(1, "hash_n_crypt failed.");
@@ -154,6 +177,13 @@ __crypto_run_std(struct csession *ses_ptr, struct crypt_op *cop)
 		src += current_len;
 	}
 
+	if (likely(ret == 0) && digest && cop->len > bufsize) {
+		ret = cryptodev_hash_final(&ses_ptr->hdata, digest);
+		if (unlikely(ret))
+			derr(0, "CryptoAPI failure: %d", ret);
+	}
+
+out:
 	free_page((unsigned long)data);
 	return ret;
 }
@@ -162,7 +192,8 @@ __crypto_run_std(struct csession *ses_ptr, struct crypt_op *cop)
 
 /* This is the main crypto function - zero-copy edition */
 static int
-__crypto_run_zc(struct csession *ses_ptr, struct kernel_crypt_op *kcop)
+__crypto_run_zc(struct csession *ses_ptr, struct kernel_crypt_op *kcop,
+		uint8_t *digest)
 {
 	struct scatterlist *src_sg, *dst_sg;
 	struct crypt_op *cop = &kcop->cop;
@@ -172,19 +203,61 @@ __crypto_run_zc(struct csession *ses_ptr, struct kernel_crypt_op *kcop)
 	                  kcop->task, kcop->mm, &src_sg, &dst_sg);
 	if (unlikely(ret)) {
 		derr(1, "Error getting user pages. Falling back to non zero copy.");
-		return __crypto_run_std(ses_ptr, cop);
+		return __crypto_run_std(ses_ptr, cop, digest);
 	}
 
-	ret = hash_n_crypt(ses_ptr, cop, src_sg, dst_sg, cop->len);
+	ret = hash_n_crypt(ses_ptr, cop, src_sg, dst_sg, cop->len, digest);
 
 	release_user_pages(ses_ptr);
 	return ret;
 }
 
+/* Produces the next IV of a session in counter IV mode: the salt, the
+ * counter in big endian and zeros up to the IV size. ChaCha20 has its
+ * block counter first, so there the zeros come first.
+ */
+int crypto_next_iv(struct csession *ses_ptr, uint8_t *iv)
+{
+	unsigned int salt_len = ses_ptr->ivgen.salt_len;
+
+	if (unlikely(ses_ptr->ivgen.counter == ~(u64)0)) {
+		derr(1, "IV counter exhausted");
+		return -EOVERFLOW;
+	}
+
+	memset(iv, 0, ses_ptr->cdata.ivsize);
+	if (ses_ptr->mode == CIPHER_MODE_CHACHA20)
+		iv += IV_BLOCK_COUNTER_SIZE;
+	memcpy(iv, ses_ptr->ivgen.salt, salt_len);
+	put_unaligned_be64(ses_ptr->ivgen.counter, iv + salt_len);
+	ses_ptr->ivgen.counter++;
+	return 0;
+}
+
+/* Takes the sequence number of the next record of a record mode. It is
+ * consumed even if the record then fails, so a nonce is never reused.
+ */
+int crypto_record_seq(struct csession *ses_ptr, u64 *seq)
+{
+	if (unlikely(!ses_ptr->record.enabled)) {
+		derr(1, "record state not set, see CIOCRECORD");
+		return -EINVAL;
+	}
+
+	if (unlikely(ses_ptr->record.seq == ~(u64)0)) {
+		derr(1, "record sequence number exhausted");
+		return -EOVERFLOW;
+	}
+
+	*seq = ses_ptr->record.seq++;
+	return 0;
+}
+
 int crypto_run(struct fcrypt *fcr, struct kernel_crypt_op *kcop)
 {
 	struct csession *ses_ptr;
 	struct crypt_op *cop = &kcop->cop;
+	uint8_t *digest = NULL;
 	int ret;
 
 	if (unlikely(cop->op != COP_ENCRYPT && cop->op != COP_DECRYPT)) {
@@ -199,7 +272,15 @@ int crypto_run(struct fcrypt *fcr, struct kernel_crypt_op *kcop)
 		return -EINVAL;
 	}
 
-	if (ses_ptr->hdata.init != 0 && (cop->flags == 0 || cop->flags & COP_FLAG_RESET)) {
+	/* A complete message is hashed with a single digest request instead
+	 * of separate init, update and final ones.
+	 */
+	if (ses_ptr->hdata.init != 0 && likely(cop->len) &&
+	    !(cop->flags & (COP_FLAG_UPDATE | COP_FLAG_FINAL)))
+		digest = kcop->hash_output;
+
+	if (ses_ptr->hdata.init != 0 && digest == NULL &&
+	    (cop->flags == 0 || cop->flags & COP_FLAG_RESET)) {
 		ret = cryptodev_hash_reset(&ses_ptr->hdata);
 		if (unlikely(ret)) {
 			derr(1, "error in cryptodev_hash_reset()");
@@ -217,8 +298,15 @@ int crypto_run(struct fcrypt *fcr, struct kernel_crypt_op *kcop)
 			goto out_unlock;
 		}
 
-		cryptodev_cipher_set_iv(&ses_ptr->cdata, kcop->iv,
-				min(ses_ptr->cdata.ivsize, kcop->ivlen));
+		if (kcop->iv_generated) {
+			ret = crypto_next_iv(ses_ptr, kcop->iv);
+			if (unlikely(ret))
+				goto out_unlock;
+			cryptodev_cipher_set_iv(&ses_ptr->cdata, kcop->iv,
+					ses_ptr->cdata.ivsize);
+		} else
+			cryptodev_cipher_set_iv(&ses_ptr->cdata, kcop->iv,
+					min(ses_ptr->cdata.ivsize, kcop->ivlen));
 	}
 
 	if (likely(cop->len)) {
@@ -237,19 +325,22 @@ int crypto_run(struct fcrypt *fcr, struct kernel_crypt_op *kcop)
 		}
 
 		if (cop->flags & COP_FLAG_NO_ZC)
-			ret = __crypto_run_std(ses_ptr, &kcop->cop);
+			ret = __crypto_run_std(ses_ptr, &kcop->cop, digest);
 		else
-			ret = __crypto_run_zc(ses_ptr, kcop);
+			ret = __crypto_run_zc(ses_ptr, kcop, digest);
 		if (unlikely(ret))
 			goto out_unlock;
 	}
 
-	if (ses_ptr->cdata.init != 0) {
+	/* a generated IV is returned as it was used */
+	if (ses_ptr->cdata.init != 0 && !kcop->iv_generated) {
 		cryptodev_cipher_get_iv(&ses_ptr->cdata, kcop->iv,
 				min(ses_ptr->cdata.ivsize, kcop->ivlen));
 	}
 
-	if (ses_ptr->hdata.init != 0 &&
+	if (digest) {
+		kcop->digestsize = ses_ptr->hdata.digestsize;
+	} else if (ses_ptr->hdata.init != 0 &&
 		((cop->flags & COP_FLAG_FINAL) ||
 		   (!(cop->flags & COP_FLAG_UPDATE) || cop->len == 0))) {
 
@@ -265,3 +356,561 @@ out_unlock:
 	crypto_put_session(ses_ptr);
 	return ret;
 }
+
+/* Hashes a batch of independent messages, HASH_BATCH_WINDOW of them at a
+ * time. The messages of each window are mapped one after the other in
+ * the session's page arrays.
+ */
+int crypto_hash_batch_run(struct fcrypt *fcr, struct hash_batch_op *hbop)
+{
+	struct csession *ses_ptr;
+	struct hash_batch_msg msgs[HASH_BATCH_WINDOW];
+	struct scatterlist *sg[HASH_BATCH_WINDOW];
+	uint32_t len[HASH_BATCH_WINDOW];
+	uint8_t *digests = NULL;
+	unsigned int i, n, j, pagecount, done = 0;
+	int ret = 0;
+
+	/* this also enters ses_ptr->sem */
+	ses_ptr = crypto_get_session_by_sid(fcr, hbop->ses);
+	if (unlikely(!ses_ptr)) {
+		derr(1, "invalid session ID=0x%08X", hbop->ses);
+		return -EINVAL;
+	}
+
+	if (unlikely(ses_ptr->hdata.init == 0 || ses_ptr->cdata.init != 0)) {
+		derr(1, "batch hashing requires a hash-only session");
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	digests = kmalloc(HASH_BATCH_WINDOW * ses_ptr->hdata.digestsize, GFP_KERNEL);
+	if (unlikely(!digests)) {
+		ret = -ENOMEM;
+		goto out_unlock;
+	}
+
+	for (i = 0; i < hbop->count; i += n) {
+		n = min_t(unsigned int, hbop->count - i, HASH_BATCH_WINDOW);
+
+		if (unlikely(copy_from_user(msgs, hbop->msgs + i, n * sizeof(msgs[0])))) {
+			ret = -EFAULT;
+			goto out;
+		}
+
+		for (j = 0, pagecount = 0; j < n; j++)
+			pagecount += PAGECOUNT(msgs[j].src, msgs[j].len);
+
+		if (pagecount > ses_ptr->array_size) {
+			ret = adjust_sg_array(ses_ptr, pagecount);
+			if (unlikely(ret))
+				goto out;
+		}
+
+		ses_ptr->used_pages = 0;
+		for (j = 0; j < n; j++) {
+			unsigned int pgcount = PAGECOUNT(msgs[j].src, msgs[j].len);
+
+			len[j] = msgs[j].len;
+			if (pgcount == 0) {
+				sg[j] = NULL;
+				continue;
+			}
+
+			ret = __get_userbuf(msgs[j].src, msgs[j].len, 0, pgcount,
+					ses_ptr->pages + ses_ptr->used_pages,
+					ses_ptr->sg + ses_ptr->used_pages,
+					current, current->mm);
+			if (unlikely(ret)) {
+				derr(1, "failed to get user pages for message %u", i + j);
+				break;
+			}
+
+			sg[j] = ses_ptr->sg + ses_ptr->used_pages;
+			ses_ptr->used_pages += pgcount;
+		}
+		/* nothing was written to the pages */
+		ses_ptr->readonly_pages = ses_ptr->used_pages;
+
+		if (likely(ret == 0))
+			ret = cryptodev_hash_digest_many(&ses_ptr->hdata, sg, len,
+							 n, digests);
+		release_user_pages(ses_ptr);
+		if (unlikely(ret)) {
+			derr(0, "CryptoAPI failure: %d", ret);
+			goto out;
+		}
+
+		if (unlikely(copy_to_user(hbop->mac + done,
+				digests, n * ses_ptr->hdata.digestsize))) {
+			ret = -EFAULT;
+			goto out;
+		}
+		done += n * ses_ptr->hdata.digestsize;
+	}
+
+out:
+	kfree(digests);
+out_unlock:
+	crypto_put_session(ses_ptr);
+	return ret;
+}
+
+
+/* Encrypts or decrypts a buffer made of consecutive data units (sectors)
+ * in a single call, the IV of each unit being derived from its number.
+ */
+int crypto_du_run(struct fcrypt *fcr, struct crypt_du_op *duop)
+{
+	struct csession *ses_ptr;
+	struct scatterlist *src_sg, *dst_sg;
+	int ret;
+
+	if (unlikely(duop->op != COP_ENCRYPT && duop->op != COP_DECRYPT)) {
+		ddebug(1, "invalid operation op=%u", duop->op);
+		return -EINVAL;
+	}
+
+	if (unlikely(duop->flags != 0)) {
+		ddebug(1, "invalid flags 0x%x", duop->flags);
+		return -EINVAL;
+	}
+
+	if (unlikely(duop->du_size == 0 || duop->len % duop->du_size)) {
+		ddebug(1, "length %u is not a multiple of the data unit size %u",
+		       duop->len, duop->du_size);
+		return -EINVAL;
+	}
+
+	/* this also enters ses_ptr->sem */
+	ses_ptr = crypto_get_session_by_sid(fcr, duop->ses);
+	if (unlikely(!ses_ptr)) {
+		derr(1, "invalid session ID=0x%08X", duop->ses);
+		return -EINVAL;
+	}
+
+	if (unlikely(ses_ptr->cdata.init == 0 || ses_ptr->cdata.aead != 0 ||
+		     ses_ptr->hdata.init != 0)) {
+		derr(1, "data unit operations require a cipher-only session");
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	if (unlikely(duop->du_size % ses_ptr->cdata.blocksize)) {
+		ddebug(1, "data unit size %u is not a multiple of blocksize %d",
+		       duop->du_size, ses_ptr->cdata.blocksize);
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	if (duop->len == 0) {
+		ret = 0;
+		goto out_unlock;
+	}
+
+	if (unlikely(!duop->src || !duop->dst)) {
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	ret = get_userbuf(ses_ptr, duop->src, duop->len, duop->dst, duop->len,
+			  current, current->mm, &src_sg, &dst_sg);
+	if (unlikely(ret)) {
+		derr(1, "Error getting user pages");
+		goto out_unlock;
+	}
+
+	ret = cryptodev_cipher_crypt_units(&ses_ptr->cdata,
+			duop->op == COP_ENCRYPT, src_sg, dst_sg, duop->len,
+			duop->du_size, duop->du_index);
+	if (unlikely(ret))
+		derr(0, "CryptoAPI failure: %d", ret);
+
+	release_user_pages(ses_ptr);
+out_unlock:
+	crypto_put_session(ses_ptr);
+	return ret;
+}
+
+/* Compresses or decompresses a complete buffer with a compression
+ * session. The output length is stored in zop->dst_len.
+ */
+int crypto_compress_run(struct fcrypt *fcr, struct compress_op *zop)
+{
+	struct csession *ses_ptr;
+	struct scatterlist *src_sg, *dst_sg;
+	ssize_t ret;
+
+	if (unlikely(zop->op != COP_COMPRESS && zop->op != COP_DECOMPRESS)) {
+		ddebug(1, "invalid operation op=%u", zop->op);
+		return -EINVAL;
+	}
+
+	if (unlikely(zop->flags != 0)) {
+		ddebug(1, "invalid flags 0x%x", zop->flags);
+		return -EINVAL;
+	}
+
+	/* the output may be larger than the input, so in-place is not an
+	 * option */
+	if (unlikely(!zop->src || !zop->dst || zop->src_len == 0 ||
+		     zop->dst_len == 0 || zop->src == zop->dst)) {
+		ddebug(1, "invalid buffers for compression");
+		return -EINVAL;
+	}
+
+	/* this also enters ses_ptr->sem */
+	ses_ptr = crypto_get_session_by_sid(fcr, zop->ses);
+	if (unlikely(!ses_ptr)) {
+		derr(1, "invalid session ID=0x%08X", zop->ses);
+		return -EINVAL;
+	}
+
+	if (unlikely(ses_ptr->zdata.init == 0)) {
+		derr(1, "compression context not initialized");
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	ret = get_userbuf(ses_ptr, zop->src, zop->src_len, zop->dst,
+			  zop->dst_len, current, current->mm, &src_sg, &dst_sg);
+	if (unlikely(ret)) {
+		derr(1, "Error getting user pages");
+		goto out_unlock;
+	}
+
+	ret = cryptodev_compress(&ses_ptr->zdata, zop->op == COP_COMPRESS,
+				 src_sg, zop->src_len, dst_sg, zop->dst_len);
+	release_user_pages(ses_ptr);
+	if (unlikely(ret < 0)) {
+		ddebug(1, "compression failure: %zd", ret);
+		goto out_unlock;
+	}
+
+	zop->dst_len = ret;
+	ret = 0;
+
+out_unlock:
+	crypto_put_session(ses_ptr);
+	return ret;
+}
+
+int crypto_random_run(struct fcrypt *fcr, struct random_op *rop)
+{
+	uint8_t __user *dst = rop->dst;
+	uint32_t left = rop->len, chunk;
+	uint8_t *buf;
+	int ret = 0;
+
+	if (unlikely(!dst && left)) {
+		ddebug(1, "invalid output buffer");
+		return -EINVAL;
+	}
+
+	/* each chunk is generated into a kernel page and copied out */
+	buf = (uint8_t *)__get_free_page(GFP_KERNEL);
+	if (unlikely(!buf))
+		return -ENOMEM;
+
+	mutex_lock(&fcr->rng_sem);
+	if (!fcr->rng) {
+		struct crypto_rng *rng = cryptodev_rng_alloc();
+
+		if (unlikely(IS_ERR(rng))) {
+			ret = PTR_ERR(rng);
+			goto out_unlock;
+		}
+		fcr->rng = rng;
+	}
+
+	while (left) {
+		chunk = min_t(uint32_t, left, PAGE_SIZE);
+
+		ret = crypto_rng_get_bytes(fcr->rng, buf, chunk);
+		if (unlikely(ret < 0)) {
+			ddebug(1, "random number generation failure: %d", ret);
+			break;
+		}
+		ret = 0;
+
+		if (unlikely(copy_to_user(dst, buf, chunk))) {
+			ret = -EFAULT;
+			break;
+		}
+
+		dst += chunk;
+		left -= chunk;
+		if (fatal_signal_pending(current)) {
+			ret = -EINTR;
+			break;
+		}
+		cond_resched();
+	}
+
+out_unlock:
+	mutex_unlock(&fcr->rng_sem);
+	memzero_explicit(buf, PAGE_SIZE);
+	free_page((unsigned long)buf);
+	return ret;
+}
+
+/* limits of CIOCKDF */
+#define KDF_MAX_INPUT	4096
+#define KDF_MAX_OUTPUT	8192
+
+/* Working memory of a derivation. Hash engines may DMA from and to it, so
+ * it is never on the stack.
+ */
+struct kdf_work {
+	uint8_t a[AALG_MAX_RESULT_LEN];	/* T(i-1) of HKDF, A(i) of the PRF */
+	uint8_t t[AALG_MAX_RESULT_LEN];
+	uint8_t counter;
+	struct scatterlist sg[3];
+};
+
+/* out = HMAC(v[0] || ... || v[n - 1]); empty parts are skipped */
+static int kdf_hmac(struct hash_data *hdata, struct kdf_work *w,
+		    const struct kvec *v, int n, uint8_t *out)
+{
+	size_t len = 0;
+	int i, k = 0;
+
+	sg_init_table(w->sg, n);
+	for (i = 0; i < n; i++) {
+		if (v[i].iov_len == 0)
+			continue;
+		sg_set_buf(&w->sg[k++], v[i].iov_base, v[i].iov_len);
+		len += v[i].iov_len;
+	}
+	if (k)
+		sg_mark_end(&w->sg[k - 1]);
+
+	return cryptodev_hash_digest(hdata, k ? w->sg : NULL, len, out);
+}
+
+/* HKDF-Expand of RFC 5869, the key of hdata being the PRK */
+static int hkdf_expand(struct hash_data *hdata, struct kdf_work *w,
+		       uint8_t *info, size_t info_len,
+		       uint8_t *out, size_t out_len)
+{
+	size_t dsize = hdata->digestsize, done, n;
+	struct kvec v[3];
+	int ret;
+
+	for (done = 0, w->counter = 1; done < out_len; done += n) {
+		v[0].iov_base = w->a;
+		v[0].iov_len = done ? dsize : 0;
+		v[1].iov_base = info;
+		v[1].iov_len = info_len;
+		v[2].iov_base = &w->counter;
+		v[2].iov_len = 1;
+
+		ret = kdf_hmac(hdata, w, v, 3, w->t);
+		if (unlikely(ret))
+			return ret;
+
+		n = min(dsize, out_len - done);
+		memcpy(out + done, w->t, n);
+		memcpy(w->a, w->t, dsize);
+		w->counter++;
+	}
+
+	return 0;
+}
+
+/* P_hash of RFC 5246, the key of hdata being the secret */
+static int tls12_prf(struct hash_data *hdata, struct kdf_work *w,
+		     uint8_t *seed, size_t seed_len,
+		     uint8_t *out, size_t out_len)
+{
+	size_t dsize = hdata->digestsize, done, n;
+	struct kvec v[2];
+	int ret;
+
+	/* A(1) */
+	v[0].iov_base = seed;
+	v[0].iov_len = seed_len;
+	ret = kdf_hmac(hdata, w, v, 1, w->a);
+	if (unlikely(ret))
+		return ret;
+
+	for (done = 0; done < out_len; done += n) {
+		v[0].iov_base = w->a;
+		v[0].iov_len = dsize;
+		v[1].iov_base = seed;
+		v[1].iov_len = seed_len;
+		ret = kdf_hmac(hdata, w, v, 2, w->t);
+		if (unlikely(ret))
+			return ret;
+
+		n = min(dsize, out_len - done);
+		memcpy(out + done, w->t, n);
+
+		/* A(i + 1) */
+		ret = kdf_hmac(hdata, w, v, 1, w->t);
+		if (unlikely(ret))
+			return ret;
+		memcpy(w->a, w->t, dsize);
+	}
+
+	return 0;
+}
+
+/* extract with the session's key as salt, then expand with a transient
+ * transform of the same driver keyed with the PRK */
+static int hkdf(struct hash_data *hdata, struct kdf_work *w,
+		uint8_t *ikm, size_t ikm_len, uint8_t *info, size_t info_len,
+		uint8_t *out, size_t out_len)
+{
+	struct hash_data prk;
+	struct kvec v;
+	int ret;
+
+	v.iov_base = ikm;
+	v.iov_len = ikm_len;
+	ret = kdf_hmac(hdata, w, &v, 1, w->t);
+	if (unlikely(ret))
+		return ret;
+
+	memset(&prk, 0, sizeof(prk));
+	ret = cryptodev_hash_init(&prk,
+			crypto_tfm_alg_driver_name(crypto_ahash_tfm(hdata->async.s)),
+			1, w->t, hdata->digestsize);
+	if (unlikely(ret))
+		return ret;
+
+	ret = hkdf_expand(&prk, w, info, info_len, out, out_len);
+	cryptodev_hash_deinit(&prk);
+	return ret;
+}
+
+/* copies an optional input of CIOCKDF */
+static int kdf_copy_in(uint8_t **p, const uint8_t __user *src, uint32_t len)
+{
+	*p = NULL;
+	if (len == 0)
+		return 0;
+
+	if (unlikely(!src || len > KDF_MAX_INPUT))
+		return -EINVAL;
+
+	*p = kmalloc(len, GFP_KERNEL);
+	if (unlikely(!*p))
+		return -ENOMEM;
+
+	if (unlikely(copy_from_user(*p, src, len)))
+		return -EFAULT;
+
+	return 0;
+}
+
+int crypto_kdf_run(struct fcrypt *fcr, struct kdf_op *kop)
+{
+	struct csession *ses_ptr;
+	struct hash_data *hdata;
+	struct kdf_work *w = NULL;
+	uint8_t *in = NULL, *info = NULL, *out = NULL;
+	size_t max_out;
+	int ret;
+
+	if (unlikely(kop->flags != 0)) {
+		ddebug(1, "invalid flags 0x%x", kop->flags);
+		return -EINVAL;
+	}
+
+	if (unlikely(!kop->out || kop->out_len == 0 ||
+		     (kop->op != KDF_HKDF && kop->info_len != 0))) {
+		ddebug(1, "invalid buffers for key derivation");
+		return -EINVAL;
+	}
+
+	/* this also enters ses_ptr->sem */
+	ses_ptr = crypto_get_session_by_sid(fcr, kop->ses);
+	if (unlikely(!ses_ptr)) {
+		derr(1, "invalid session ID=0x%08X", kop->ses);
+		return -EINVAL;
+	}
+	hdata = &ses_ptr->hdata;
+
+	if (unlikely(hdata->init == 0 ||
+		     strncmp(crypto_tfm_alg_name(crypto_ahash_tfm(hdata->async.s)),
+			     "hmac(", 5) != 0)) {
+		derr(1, "key derivation requires an HMAC session");
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	switch (kop->op) {
+	case KDF_HKDF_EXTRACT:
+		max_out = hdata->digestsize;
+		break;
+	case KDF_HKDF_EXPAND:
+	case KDF_HKDF:
+		max_out = 255 * hdata->digestsize;
+		break;
+	case KDF_TLS12_PRF:
+		max_out = KDF_MAX_OUTPUT;
+		break;
+	default:
+		ddebug(1, "invalid operation op=%u", kop->op);
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	if (unlikely(kop->out_len > max_out ||
+		     (kop->op == KDF_HKDF_EXTRACT &&
+		      kop->out_len != hdata->digestsize))) {
+		ddebug(1, "invalid output length %u", kop->out_len);
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	ret = kdf_copy_in(&in, kop->in, kop->in_len);
+	if (likely(ret == 0))
+		ret = kdf_copy_in(&info, kop->info, kop->info_len);
+	if (unlikely(ret))
+		goto out;
+
+	w = kzalloc(sizeof(*w), GFP_KERNEL);
+	out = kmalloc(kop->out_len, GFP_KERNEL);
+	if (unlikely(!w || !out)) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	switch (kop->op) {
+	case KDF_HKDF_EXTRACT: {
+		struct kvec v = { .iov_base = in, .iov_len = kop->in_len };
+
+		ret = kdf_hmac(hdata, w, &v, 1, out);
+		break;
+	}
+	case KDF_HKDF_EXPAND:
+		ret = hkdf_expand(hdata, w, in, kop->in_len, out, kop->out_len);
+		break;
+	case KDF_HKDF:
+		ret = hkdf(hdata, w, in, kop->in_len, info, kop->info_len,
+			   out, kop->out_len);
+		break;
+	case KDF_TLS12_PRF:
+		ret = tls12_prf(hdata, w, in, kop->in_len, out, kop->out_len);
+		break;
+	}
+	if (unlikely(ret)) {
+		ddebug(1, "key derivation failure: %d", ret);
+		goto out;
+	}
+
+	if (unlikely(copy_to_user(kop->out, out, kop->out_len)))
+		ret = -EFAULT;
+
+out:
+	/* all of these may hold key material */
+	kzfree(out);
+	kzfree(w);
+	kzfree(info);
+	kzfree(in);
+out_unlock:
+	crypto_put_session(ses_ptr);
+	return ret;
+}
@@ -0,0 +1,239 @@
+/*
+ * Driver for /dev/crypto device (aka CryptoDev)
+ *
+ * This file is part of linux cryptodev.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * This file handles the public key (CIOCKEY) part of /dev/crypto.
+ *
+ */
+
+#include <linux/crypto.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <crypto/cryptodev.h>
+#include "cryptodev_int.h"
+
+/* The parameters of struct crypt_kop are little endian numbers, while the
+ * kernel uses big endian ones. */
+static void reverse_bytes(uint8_t *buf, unsigned int len)
+{
+	unsigned int i;
+
+	for (i = 0; i < len / 2; i++)
+		swap(buf[i], buf[len - 1 - i]);
+}
+
+void kkop_free(struct kernel_crypt_kop *kkop)
+{
+	unsigned int i;
+
+	/* they may hold private keys */
+	for (i = 0; i < CRK_MAXPARAM; i++) {
+		kzfree(kkop->param[i]);
+		kkop->param[i] = NULL;
+	}
+}
+
+/* Copies the request and its input parameters to the kernel, so that it
+ * can also be processed outside the context of the caller.
+ */
+int kkop_from_user(struct kernel_crypt_kop *kkop, void __user *arg)
+{
+	struct crypt_kop *kop = &kkop->kop;
+	unsigned int i, nparams;
+	int ret;
+
+	memset(kkop->param, 0, sizeof(kkop->param));
+
+	if (unlikely(copy_from_user(kop, arg, sizeof(*kop))))
+		return -EFAULT;
+
+	nparams = kop->crk_iparams + kop->crk_oparams;
+	if (unlikely(nparams > CRK_MAXPARAM)) {
+		ddebug(1, "too many parameters: %u", nparams);
+		return -EINVAL;
+	}
+
+	for (i = 0; i < nparams; i++) {
+		unsigned int len = DIV_ROUND_UP(kop->crk_param[i].crp_nbits, 8);
+
+		if (unlikely(len > CRK_MAX_PARAM_BYTES)) {
+			ddebug(1, "parameter %u too large (%u bits)", i,
+			       kop->crk_param[i].crp_nbits);
+			ret = -EINVAL;
+			goto fail;
+		}
+
+		kkop->param_len[i] = len;
+		if (len == 0)
+			continue;
+
+		kkop->param[i] = kzalloc(len, GFP_KERNEL);
+		if (unlikely(!kkop->param[i])) {
+			ret = -ENOMEM;
+			goto fail;
+		}
+
+		if (i >= kop->crk_iparams)
+			continue;
+
+		if (unlikely(copy_from_user(kkop->param[i],
+				kop->crk_param[i].crp_p, len))) {
+			ret = -EFAULT;
+			goto fail;
+		}
+		reverse_bytes(kkop->param[i], len);
+	}
+
+	return 0;
+
+fail:
+	kkop_free(kkop);
+	return ret;
+}
+
+/* Copies the output parameters and the status back and releases the
+ * request.
+ */
+int kkop_to_user(struct kernel_crypt_kop *kkop, void __user *arg)
+{
+	struct crypt_kop *kop = &kkop->kop;
+	unsigned int i;
+	int ret = 0;
+
+	if (kop->crk_status == 0) {
+		for (i = kop->crk_iparams;
+		     i < kop->crk_iparams + kop->crk_oparams; i++) {
+			if (kkop->param_len[i] == 0)
+				continue;
+
+			reverse_bytes(kkop->param[i], kkop->param_len[i]);
+			if (unlikely(copy_to_user(kop->crk_param[i].crp_p,
+					kkop->param[i], kkop->param_len[i]))) {
+				ret = -EFAULT;
+				goto out;
+			}
+		}
+	}
+
+	if (unlikely(copy_to_user(arg, kop, sizeof(*kop))))
+		ret = -EFAULT;
+
+out:
+	kkop_free(kkop);
+	return ret;
+}
+
+/* base, exponent, modulus -> result */
+static int crypto_mod_exp(struct kernel_crypt_kop *kkop)
+{
+	if (unlikely(kkop->kop.crk_iparams != 3 || kkop->kop.crk_oparams != 1))
+		return -EINVAL;
+
+	if (unlikely(!kkop->param_len[2] || !kkop->param_len[3]))
+		return -EINVAL;
+
+	return cryptodev_pk_mod_exp(kkop->param[0], kkop->param_len[0],
+				    kkop->param[1], kkop->param_len[1],
+				    kkop->param[2], kkop->param_len[2],
+				    kkop->param[3], kkop->param_len[3]);
+}
+
+/* private key, public key of the peer, prime -> shared secret */
+static int crypto_dh_compute_key(struct kernel_crypt_kop *kkop)
+{
+	if (unlikely(kkop->kop.crk_iparams != 3 || kkop->kop.crk_oparams != 1))
+		return -EINVAL;
+
+	if (unlikely(!kkop->param_len[0] || !kkop->param_len[1] ||
+		     !kkop->param_len[2] || !kkop->param_len[3]))
+		return -EINVAL;
+
+	return cryptodev_pk_dh(kkop->param[0], kkop->param_len[0],
+			       kkop->param[1], kkop->param_len[1],
+			       kkop->param[2], kkop->param_len[2],
+			       kkop->param[3], kkop->param_len[3]);
+}
+
+/* private key, public key of the peer (x || y) -> x of the shared point */
+static int crypto_ecdh_compute_key(struct kernel_crypt_kop *kkop)
+{
+	if (unlikely(kkop->kop.crk_iparams != 2 || kkop->kop.crk_oparams != 1))
+		return -EINVAL;
+
+	if (unlikely(!kkop->param_len[0] || !kkop->param_len[2]))
+		return -EINVAL;
+
+	return cryptodev_pk_ecdh(kkop->param[0], kkop->param_len[0],
+				 kkop->param[1], kkop->param_len[1],
+				 kkop->param[2], kkop->param_len[2]);
+}
+
+/* Runs a request copied with kkop_from_user(). The outcome is also set
+ * in crk_status, as a positive error code.
+ */
+int crypto_kop_run(struct kernel_crypt_kop *kkop)
+{
+	struct crypt_kop *kop = &kkop->kop;
+	int ret;
+
+	switch (kop->crk_op) {
+	case CRK_MOD_EXP:
+		ret = crypto_mod_exp(kkop);
+		break;
+	case CRK_DH_COMPUTE_KEY:
+		ret = crypto_dh_compute_key(kkop);
+		break;
+	case CRK_ECDH_COMPUTE_KEY:
+		ret = crypto_ecdh_compute_key(kkop);
+		break;
+	default:
+		ddebug(1, "unsupported key operation %u", kop->crk_op);
+		ret = -EOPNOTSUPP;
+		break;
+	}
+
+	kop->crk_status = -ret;
+	return ret;
+}
+
+/* the CRF_* flags of the operations the kernel can do */
+int crypto_kop_features(void)
+{
+	int features = 0;
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 8, 0))
+	if (crypto_has_alg("rsa", CRYPTO_ALG_TYPE_AKCIPHER,
+			   CRYPTO_ALG_TYPE_MASK))
+		features |= CRF_MOD_EXP;
+	if (crypto_has_alg("dh", CRYPTO_ALG_TYPE_KPP, CRYPTO_ALG_TYPE_MASK))
+		features |= CRF_DH_COMPUTE_KEY;
+#endif
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 12, 0))
+	if (crypto_has_alg("ecdh-nist-p256", CRYPTO_ALG_TYPE_KPP,
+			   CRYPTO_ALG_TYPE_MASK))
+		features |= CRF_ECDH_COMPUTE_KEY;
+#elif (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 8, 0))
+	if (crypto_has_alg("ecdh", CRYPTO_ALG_TYPE_KPP, CRYPTO_ALG_TYPE_MASK))
+		features |= CRF_ECDH_COMPUTE_KEY;
+#endif
+
+	return features;
+}
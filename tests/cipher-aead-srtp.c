@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
 
@@ -515,6 +516,456 @@ test_encrypt_decrypt_error(int cfd, int err)
 	return 1;
 }
 
+/* key 00..0f, RFC 7714 salt, SSRC cafebabe, ROC 0 */
+static const unsigned char gcm_salt[] =
+	"\x51\x75\x69\x64\x20\x70\x72\x6f\x20\x71\x75\x6f";
+/* RTP, sequence number f17b, payload 40..4f */
+static const unsigned char gcm_rtp[] =
+	"\x80\x40\xf1\x7b\x80\x41\xf8\xd3\xca\xfe\xba\xbe\xbd\xbb\x1b\xc0"
+	"\x8c\x92\x21\x83\xbf\x1f\xc3\xa3\x8c\xf8\xf9\xac\xcf\x50\x54\x07"
+	"\xff\x5b\xf8\x8f\x54\x6b\x5f\x3b\xdf\x8a\x55\xa6";
+/* SRTCP, index 5d4, payload 60..73 */
+static const unsigned char gcm_srtcp[] =
+	"\x81\xc8\x00\x0d\xca\xfe\xba\xbe\xb1\xd4\xd3\x26\xc0\x78\xc3\x4d"
+	"\x42\x72\xea\x20\x10\xd2\xaf\xa1\x0a\xdb\x7c\x8e\xd2\x76\xa7\x2d"
+	"\x01\xc9\x68\x24\x77\x26\xfd\xc7\x12\x93\x8d\xe1\x80\x00\x05\xd4";
+
+#define GCM_TAG_SIZE 16
+#define GCM_LONG_HEADER 300
+
+static void
+gcm_fill(struct crypt_auth_op *cao, uint32_t ses, int op, unsigned char *packet,
+	 int hdr_len, int len, int trailer_len, unsigned char *iv)
+{
+	memset(cao, 0, sizeof(*cao));
+	cao->ses = ses;
+	cao->op = op;
+	cao->flags = COP_FLAG_AEAD_SRTP_TYPE;
+	cao->auth_src = packet;
+	cao->src = cao->dst = packet + hdr_len;
+	cao->len = len;
+	cao->auth_len = hdr_len + trailer_len +
+		(op == COP_ENCRYPT ? len : len - GCM_TAG_SIZE);
+	cao->iv = iv;
+}
+
+static int
+gcm_packet(int cfd, uint32_t ses, int op, unsigned char *packet,
+	   int hdr_len, int len, int trailer_len, unsigned char *iv)
+{
+	struct crypt_auth_op cao;
+
+	gcm_fill(&cao, ses, op, packet, hdr_len, len, trailer_len, iv);
+	return ioctl(cfd, CIOCAUTHCRYPT, &cao);
+}
+
+/* RTP: (0 || SSRC || ROC || SEQ) XOR salt */
+static void
+gcm_rtp_iv(unsigned char *iv, const unsigned char *packet, uint32_t roc)
+{
+	int i;
+
+	memset(iv, 0, 12);
+	memcpy(iv + 2, packet + 8, 4);
+	for (i = 0; i < 4; i++)
+		iv[6 + i] = roc >> (24 - 8 * i);
+	memcpy(iv + 10, packet + 2, 2);
+	for (i = 0; i < 12; i++)
+		iv[i] ^= gcm_salt[i];
+}
+
+/* SRTCP: (0 || SSRC || 0 || index) XOR salt */
+static void
+gcm_srtcp_iv(unsigned char *iv, const unsigned char *packet, int size)
+{
+	int i;
+
+	memset(iv, 0, 12);
+	memcpy(iv + 2, packet + 4, 4);
+	memcpy(iv + 8, packet + size - 4, 4);
+	iv[8] &= 0x7f;
+	for (i = 0; i < 12; i++)
+		iv[i] ^= gcm_salt[i];
+}
+
+static int
+gcm_session(int cfd, struct session_op *sess)
+{
+	unsigned char key[KEY_SIZE];
+	int i;
+
+	for (i = 0; i < KEY_SIZE; i++)
+		key[i] = i;
+
+	memset(sess, 0, sizeof(*sess));
+	sess->cipher = CRYPTO_AES_GCM;
+	sess->keylen = KEY_SIZE;
+	sess->key = key;
+	if (ioctl(cfd, CIOCGSESSION, sess)) {
+		perror("ioctl(CIOCGSESSION)");
+		return 1;
+	}
+	return 0;
+}
+
+/* SRTP and SRTCP with AES-GCM (RFC 7714): the kernel authenticates the
+ * header and the SRTCP trailer and appends the tag to the payload.
+ */
+static int
+test_gcm(int cfd)
+{
+	unsigned char iv[12];
+	unsigned char packet[GCM_LONG_HEADER + 64];
+	struct session_op sess;
+	int i;
+
+	if (gcm_session(cfd, &sess))
+		return 1;
+
+	memcpy(packet, gcm_rtp, 12);
+	for (i = 0; i < 16; i++)
+		packet[12 + i] = 0x40 + i;
+	gcm_rtp_iv(iv, packet, 0);
+
+	if (gcm_packet(cfd, sess.ses, COP_ENCRYPT, packet, 12, 16, 0, iv)) {
+		perror("ioctl(CIOCAUTHCRYPT)");
+		return 1;
+	}
+	if (memcmp(packet, gcm_rtp, sizeof(gcm_rtp) - 1) != 0) {
+		fprintf(stderr, "SRTP-GCM packet mismatch\n");
+		print_buf("Packet  : ", packet, sizeof(gcm_rtp) - 1);
+		print_buf("Expected: ", (unsigned char *)gcm_rtp, sizeof(gcm_rtp) - 1);
+		return 1;
+	}
+
+	if (gcm_packet(cfd, sess.ses, COP_DECRYPT, packet, 12, 16 + GCM_TAG_SIZE, 0, iv)) {
+		perror("ioctl(CIOCAUTHCRYPT)");
+		return 1;
+	}
+	for (i = 0; i < 16; i++) {
+		if (packet[12 + i] != 0x40 + i) {
+			fprintf(stderr, "SRTP-GCM decryption mismatch\n");
+			return 1;
+		}
+	}
+
+	memcpy(packet, gcm_srtcp, sizeof(gcm_srtcp) - 1);
+	gcm_srtcp_iv(iv, packet, sizeof(gcm_srtcp) - 1);
+
+	if (gcm_packet(cfd, sess.ses, COP_DECRYPT, packet, 8, 20 + GCM_TAG_SIZE, 4, iv)) {
+		perror("ioctl(CIOCAUTHCRYPT)");
+		return 1;
+	}
+	for (i = 0; i < 20; i++) {
+		if (packet[8 + i] != 0x60 + i) {
+			fprintf(stderr, "SRTCP-GCM decryption mismatch\n");
+			return 1;
+		}
+	}
+
+	if (gcm_packet(cfd, sess.ses, COP_ENCRYPT, packet, 8, 20, 4, iv)) {
+		perror("ioctl(CIOCAUTHCRYPT)");
+		return 1;
+	}
+	if (memcmp(packet, gcm_srtcp, sizeof(gcm_srtcp) - 1) != 0) {
+		fprintf(stderr, "SRTCP-GCM packet mismatch\n");
+		print_buf("Packet  : ", packet, sizeof(gcm_srtcp) - 1);
+		return 1;
+	}
+
+	/* headers with long extensions are fine, and are authenticated */
+	memset(packet, 0x15, GCM_LONG_HEADER);
+	memset(packet + GCM_LONG_HEADER, 0x17, 32);
+	if (gcm_packet(cfd, sess.ses, COP_ENCRYPT, packet, GCM_LONG_HEADER, 32, 0, iv)) {
+		perror("ioctl(CIOCAUTHCRYPT)");
+		return 1;
+	}
+	packet[GCM_LONG_HEADER - 1] ^= 1;
+	if (gcm_packet(cfd, sess.ses, COP_DECRYPT, packet, GCM_LONG_HEADER,
+		       32 + GCM_TAG_SIZE, 0, iv) == 0) {
+		fprintf(stderr, "SRTP-GCM packet with a modified header accepted\n");
+		return 1;
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	if (debug) printf("Test passed\n");
+	return 0;
+}
+
+/* Protect and unprotect several packets with one CIOCSRTPBATCH; a
+ * forged packet only fails on its own.
+ */
+static int
+test_batch(int cfd)
+{
+	unsigned char rtp[64], srtcp[64], forged[64];
+	unsigned char rtp_iv[12], srtcp_iv[12];
+	struct crypt_auth_op caops[3];
+	struct srtp_batch_op sbop;
+	struct session_op sess;
+	int status[3];
+	int i;
+
+	if (gcm_session(cfd, &sess))
+		return 1;
+
+	memcpy(rtp, gcm_rtp, 12);
+	for (i = 0; i < 16; i++)
+		rtp[12 + i] = 0x40 + i;
+	gcm_rtp_iv(rtp_iv, rtp, 0);
+	memcpy(forged, gcm_rtp, sizeof(gcm_rtp) - 1);
+	forged[20] ^= 1;
+	memcpy(srtcp, gcm_srtcp, sizeof(gcm_srtcp) - 1);
+	gcm_srtcp_iv(srtcp_iv, srtcp, sizeof(gcm_srtcp) - 1);
+
+	gcm_fill(&caops[0], sess.ses, COP_ENCRYPT, rtp, 12, 16, 0, rtp_iv);
+	gcm_fill(&caops[1], sess.ses, COP_DECRYPT, forged, 12, 16 + GCM_TAG_SIZE, 0, rtp_iv);
+	gcm_fill(&caops[2], sess.ses, COP_DECRYPT, srtcp, 8, 20 + GCM_TAG_SIZE, 4, srtcp_iv);
+
+	memset(&sbop, 0, sizeof(sbop));
+	sbop.count = 3;
+	sbop.caops = caops;
+	sbop.status = status;
+	if (ioctl(cfd, CIOCSRTPBATCH, &sbop)) {
+		perror("ioctl(CIOCSRTPBATCH)");
+		return 1;
+	}
+
+	if (status[0] != 0 || status[1] != -EBADMSG || status[2] != 0) {
+		fprintf(stderr, "SRTP batch status %d %d %d\n",
+			status[0], status[1], status[2]);
+		return 1;
+	}
+
+	if (caops[0].len != 16 + GCM_TAG_SIZE ||
+	    memcmp(rtp, gcm_rtp, sizeof(gcm_rtp) - 1) != 0) {
+		fprintf(stderr, "SRTP batch packet mismatch\n");
+		return 1;
+	}
+
+	for (i = 0; i < 20; i++) {
+		if (caops[2].len != 20 || srtcp[8 + i] != 0x60 + i) {
+			fprintf(stderr, "SRTP batch decryption mismatch\n");
+			return 1;
+		}
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	if (debug) printf("Test passed\n");
+	return 0;
+}
+
+static int
+set_salt(int cfd, uint32_t ses, const unsigned char *salt, int salt_len)
+{
+	struct record_state_op rsop;
+
+	memset(&rsop, 0, sizeof(rsop));
+	rsop.ses = ses;
+	rsop.iv = (unsigned char *)salt;
+	rsop.iv_len = salt_len;
+	if (ioctl(cfd, CIOCRECORD, &rsop)) {
+		perror("ioctl(CIOCRECORD)");
+		return 1;
+	}
+	return 0;
+}
+
+/* SRTP-GCM packets with kernel-derived IVs: the first one matches the
+ * known answer and the sequence number wrapping moves the rollover
+ * counter, for the sender and for the receiver.
+ */
+static int
+test_kernel_iv_gcm(int cfd)
+{
+	unsigned char packets[3][64], expected[64], iv[12];
+	static const uint16_t seqs[3] = { 0xf17b, 0xffff, 0x0001 };
+	static const uint32_t rocs[3] = { 0, 0, 1 };
+	struct session_op enc, dec, ref;
+	struct crypt_auth_op cao;
+	int i, j;
+
+	if (gcm_session(cfd, &enc) || gcm_session(cfd, &dec) ||
+	    gcm_session(cfd, &ref))
+		return 1;
+	if (set_salt(cfd, enc.ses, gcm_salt, 12) ||
+	    set_salt(cfd, dec.ses, gcm_salt, 12))
+		return 1;
+
+	for (i = 0; i < 3; i++) {
+		memcpy(packets[i], gcm_rtp, 12);
+		packets[i][2] = seqs[i] >> 8;
+		packets[i][3] = seqs[i];
+		for (j = 0; j < 16; j++)
+			packets[i][12 + j] = 0x40 + j;
+
+		/* the reference is built with an explicit IV */
+		memcpy(expected, packets[i], 28);
+		gcm_rtp_iv(iv, expected, rocs[i]);
+		if (gcm_packet(cfd, ref.ses, COP_ENCRYPT, expected, 12, 16, 0, iv)) {
+			perror("ioctl(CIOCAUTHCRYPT)");
+			return 1;
+		}
+
+		memset(&cao, 0, sizeof(cao));
+		cao.ses = enc.ses;
+		cao.op = COP_ENCRYPT;
+		cao.flags = COP_FLAG_AEAD_SRTP_TYPE;
+		cao.auth_src = packets[i];
+		cao.auth_len = 28;
+		if (ioctl(cfd, CIOCAUTHCRYPT, &cao)) {
+			perror("ioctl(CIOCAUTHCRYPT)");
+			return 1;
+		}
+
+		if (cao.len != 16 + GCM_TAG_SIZE ||
+		    memcmp(packets[i], expected, 28 + GCM_TAG_SIZE) != 0 ||
+		    (i == 0 && memcmp(packets[i], gcm_rtp, sizeof(gcm_rtp) - 1) != 0)) {
+			fprintf(stderr, "SRTP-GCM packet %d mismatch\n", i);
+			print_buf("Packet  : ", packets[i], 28 + GCM_TAG_SIZE);
+			print_buf("Expected: ", expected, 28 + GCM_TAG_SIZE);
+			return 1;
+		}
+	}
+
+	for (i = 0; i < 3; i++) {
+		memset(&cao, 0, sizeof(cao));
+		cao.ses = dec.ses;
+		cao.op = COP_DECRYPT;
+		cao.flags = COP_FLAG_AEAD_SRTP_TYPE;
+		cao.auth_src = packets[i];
+		cao.auth_len = 28;
+		if (ioctl(cfd, CIOCAUTHCRYPT, &cao)) {
+			perror("ioctl(CIOCAUTHCRYPT)");
+			return 1;
+		}
+
+		for (j = 0; j < 16; j++) {
+			if (cao.len != 16 || packets[i][12 + j] != 0x40 + j) {
+				fprintf(stderr, "SRTP-GCM packet %d decryption mismatch\n", i);
+				return 1;
+			}
+		}
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &enc.ses) ||
+	    ioctl(cfd, CIOCFSESSION, &dec.ses) ||
+	    ioctl(cfd, CIOCFSESSION, &ref.ses)) {
+		perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	if (debug) printf("Test passed\n");
+	return 0;
+}
+
+#define CM_SALT_SIZE 14
+#define CM_TAG_SIZE 10
+
+/* AES-CM with HMAC-SHA1 and a kernel-derived IV, checked against the
+ * same packet protected with an explicit IV and an appended ROC.
+ */
+static int
+test_kernel_iv_cm(int cfd)
+{
+	unsigned char key[KEY_SIZE], salt[CM_SALT_SIZE], iv[BLOCK_SIZE];
+	unsigned char mackey[20];
+	unsigned char packet[64], expected[64], tag[CM_TAG_SIZE];
+	struct session_op sess;
+	struct crypt_auth_op cao;
+	int i;
+
+	memset(key, 0x33, sizeof(key));
+	memset(mackey, 0x0b, sizeof(mackey));
+	for (i = 0; i < CM_SALT_SIZE; i++)
+		salt[i] = 0xa0 + i;
+
+	memset(&sess, 0, sizeof(sess));
+	sess.cipher = CRYPTO_AES_CTR;
+	sess.keylen = KEY_SIZE;
+	sess.key = key;
+	sess.mac = CRYPTO_SHA1_HMAC;
+	sess.mackeylen = sizeof(mackey);
+	sess.mackey = mackey;
+	if (ioctl(cfd, CIOCGSESSION, &sess)) {
+		perror("ioctl(CIOCGSESSION)");
+		return 1;
+	}
+
+	/* version 2, one CSRC and a one-word extension */
+	memset(packet, 0, sizeof(packet));
+	packet[0] = 0x91;
+	packet[2] = 0x12;
+	packet[3] = 0x34;
+	memcpy(packet + 8, "\xca\xfe\xba\xbe", 4);
+	packet[19] = 1;
+	for (i = 24; i < 44; i++)
+		packet[i] = i;
+	memcpy(expected, packet, sizeof(packet));
+
+	/* salt * 2^16 XOR SSRC * 2^64 XOR index * 2^16, with ROC 0 */
+	memset(iv, 0, sizeof(iv));
+	memcpy(iv + 4, packet + 8, 4);
+	memcpy(iv + 12, packet + 2, 2);
+	for (i = 0; i < CM_SALT_SIZE; i++)
+		iv[i] ^= salt[i];
+
+	memset(&cao, 0, sizeof(cao));
+	cao.ses = sess.ses;
+	cao.op = COP_ENCRYPT;
+	cao.flags = COP_FLAG_AEAD_SRTP_TYPE;
+	cao.auth_src = expected;
+	cao.auth_len = 44 + 4;	/* the ROC follows the packet */
+	cao.src = cao.dst = expected + 24;
+	cao.len = 20;
+	cao.iv = iv;
+	cao.tag = tag;
+	cao.tag_len = CM_TAG_SIZE;
+	if (ioctl(cfd, CIOCAUTHCRYPT, &cao)) {
+		perror("ioctl(CIOCAUTHCRYPT)");
+		return 1;
+	}
+	memcpy(expected + 44, tag, CM_TAG_SIZE);
+
+	if (set_salt(cfd, sess.ses, salt, CM_SALT_SIZE))
+		return 1;
+
+	memset(&cao, 0, sizeof(cao));
+	cao.ses = sess.ses;
+	cao.op = COP_ENCRYPT;
+	cao.flags = COP_FLAG_AEAD_SRTP_TYPE;
+	cao.auth_src = packet;
+	cao.auth_len = 44;
+	cao.tag_len = CM_TAG_SIZE;
+	if (ioctl(cfd, CIOCAUTHCRYPT, &cao)) {
+		perror("ioctl(CIOCAUTHCRYPT)");
+		return 1;
+	}
+
+	if (cao.len != 20 || memcmp(packet, expected, 44 + CM_TAG_SIZE) != 0) {
+		fprintf(stderr, "SRTP packet with kernel IV mismatch\n");
+		print_buf("Packet  : ", packet, 44 + CM_TAG_SIZE);
+		print_buf("Expected: ", expected, 44 + CM_TAG_SIZE);
+		return 1;
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	if (debug) printf("Test passed\n");
+	return 0;
+}
+
 int
 main(int argc, char** argv)
 {
@@ -555,6 +1006,18 @@ main(int argc, char** argv)
 	if (test_encrypt_decrypt_error(cfd,1))
 		return 1;
 
+	if (test_gcm(cfd))
+		return 1;
+
+	if (test_batch(cfd))
+		return 1;
+
+	if (test_kernel_iv_gcm(cfd))
+		return 1;
+
+	if (test_kernel_iv_cm(cfd))
+		return 1;
+
 	/* Close cloned descriptor */
 	if (close(cfd)) {
 		perror("close(cfd)");
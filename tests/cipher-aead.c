@@ -13,7 +13,8 @@
 #include <sys/ioctl.h>
 #include <crypto/cryptodev.h>
 
-#define	DATA_SIZE	(8*1024)
+/* larger than the chunks the kernel hashes and encrypts at a time */
+#define	DATA_SIZE	(20*1024)
 #define AUTH_SIZE       31
 #define	BLOCK_SIZE	16
 #define	KEY_SIZE	16
@@ -519,6 +520,115 @@ test_encrypt_decrypt_error(int cfd, int err)
 	return 1;
 }
 
+/* A stream cipher record larger than the chunks the kernel hashes and
+ * encrypts at a time must come out as if it were done in one pass.
+ */
+static int
+test_stream_record(int cfd)
+{
+	static char plaintext[DATA_SIZE], record[DATA_SIZE + MAC_SIZE];
+	static char expected[DATA_SIZE + MAC_SIZE];
+	char iv[BLOCK_SIZE];
+	char key[32];
+	char auth[AUTH_SIZE];
+	unsigned char sha1mac[20];
+
+	struct session_op sess;
+	struct crypt_op co;
+	struct crypt_auth_op cao;
+
+	memset(&sess, 0, sizeof(sess));
+	memset(&cao, 0, sizeof(cao));
+	memset(&co, 0, sizeof(co));
+
+	memset(key, 0x33, sizeof(key));
+	memset(iv, 0x03, sizeof(iv));
+	memset(auth, 0xf1, sizeof(auth));
+	memset(plaintext, 0x15, DATA_SIZE);
+
+	/* the MAC and the ciphertext in one pass each */
+	sess.mackey = (uint8_t*)"\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b";
+	if (get_sha1_hmac(cfd, sess.mackey, 16, auth, sizeof(auth), plaintext, DATA_SIZE, sha1mac) != 0) {
+		fprintf(stderr, "SHA1 MAC failed\n");
+		return 1;
+	}
+	memcpy(expected, plaintext, DATA_SIZE);
+	memcpy(expected + DATA_SIZE, sha1mac, MAC_SIZE);
+
+	sess.cipher = CRYPTO_CHACHA20;
+	sess.keylen = sizeof(key);
+	sess.key = (void*)key;
+	sess.mackey = NULL;
+	if (ioctl(cfd, CIOCGSESSION, &sess)) {
+		perror("ioctl(CIOCGSESSION)");
+		return 1;
+	}
+
+	co.ses = sess.ses;
+	co.len = sizeof(expected);
+	co.src = expected;
+	co.dst = expected;
+	co.iv = iv;
+	co.op = COP_ENCRYPT;
+	if (ioctl(cfd, CIOCCRYPT, &co)) {
+		perror("ioctl(CIOCCRYPT)");
+		return 1;
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	/* and as a TLS record */
+	sess.mac = CRYPTO_SHA1_HMAC;
+	sess.mackeylen = 16;
+	sess.mackey = (uint8_t*)"\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b";
+	if (ioctl(cfd, CIOCGSESSION, &sess)) {
+		perror("ioctl(CIOCGSESSION)");
+		return 1;
+	}
+
+	memcpy(record, plaintext, DATA_SIZE);
+	cao.ses = sess.ses;
+	cao.auth_src = auth;
+	cao.auth_len = sizeof(auth);
+	cao.len = DATA_SIZE;
+	cao.src = record;
+	cao.dst = record;
+	cao.iv = iv;
+	cao.op = COP_ENCRYPT;
+	cao.flags = COP_FLAG_AEAD_TLS_TYPE;
+	if (ioctl(cfd, CIOCAUTHCRYPT, &cao)) {
+		perror("ioctl(CIOCAUTHCRYPT)");
+		return 1;
+	}
+
+	if (cao.len != sizeof(record) || memcmp(record, expected, sizeof(record)) != 0) {
+		fprintf(stderr, "ChaCha20 record differs from the one-pass result\n");
+		return 1;
+	}
+
+	cao.op = COP_DECRYPT;
+	if (ioctl(cfd, CIOCAUTHCRYPT, &cao)) {
+		perror("ioctl(CIOCAUTHCRYPT)");
+		return 1;
+	}
+
+	if (cao.len != DATA_SIZE || memcmp(record, plaintext, DATA_SIZE) != 0) {
+		fprintf(stderr, "ChaCha20 record was not decrypted\n");
+		return 1;
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	if (debug) printf("Test passed\n");
+	return 0;
+}
+
 int
 main()
 {
@@ -557,6 +667,9 @@ main()
 	if (test_encrypt_decrypt_error(cfd, 1))
 		return 1;
 
+	if (test_stream_record(cfd))
+		return 1;
+
 	/* Close cloned descriptor */
 	if (close(cfd)) {
 		perror("close(cfd)");
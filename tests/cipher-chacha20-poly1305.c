@@ -0,0 +1,358 @@
+/*
+ * Demo on how to use /dev/crypto device for ChaCha20 and
+ * ChaCha20-Poly1305.
+ *
+ * Placed under public domain.
+ *
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/ioctl.h>
+#include <crypto/cryptodev.h>
+
+#define	DATA_SIZE	(8*1024)
+#define AUTH_SIZE       31
+#define	IV_SIZE		12
+#define	KEY_SIZE	32
+#define	TAG_SIZE	16
+
+#define my_perror(x) {fprintf(stderr, "%s: %d\n", __func__, __LINE__); perror(x); }
+
+static int debug = 0;
+
+static void print_buf(char *desc, const unsigned char *buf, int size)
+{
+	int i;
+	fputs(desc, stdout);
+	for (i = 0; i < size; i++) {
+		printf("%.2x", (uint8_t) buf[i]);
+	}
+	fputs("\n", stdout);
+}
+
+/* RFC 7539, sections 2.4.2 and 2.8.2 */
+static const uint8_t sunscreen[] =
+	"Ladies and Gentlemen of the class of '99: If I could offer you only "
+	"one tip for the future, sunscreen would be it.";
+#define SUNSCREEN_SIZE	114
+
+static const uint8_t chacha20_key[] =
+	"\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f"
+	"\x10\x11\x12\x13\x14\x15\x16\x17\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f";
+/* block counter 1, followed by the nonce */
+static const uint8_t chacha20_iv[] =
+	"\x01\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x4a\x00\x00\x00\x00";
+static const uint8_t chacha20_ciphertext[] =
+	"\x6e\x2e\x35\x9a\x25\x68\xf9\x80\x41\xba\x07\x28\xdd\x0d\x69\x81"
+	"\xe9\x7e\x7a\xec\x1d\x43\x60\xc2\x0a\x27\xaf\xcc\xfd\x9f\xae\x0b"
+	"\xf9\x1b\x65\xc5\x52\x47\x33\xab\x8f\x59\x3d\xab\xcd\x62\xb3\x57"
+	"\x16\x39\xd6\x24\xe6\x51\x52\xab\x8f\x53\x0c\x35\x9f\x08\x61\xd8"
+	"\x07\xca\x0d\xbf\x50\x0d\x6a\x61\x56\xa3\x8e\x08\x8a\x22\xb6\x5e"
+	"\x52\xbc\x51\x4d\x16\xcc\xf8\x06\x81\x8c\xe9\x1a\xb7\x79\x37\x36"
+	"\x5a\xf9\x0b\xbf\x74\xa3\x5b\xe6\xb4\x0b\x8e\xed\xf2\x78\x5e\x42"
+	"\x87\x4d";
+
+static const uint8_t aead_key[] =
+	"\x80\x81\x82\x83\x84\x85\x86\x87\x88\x89\x8a\x8b\x8c\x8d\x8e\x8f"
+	"\x90\x91\x92\x93\x94\x95\x96\x97\x98\x99\x9a\x9b\x9c\x9d\x9e\x9f";
+static const uint8_t aead_iv[] =
+	"\x07\x00\x00\x00\x40\x41\x42\x43\x44\x45\x46\x47";
+static const uint8_t aead_auth[] =
+	"\x50\x51\x52\x53\xc0\xc1\xc2\xc3\xc4\xc5\xc6\xc7";
+static const uint8_t aead_ciphertext[] =
+	"\xd3\x1a\x8d\x34\x64\x8e\x60\xdb\x7b\x86\xaf\xbc\x53\xef\x7e\xc2"
+	"\xa4\xad\xed\x51\x29\x6e\x08\xfe\xa9\xe2\xb5\xa7\x36\xee\x62\xd6"
+	"\x3d\xbe\xa4\x5e\x8c\xa9\x67\x12\x82\xfa\xfb\x69\xda\x92\x72\x8b"
+	"\x1a\x71\xde\x0a\x9e\x06\x0b\x29\x05\xd6\xa5\xb6\x7e\xcd\x3b\x36"
+	"\x92\xdd\xbd\x7f\x2d\x77\x8b\x8c\x98\x03\xae\xe3\x28\x09\x1b\x58"
+	"\xfa\xb3\x24\xe4\xfa\xd6\x75\x94\x55\x85\x80\x8b\x48\x31\xd7\xbc"
+	"\x3f\xf4\xde\xf0\x8e\x4b\x7a\x9d\xe5\x76\xd2\x65\x86\xce\xc6\x4b"
+	"\x61\x16";
+static const uint8_t aead_tag[] =
+	"\x1a\xe1\x0b\x59\x4f\x09\xe2\x6a\x7e\x90\x2e\xcb\xd0\x60\x06\x91";
+
+/* Test ChaCha20 against the RFC 7539 test vector.
+ */
+static int test_stream(int cfd)
+{
+	uint8_t tmp[SUNSCREEN_SIZE];
+	struct session_op sess;
+	struct crypt_op co;
+
+	if (debug) {
+		fprintf(stdout, "Tests on ChaCha20 vectors: ");
+		fflush(stdout);
+	}
+
+	memset(&sess, 0, sizeof(sess));
+	memset(&co, 0, sizeof(co));
+
+	sess.cipher = CRYPTO_CHACHA20;
+	sess.keylen = KEY_SIZE;
+	sess.key = (void *) chacha20_key;
+
+	if (ioctl(cfd, CIOCGSESSION, &sess)) {
+		my_perror("ioctl(CIOCGSESSION)");
+		return 1;
+	}
+
+	co.ses = sess.ses;
+	co.len = SUNSCREEN_SIZE;
+	co.src = (void *) sunscreen;
+	co.dst = tmp;
+	co.iv = (void *) chacha20_iv;
+	co.op = COP_ENCRYPT;
+
+	if (ioctl(cfd, CIOCCRYPT, &co)) {
+		my_perror("ioctl(CIOCCRYPT)");
+		return 1;
+	}
+
+	if (memcmp(tmp, chacha20_ciphertext, SUNSCREEN_SIZE) != 0) {
+		fprintf(stderr, "ChaCha20 test vector failed!\n");
+		print_buf("Cipher: ", tmp, SUNSCREEN_SIZE);
+		print_buf("Expected: ", chacha20_ciphertext, SUNSCREEN_SIZE);
+		return 1;
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		my_perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	if (debug) {
+		fprintf(stdout, "ok\n");
+		fprintf(stdout, "\n");
+	}
+
+	return 0;
+}
+
+/* Test ChaCha20-Poly1305 against the RFC 7539 test vector.
+ */
+static int test_crypto(int cfd)
+{
+	uint8_t tmp[SUNSCREEN_SIZE + TAG_SIZE];
+	struct session_op sess;
+	struct crypt_auth_op cao;
+
+	if (debug) {
+		fprintf(stdout, "Tests on ChaCha20-Poly1305 vectors: ");
+		fflush(stdout);
+	}
+
+	memset(&sess, 0, sizeof(sess));
+	memset(&cao, 0, sizeof(cao));
+
+	sess.cipher = CRYPTO_CHACHA20_POLY1305;
+	sess.keylen = KEY_SIZE;
+	sess.key = (void *) aead_key;
+
+	if (ioctl(cfd, CIOCGSESSION, &sess)) {
+		my_perror("ioctl(CIOCGSESSION)");
+		return 1;
+	}
+
+	cao.ses = sess.ses;
+	cao.auth_src = (void *) aead_auth;
+	cao.auth_len = 12;
+	cao.len = SUNSCREEN_SIZE;
+	cao.src = (void *) sunscreen;
+	cao.dst = tmp;
+	cao.iv = (void *) aead_iv;
+	cao.iv_len = IV_SIZE;
+	cao.op = COP_ENCRYPT;
+
+	if (ioctl(cfd, CIOCAUTHCRYPT, &cao)) {
+		my_perror("ioctl(CIOCAUTHCRYPT)");
+		return 1;
+	}
+
+	if (memcmp(tmp, aead_ciphertext, SUNSCREEN_SIZE) != 0) {
+		fprintf(stderr, "ChaCha20-Poly1305 test vector failed!\n");
+		print_buf("Cipher: ", tmp, SUNSCREEN_SIZE);
+		print_buf("Expected: ", aead_ciphertext, SUNSCREEN_SIZE);
+		return 1;
+	}
+
+	if (cao.tag_len != TAG_SIZE ||
+	    memcmp(&tmp[cao.len - cao.tag_len], aead_tag, TAG_SIZE) != 0) {
+		fprintf(stderr, "ChaCha20-Poly1305 test vector failed (tag)!\n");
+		print_buf("Tag: ", &tmp[cao.len - cao.tag_len], cao.tag_len);
+		print_buf("Expected tag: ", aead_tag, TAG_SIZE);
+		return 1;
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		my_perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	if (debug) {
+		fprintf(stdout, "ok\n");
+		fprintf(stdout, "\n");
+	}
+
+	return 0;
+}
+
+/* Checks if encryption and subsequent decryption produces the same
+ * data, and that modifications are detected.
+ */
+static int test_encrypt_decrypt(int cfd, int modify)
+{
+	static uint8_t plaintext[DATA_SIZE];
+	static uint8_t data[DATA_SIZE + TAG_SIZE];
+	uint8_t iv[IV_SIZE];
+	uint8_t key[KEY_SIZE];
+	uint8_t auth[AUTH_SIZE];
+	int enc_len, ret;
+
+	struct session_op sess;
+	struct crypt_auth_op cao;
+
+	if (debug) {
+		fprintf(stdout, "Tests on ChaCha20-Poly1305 encryption/decryption%s: ",
+			modify ? " with modified data" : "");
+		fflush(stdout);
+	}
+
+	memset(&sess, 0, sizeof(sess));
+	memset(&cao, 0, sizeof(cao));
+
+	memset(key, 0x33, sizeof(key));
+	memset(iv, 0x03, sizeof(iv));
+	memset(auth, 0xf1, sizeof(auth));
+	memset(plaintext, 0x15, sizeof(plaintext));
+	memcpy(data, plaintext, DATA_SIZE);
+
+	sess.cipher = CRYPTO_CHACHA20_POLY1305;
+	sess.keylen = KEY_SIZE;
+	sess.key = key;
+
+	if (ioctl(cfd, CIOCGSESSION, &sess)) {
+		my_perror("ioctl(CIOCGSESSION)");
+		return 1;
+	}
+
+	cao.ses = sess.ses;
+	cao.auth_src = auth;
+	cao.auth_len = sizeof(auth);
+	cao.len = DATA_SIZE;
+	cao.src = data;
+	cao.dst = data;
+	cao.iv = iv;
+	cao.iv_len = IV_SIZE;
+	cao.op = COP_ENCRYPT;
+
+	if (ioctl(cfd, CIOCAUTHCRYPT, &cao)) {
+		my_perror("ioctl(CIOCAUTHCRYPT)");
+		return 1;
+	}
+
+	enc_len = cao.len;
+
+	if (modify)
+		data[4]++;
+
+	cao.ses = sess.ses;
+	cao.auth_src = auth;
+	cao.auth_len = sizeof(auth);
+	cao.len = enc_len;
+	cao.src = data;
+	cao.dst = data;
+	cao.iv = iv;
+	cao.iv_len = IV_SIZE;
+	cao.op = COP_DECRYPT;
+
+	ret = ioctl(cfd, CIOCAUTHCRYPT, &cao);
+
+	if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		my_perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	if (modify) {
+		if (ret == 0) {
+			fprintf(stderr, "Modification to ciphertext was not detected\n");
+			return 1;
+		}
+	} else {
+		if (ret) {
+			my_perror("ioctl(CIOCAUTHCRYPT)");
+			return 1;
+		}
+
+		if (cao.len != DATA_SIZE ||
+		    memcmp(plaintext, data, DATA_SIZE) != 0) {
+			fprintf(stderr,
+				"FAIL: Decrypted data are different from the input data.\n");
+			return 1;
+		}
+	}
+
+	if (debug) {
+		fprintf(stdout, "ok\n");
+		fprintf(stdout, "\n");
+	}
+
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	int fd = -1, cfd = -1;
+
+	if (argc > 1) debug = 1;
+
+	/* Open the crypto device */
+	fd = open("/dev/crypto", O_RDWR, 0);
+	if (fd < 0) {
+		my_perror("open(/dev/crypto)");
+		return 1;
+	}
+
+	/* Clone file descriptor */
+	if (ioctl(fd, CRIOGET, &cfd)) {
+		my_perror("ioctl(CRIOGET)");
+		return 1;
+	}
+
+	/* Set close-on-exec (not really neede here) */
+	if (fcntl(cfd, F_SETFD, 1) == -1) {
+		my_perror("fcntl(F_SETFD)");
+		return 1;
+	}
+
+	/* Run the test itself */
+
+	if (test_stream(cfd))
+		return 1;
+
+	if (test_crypto(cfd))
+		return 1;
+
+	if (test_encrypt_decrypt(cfd, 0))
+		return 1;
+
+	if (test_encrypt_decrypt(cfd, 1))
+		return 1;
+
+	/* Close cloned descriptor */
+	if (close(cfd)) {
+		my_perror("close(cfd)");
+		return 1;
+	}
+
+	/* Close the original descriptor */
+	if (close(fd)) {
+		my_perror("close(fd)");
+		return 1;
+	}
+
+	return 0;
+}
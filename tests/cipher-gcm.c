@@ -15,6 +15,7 @@
 
 #define	DATA_SIZE	(8*1024)
 #define AUTH_SIZE       31
+#define LARGE_AUTH_SIZE (3*4096 + 31)
 #define	BLOCK_SIZE	16
 #define	KEY_SIZE	16
 
@@ -474,6 +475,349 @@ static int test_encrypt_decrypt_error(int cfd, int err)
 	return 1;
 }
 
+/* Checks that auth data larger than a page are accepted, and that they
+ * are authenticated, when operating in-place.
+ */
+static int test_encrypt_decrypt_large_auth(int cfd)
+{
+	static char data[DATA_SIZE + BLOCK_SIZE];
+	static char plaintext[DATA_SIZE];
+	static char auth[LARGE_AUTH_SIZE];
+	char iv[BLOCK_SIZE];
+	char key[KEY_SIZE];
+	int enc_len;
+
+	struct session_op sess;
+	struct crypt_auth_op cao;
+
+	if (debug) {
+		fprintf(stdout, "Tests on AES-GCM with large auth data: ");
+		fflush(stdout);
+	}
+
+	memset(&sess, 0, sizeof(sess));
+	memset(&cao, 0, sizeof(cao));
+
+	memset(key, 0x33, sizeof(key));
+	memset(iv, 0x03, sizeof(iv));
+	memset(auth, 0xf1, sizeof(auth));
+	memset(plaintext, 0x15, sizeof(plaintext));
+	memcpy(data, plaintext, DATA_SIZE);
+
+	sess.cipher = CRYPTO_AES_GCM;
+	sess.keylen = KEY_SIZE;
+	sess.key = key;
+
+	if (ioctl(cfd, CIOCGSESSION, &sess)) {
+		my_perror("ioctl(CIOCGSESSION)");
+		return 1;
+	}
+
+	cao.ses = sess.ses;
+	cao.auth_src = auth;
+	cao.auth_len = sizeof(auth);
+	cao.len = DATA_SIZE;
+	cao.src = data;
+	cao.dst = data;
+	cao.iv = iv;
+	cao.iv_len = 12;
+	cao.op = COP_ENCRYPT;
+
+	if (ioctl(cfd, CIOCAUTHCRYPT, &cao)) {
+		my_perror("ioctl(CIOCAUTHCRYPT)");
+		return 1;
+	}
+
+	enc_len = cao.len;
+
+	cao.ses = sess.ses;
+	cao.auth_src = auth;
+	cao.auth_len = sizeof(auth);
+	cao.len = enc_len;
+	cao.src = data;
+	cao.dst = data;
+	cao.iv = iv;
+	cao.iv_len = 12;
+	cao.op = COP_DECRYPT;
+
+	if (ioctl(cfd, CIOCAUTHCRYPT, &cao)) {
+		my_perror("ioctl(CIOCAUTHCRYPT)");
+		return 1;
+	}
+
+	if (cao.len != DATA_SIZE || memcmp(plaintext, data, DATA_SIZE) != 0) {
+		fprintf(stderr,
+			"FAIL: Decrypted data are different from the input data.\n");
+		return 1;
+	}
+
+	/* Encrypt again and modify the last page of auth data */
+	cao.len = DATA_SIZE;
+	cao.op = COP_ENCRYPT;
+	if (ioctl(cfd, CIOCAUTHCRYPT, &cao)) {
+		my_perror("ioctl(CIOCAUTHCRYPT)");
+		return 1;
+	}
+
+	auth[sizeof(auth) - 1]++;
+
+	cao.len = enc_len;
+	cao.op = COP_DECRYPT;
+	if (ioctl(cfd, CIOCAUTHCRYPT, &cao) == 0) {
+		fprintf(stderr, "Modification to auth data was not detected\n");
+		return 1;
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		my_perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	if (debug) {
+		fprintf(stdout, "ok\n");
+		fprintf(stdout, "\n");
+	}
+
+	return 0;
+}
+
+#ifdef CIOCIVCOUNTER
+/* Encrypt with kernel-generated IVs and decrypt with the returned ones.
+ */
+static int test_iv_counter(int cfd)
+{
+	static char data[2][DATA_SIZE + BLOCK_SIZE];
+	static char plaintext[DATA_SIZE];
+	char auth[AUTH_SIZE];
+	char iv[2][12];
+	char key[KEY_SIZE];
+	const char salt[4] = { 0xca, 0xfe, 0xba, 0xbe };
+	const char expected_iv[12] = { 0xca, 0xfe, 0xba, 0xbe,
+		0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0xff };
+	int enc_len, i;
+
+	struct session_op sess;
+	struct crypt_auth_op cao;
+	struct iv_counter_op ivop;
+
+	if (debug) {
+		fprintf(stdout, "Tests on AES-GCM with counter IVs: ");
+		fflush(stdout);
+	}
+
+	memset(&sess, 0, sizeof(sess));
+	memset(&cao, 0, sizeof(cao));
+	memset(&ivop, 0, sizeof(ivop));
+
+	memset(key, 0x33, sizeof(key));
+	memset(auth, 0xf1, sizeof(auth));
+	memset(plaintext, 0x15, sizeof(plaintext));
+
+	sess.cipher = CRYPTO_AES_GCM;
+	sess.keylen = KEY_SIZE;
+	sess.key = key;
+
+	if (ioctl(cfd, CIOCGSESSION, &sess)) {
+		my_perror("ioctl(CIOCGSESSION)");
+		return 1;
+	}
+
+	ivop.ses = sess.ses;
+	ivop.salt = (void *)salt;
+	ivop.salt_len = sizeof(salt);
+	ivop.counter = 0x1000000ffULL;
+	if (ioctl(cfd, CIOCIVCOUNTER, &ivop)) {
+		my_perror("ioctl(CIOCIVCOUNTER)");
+		return 1;
+	}
+
+	/* the same plaintext twice must give different IVs and ciphertexts */
+	for (i = 0; i < 2; i++) {
+		memcpy(data[i], plaintext, DATA_SIZE);
+		memset(iv[i], 0, sizeof(iv[i]));
+
+		cao.ses = sess.ses;
+		cao.auth_src = auth;
+		cao.auth_len = sizeof(auth);
+		cao.len = DATA_SIZE;
+		cao.src = data[i];
+		cao.dst = data[i];
+		cao.iv = iv[i];
+		cao.iv_len = 12;
+		cao.op = COP_ENCRYPT;
+
+		if (ioctl(cfd, CIOCAUTHCRYPT, &cao)) {
+			my_perror("ioctl(CIOCAUTHCRYPT)");
+			return 1;
+		}
+	}
+	enc_len = cao.len;
+
+	if (memcmp(iv[0], expected_iv, sizeof(expected_iv)) != 0 ||
+	    memcmp(iv[1], expected_iv, 10) != 0 ||
+	    iv[1][10] != 0x01 || iv[1][11] != 0x00) {
+		fprintf(stderr, "FAIL: Unexpected IVs generated.\n");
+		print_buf("IV 1: ", (void *)iv[0], 12);
+		print_buf("IV 2: ", (void *)iv[1], 12);
+		return 1;
+	}
+
+	if (memcmp(data[0], data[1], enc_len) == 0) {
+		fprintf(stderr, "FAIL: IV reuse.\n");
+		return 1;
+	}
+
+	for (i = 0; i < 2; i++) {
+		cao.ses = sess.ses;
+		cao.auth_src = auth;
+		cao.auth_len = sizeof(auth);
+		cao.len = enc_len;
+		cao.src = data[i];
+		cao.dst = data[i];
+		cao.iv = iv[i];
+		cao.iv_len = 12;
+		cao.op = COP_DECRYPT;
+
+		if (ioctl(cfd, CIOCAUTHCRYPT, &cao)) {
+			my_perror("ioctl(CIOCAUTHCRYPT)");
+			return 1;
+		}
+
+		if (cao.len != DATA_SIZE || memcmp(plaintext, data[i], DATA_SIZE) != 0) {
+			fprintf(stderr,
+				"FAIL: Decrypted data are different from the input data.\n");
+			return 1;
+		}
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		my_perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	if (debug) {
+		fprintf(stdout, "ok\n");
+		fprintf(stdout, "\n");
+	}
+
+	return 0;
+}
+
+/* The salt of a CTR session must leave 32 bits to the block counter */
+static int test_iv_counter_salt(int cfd)
+{
+	static const uint32_t salt_lens[] = { 8, 5, 0xfffffff8 };
+	char key[KEY_SIZE], salt[16];
+	struct session_op sess;
+	struct iv_counter_op ivop;
+	int i;
+
+	memset(&sess, 0, sizeof(sess));
+	memset(&ivop, 0, sizeof(ivop));
+	memset(key, 0x33, sizeof(key));
+	memset(salt, 0xca, sizeof(salt));
+
+	sess.cipher = CRYPTO_AES_CTR;
+	sess.keylen = KEY_SIZE;
+	sess.key = key;
+	if (ioctl(cfd, CIOCGSESSION, &sess)) {
+		my_perror("ioctl(CIOCGSESSION)");
+		return 1;
+	}
+
+	ivop.ses = sess.ses;
+	ivop.salt = (void *)salt;
+	for (i = 0; i < sizeof(salt_lens) / sizeof(salt_lens[0]); i++) {
+		ivop.salt_len = salt_lens[i];
+		if (ioctl(cfd, CIOCIVCOUNTER, &ivop) == 0) {
+			fprintf(stderr, "FAIL: CTR salt of %u bytes accepted.\n",
+				salt_lens[i]);
+			return 1;
+		}
+	}
+
+	ivop.salt_len = 4;
+	if (ioctl(cfd, CIOCIVCOUNTER, &ivop)) {
+		my_perror("ioctl(CIOCIVCOUNTER)");
+		return 1;
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		my_perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	return 0;
+}
+#endif
+
+/* GMAC: the data are only authenticated, with len 0 the tag is the output
+ */
+static int test_gmac(int cfd)
+{
+	const uint8_t expected_tag[16] =
+		"\x8e\x57\x26\x32\xcd\x8c\xdc\x37\xff\xba\x44\xb1\xd0\x38\x13\x8a";
+	uint8_t key[16], iv[12], data[40], tag[16];
+	struct session_op sess;
+	struct crypt_auth_op cao;
+	int i;
+
+	if (debug) {
+		fprintf(stdout, "Tests on AES-GMAC: ");
+		fflush(stdout);
+	}
+
+	for (i = 0; i < sizeof(key); i++)
+		key[i] = i;
+	for (i = 0; i < sizeof(iv); i++)
+		iv[i] = 0xa0 + i;
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = i * 3;
+
+	memset(&sess, 0, sizeof(sess));
+	sess.cipher = CRYPTO_AES_GMAC;
+	sess.keylen = sizeof(key);
+	sess.key = key;
+	if (ioctl(cfd, CIOCGSESSION, &sess)) {
+		my_perror("ioctl(CIOCGSESSION)");
+		return 1;
+	}
+
+	memset(&cao, 0, sizeof(cao));
+	cao.ses = sess.ses;
+	cao.auth_src = data;
+	cao.auth_len = sizeof(data);
+	cao.len = 0;
+	cao.dst = tag;
+	cao.iv = iv;
+	cao.iv_len = sizeof(iv);
+	cao.op = COP_ENCRYPT;
+	if (ioctl(cfd, CIOCAUTHCRYPT, &cao)) {
+		my_perror("ioctl(CIOCAUTHCRYPT)");
+		return 1;
+	}
+
+	if (cao.len != sizeof(tag) ||
+	    memcmp(tag, expected_tag, sizeof(tag)) != 0) {
+		fprintf(stderr, "FAIL: GMAC tag mismatch.\n");
+		print_buf("Tag     : ", tag, sizeof(tag));
+		print_buf("Expected: ", expected_tag, sizeof(tag));
+		return 1;
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		my_perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	if (debug) {
+		fprintf(stdout, "ok\n");
+		fprintf(stdout, "\n");
+	}
+
+	return 0;
+}
+
 int main(int argc, char** argv)
 {
 	int fd = -1, cfd = -1;
@@ -513,6 +857,20 @@ int main(int argc, char** argv)
 	if (test_encrypt_decrypt_error(cfd, 1))
 		return 1;
 
+	if (test_encrypt_decrypt_large_auth(cfd))
+		return 1;
+
+#ifdef CIOCIVCOUNTER
+	if (test_iv_counter(cfd))
+		return 1;
+
+	if (test_iv_counter_salt(cfd))
+		return 1;
+#endif
+
+	if (test_gmac(cfd))
+		return 1;
+
 	/* Close cloned descriptor */
 	if (close(cfd)) {
 		my_perror("close(cfd)");
@@ -0,0 +1,248 @@
+/*
+ * Demo on how to use /dev/crypto device for AES-XTS storage encryption,
+ * one sector at a time and many sectors at once.
+ *
+ * Placed under public domain.
+ *
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/ioctl.h>
+#include <crypto/cryptodev.h>
+
+#define	KEY_SIZE	32
+#define	IV_SIZE		16
+#define	SECTOR_SIZE	512
+#define	SECTORS		37
+#define	FIRST_SECTOR	5
+
+#define my_perror(x) {fprintf(stderr, "%s: %d\n", __func__, __LINE__); perror(x); }
+
+static int debug = 0;
+
+static void print_buf(char *desc, const unsigned char *buf, int size)
+{
+	int i;
+	fputs(desc, stdout);
+	for (i = 0; i < size; i++) {
+		printf("%.2x", (uint8_t) buf[i]);
+	}
+	fputs("\n", stdout);
+}
+
+/* key 00..1f, sector 5, plaintext 20..3f */
+static const uint8_t xts_ciphertext[] =
+	"\xa0\x7b\xd2\xcb\x3a\x2b\xa1\x47\x82\x48\xf3\x21\x9a\xc8\xcc\xdd"
+	"\xfc\x78\x88\x86\xb1\xb1\xca\xb1\xc3\xec\x34\x0e\x77\x77\xe6\x6f";
+
+static int open_session(int cfd, struct session_op *sess, uint8_t *key)
+{
+	memset(sess, 0, sizeof(*sess));
+	sess->cipher = CRYPTO_AES_XTS;
+	sess->keylen = KEY_SIZE;
+	sess->key = key;
+	if (ioctl(cfd, CIOCGSESSION, sess)) {
+		my_perror("ioctl(CIOCGSESSION)");
+		return -1;
+	}
+	return 0;
+}
+
+static void sector_iv(uint8_t *iv, uint64_t sector)
+{
+	int i;
+
+	memset(iv, 0, IV_SIZE);
+	for (i = 0; i < 8; i++)
+		iv[i] = sector >> (8 * i);
+}
+
+/* Test a single sector with CIOCCRYPT against a known answer.
+ */
+static int test_sector(int cfd)
+{
+	uint8_t key[KEY_SIZE], iv[IV_SIZE];
+	uint8_t plaintext[32], ciphertext[32];
+	struct session_op sess;
+	struct crypt_op cryp;
+	int i;
+
+	for (i = 0; i < KEY_SIZE; i++)
+		key[i] = i;
+	for (i = 0; i < sizeof(plaintext); i++)
+		plaintext[i] = 0x20 + i;
+	sector_iv(iv, FIRST_SECTOR);
+
+	if (open_session(cfd, &sess, key))
+		return 1;
+
+	memset(&cryp, 0, sizeof(cryp));
+	cryp.ses = sess.ses;
+	cryp.len = sizeof(plaintext);
+	cryp.src = plaintext;
+	cryp.dst = ciphertext;
+	cryp.iv = iv;
+	cryp.op = COP_ENCRYPT;
+	if (ioctl(cfd, CIOCCRYPT, &cryp)) {
+		my_perror("ioctl(CIOCCRYPT)");
+		return 1;
+	}
+
+	if (memcmp(ciphertext, xts_ciphertext, sizeof(ciphertext)) != 0) {
+		printf("Test failed: ciphertext mismatch\n");
+		print_buf("Ciphertext: ", ciphertext, sizeof(ciphertext));
+		print_buf("Expected  : ", xts_ciphertext, sizeof(ciphertext));
+		return 1;
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		my_perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	printf("Test passed\n");
+	return 0;
+}
+
+/* Encrypt many sectors with one CIOCCRYPTDU, compare against one
+ * CIOCCRYPT per sector and decrypt them back in place.
+ */
+static int test_data_units(int cfd)
+{
+	static uint8_t plaintext[SECTORS * SECTOR_SIZE];
+	static uint8_t ciphertext[SECTORS * SECTOR_SIZE];
+	static uint8_t expected[SECTORS * SECTOR_SIZE];
+	uint8_t key[KEY_SIZE], iv[IV_SIZE];
+	struct session_op sess;
+	struct crypt_op cryp;
+	struct crypt_du_op du;
+	int i;
+
+	for (i = 0; i < KEY_SIZE; i++)
+		key[i] = 0xc0 ^ i;
+	for (i = 0; i < sizeof(plaintext); i++)
+		plaintext[i] = i * 7;
+
+	if (open_session(cfd, &sess, key))
+		return 1;
+
+	for (i = 0; i < SECTORS; i++) {
+		sector_iv(iv, FIRST_SECTOR + i);
+
+		memset(&cryp, 0, sizeof(cryp));
+		cryp.ses = sess.ses;
+		cryp.len = SECTOR_SIZE;
+		cryp.src = plaintext + i * SECTOR_SIZE;
+		cryp.dst = expected + i * SECTOR_SIZE;
+		cryp.iv = iv;
+		cryp.op = COP_ENCRYPT;
+		if (ioctl(cfd, CIOCCRYPT, &cryp)) {
+			my_perror("ioctl(CIOCCRYPT)");
+			return 1;
+		}
+	}
+
+	memset(&du, 0, sizeof(du));
+	du.ses = sess.ses;
+	du.op = COP_ENCRYPT;
+	du.len = sizeof(plaintext);
+	du.du_size = SECTOR_SIZE;
+	du.du_index = FIRST_SECTOR;
+	du.src = plaintext;
+	du.dst = ciphertext;
+	if (ioctl(cfd, CIOCCRYPTDU, &du)) {
+		my_perror("ioctl(CIOCCRYPTDU)");
+		return 1;
+	}
+
+	for (i = 0; i < SECTORS; i++) {
+		if (memcmp(ciphertext + i * SECTOR_SIZE,
+			   expected + i * SECTOR_SIZE, SECTOR_SIZE) != 0) {
+			printf("Test failed: sector %d mismatch\n", FIRST_SECTOR + i);
+			if (debug) {
+				print_buf("Ciphertext: ", ciphertext + i * SECTOR_SIZE, 32);
+				print_buf("Expected  : ", expected + i * SECTOR_SIZE, 32);
+			}
+			return 1;
+		}
+	}
+
+	du.op = COP_DECRYPT;
+	du.src = du.dst = ciphertext;
+	if (ioctl(cfd, CIOCCRYPTDU, &du)) {
+		my_perror("ioctl(CIOCCRYPTDU)");
+		return 1;
+	}
+
+	if (memcmp(ciphertext, plaintext, sizeof(plaintext)) != 0) {
+		printf("Test failed: decrypted data mismatch\n");
+		return 1;
+	}
+
+	/* a partial sector is refused */
+	du.len = SECTOR_SIZE + 16;
+	if (ioctl(cfd, CIOCCRYPTDU, &du) == 0) {
+		printf("Test failed: partial data unit accepted\n");
+		return 1;
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		my_perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	printf("Test passed\n");
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int fd = -1, cfd = -1;
+
+	if (argc > 1)
+		debug = 1;
+
+	/* Open the crypto device */
+	fd = open("/dev/crypto", O_RDWR, 0);
+	if (fd < 0) {
+		perror("open(/dev/crypto)");
+		return 1;
+	}
+
+	/* Clone file descriptor */
+	if (ioctl(fd, CRIOGET, &cfd)) {
+		perror("ioctl(CRIOGET)");
+		return 1;
+	}
+
+	/* Set close-on-exec (not really neede here) */
+	if (fcntl(cfd, F_SETFD, 1) == -1) {
+		perror("fcntl(F_SETFD)");
+		return 1;
+	}
+
+	/* Run the test itself */
+	if (test_sector(cfd))
+		return 1;
+
+	if (test_data_units(cfd))
+		return 1;
+
+	/* Close cloned descriptor */
+	if (close(cfd)) {
+		perror("close(cfd)");
+		return 1;
+	}
+
+	/* Close the original descriptor */
+	if (close(fd)) {
+		perror("close(fd)");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,150 @@
+/*
+ * Demo on how to use /dev/crypto device for compression.
+ *
+ * Placed under public domain.
+ *
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/ioctl.h>
+#include <crypto/cryptodev.h>
+
+#define	DATA_SIZE	(64*1024)
+
+#define my_perror(x) {fprintf(stderr, "%s: %d\n", __func__, __LINE__); perror(x); }
+
+static int debug = 0;
+
+static int test_deflate(int cfd)
+{
+	static uint8_t plaintext[DATA_SIZE];
+	static uint8_t compressed[DATA_SIZE];
+	static uint8_t decompressed[DATA_SIZE];
+	struct session_op sess;
+	struct session_info_op siop;
+	struct compress_op zop;
+	uint32_t compressed_len;
+	int i;
+
+	/* something compressible */
+	for (i = 0; i < DATA_SIZE; i++)
+		plaintext[i] = "cryptodev compression "[i % 22] + (i / 4096);
+
+	memset(&sess, 0, sizeof(sess));
+	sess.cipher = CRYPTO_DEFLATE_COMP;
+	if (ioctl(cfd, CIOCGSESSION, &sess)) {
+		my_perror("ioctl(CIOCGSESSION)");
+		return 1;
+	}
+
+	siop.ses = sess.ses;
+	if (ioctl(cfd, CIOCGSESSINFO, &siop)) {
+		my_perror("ioctl(CIOCGSESSINFO)");
+		return 1;
+	}
+	if (debug)
+		printf("requested deflate, got %s with driver %s\n",
+		       siop.cipher_info.cra_name, siop.cipher_info.cra_driver_name);
+
+	memset(&zop, 0, sizeof(zop));
+	zop.ses = sess.ses;
+	zop.op = COP_COMPRESS;
+	zop.src = plaintext;
+	zop.src_len = sizeof(plaintext);
+	zop.dst = compressed;
+	zop.dst_len = sizeof(compressed);
+	if (ioctl(cfd, CIOCCOMPRESS, &zop)) {
+		my_perror("ioctl(CIOCCOMPRESS)");
+		return 1;
+	}
+	compressed_len = zop.dst_len;
+
+	if (compressed_len == 0 || compressed_len >= DATA_SIZE / 4) {
+		fprintf(stderr, "FAIL: compressed %d bytes into %u\n",
+			DATA_SIZE, compressed_len);
+		return 1;
+	}
+
+	memset(&zop, 0, sizeof(zop));
+	zop.ses = sess.ses;
+	zop.op = COP_DECOMPRESS;
+	zop.src = compressed;
+	zop.src_len = compressed_len;
+	zop.dst = decompressed;
+	zop.dst_len = sizeof(decompressed);
+	if (ioctl(cfd, CIOCCOMPRESS, &zop)) {
+		my_perror("ioctl(CIOCCOMPRESS)");
+		return 1;
+	}
+
+	if (zop.dst_len != DATA_SIZE ||
+	    memcmp(plaintext, decompressed, DATA_SIZE) != 0) {
+		fprintf(stderr, "FAIL: decompressed data differ from the input\n");
+		return 1;
+	}
+
+	/* output that does not fit must be refused */
+	zop.dst_len = DATA_SIZE / 2;
+	if (ioctl(cfd, CIOCCOMPRESS, &zop) == 0) {
+		fprintf(stderr, "FAIL: output larger than dst was accepted\n");
+		return 1;
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		my_perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	printf("Test passed (%d bytes compressed to %u)\n", DATA_SIZE,
+	       compressed_len);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int fd = -1, cfd = -1;
+
+	if (argc > 1)
+		debug = 1;
+
+	/* Open the crypto device */
+	fd = open("/dev/crypto", O_RDWR, 0);
+	if (fd < 0) {
+		perror("open(/dev/crypto)");
+		return 1;
+	}
+
+	/* Clone file descriptor */
+	if (ioctl(fd, CRIOGET, &cfd)) {
+		perror("ioctl(CRIOGET)");
+		return 1;
+	}
+
+	/* Set close-on-exec (not really neede here) */
+	if (fcntl(cfd, F_SETFD, 1) == -1) {
+		perror("fcntl(F_SETFD)");
+		return 1;
+	}
+
+	/* Run the test itself */
+	if (test_deflate(cfd))
+		return 1;
+
+	/* Close cloned descriptor */
+	if (close(cfd)) {
+		perror("close(cfd)");
+		return 1;
+	}
+
+	/* Close the original descriptor */
+	if (close(fd)) {
+		perror("close(fd)");
+		return 1;
+	}
+
+	return 0;
+}
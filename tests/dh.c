@@ -0,0 +1,320 @@
+/*
+ * Demo on how to use /dev/crypto device for Diffie-Hellman and ECDH key
+ * agreement with CIOCKEY, alone and batched with CIOCKEYBATCH.
+ *
+ * Placed under public domain.
+ *
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/ioctl.h>
+#include <crypto/cryptodev.h>
+
+#define	DH_SIZE		256
+#define	DH_PRIV_SIZE	32
+#define	EC_SIZE		32
+#define	BATCH_SIZE	8
+
+#define my_perror(x) {fprintf(stderr, "%s: %d\n", __func__, __LINE__); perror(x); }
+
+static int debug = 0;
+
+static void print_buf(char *desc, const unsigned char *buf, int size)
+{
+	int i;
+	fputs(desc, stdout);
+	for (i = 0; i < size; i++) {
+		printf("%.2x", (uint8_t) buf[i]);
+	}
+	fputs("\n", stdout);
+}
+
+/* big endian; the 2048-bit MODP group of RFC 3526 with generator 2 */
+static const uint8_t dh_prime[] =
+	"\xff\xff\xff\xff\xff\xff\xff\xff\xc9\x0f\xda\xa2\x21\x68\xc2\x34"
+	"\xc4\xc6\x62\x8b\x80\xdc\x1c\xd1\x29\x02\x4e\x08\x8a\x67\xcc\x74"
+	"\x02\x0b\xbe\xa6\x3b\x13\x9b\x22\x51\x4a\x08\x79\x8e\x34\x04\xdd"
+	"\xef\x95\x19\xb3\xcd\x3a\x43\x1b\x30\x2b\x0a\x6d\xf2\x5f\x14\x37"
+	"\x4f\xe1\x35\x6d\x6d\x51\xc2\x45\xe4\x85\xb5\x76\x62\x5e\x7e\xc6"
+	"\xf4\x4c\x42\xe9\xa6\x37\xed\x6b\x0b\xff\x5c\xb6\xf4\x06\xb7\xed"
+	"\xee\x38\x6b\xfb\x5a\x89\x9f\xa5\xae\x9f\x24\x11\x7c\x4b\x1f\xe6"
+	"\x49\x28\x66\x51\xec\xe4\x5b\x3d\xc2\x00\x7c\xb8\xa1\x63\xbf\x05"
+	"\x98\xda\x48\x36\x1c\x55\xd3\x9a\x69\x16\x3f\xa8\xfd\x24\xcf\x5f"
+	"\x83\x65\x5d\x23\xdc\xa3\xad\x96\x1c\x62\xf3\x56\x20\x85\x52\xbb"
+	"\x9e\xd5\x29\x07\x70\x96\x96\x6d\x67\x0c\x35\x4e\x4a\xbc\x98\x04"
+	"\xf1\x74\x6c\x08\xca\x18\x21\x7c\x32\x90\x5e\x46\x2e\x36\xce\x3b"
+	"\xe3\x9e\x77\x2c\x18\x0e\x86\x03\x9b\x27\x83\xa2\xec\x07\xa2\x8f"
+	"\xb5\xc5\x5d\xf0\x6f\x4c\x52\xc9\xde\x2b\xcb\xf6\x95\x58\x17\x18"
+	"\x39\x95\x49\x7c\xea\x95\x6a\xe5\x15\xd2\x26\x18\x98\xfa\x05\x10"
+	"\x15\x72\x8e\x5a\x8a\xac\xaa\x68\xff\xff\xff\xff\xff\xff\xff\xff";
+
+static const uint8_t dh_priv[] =
+	"\xbf\x2e\xb1\x10\xd7\x88\x10\x03\xaa\x59\xce\x1e\x9e\x29\x36\x41"
+	"\xef\x70\xb4\xc0\x17\x73\x44\xa3\x9b\x95\xf2\x39\xae\x97\xd9\xdb";
+static const uint8_t dh_peer[] =
+	"\xa3\xae\x1b\x27\x53\x84\x40\xf1\x4d\x00\xf5\x30\x2f\xde\x29\x58"
+	"\xdf\xa5\xd8\x6f\xfd\xb1\x64\x3b\xa3\xf8\xba\x68\x32\xee\x4f\x47"
+	"\x43\xf5\x2b\x1f\x54\xf9\x5c\x80\xa1\xf1\xc7\x05\x09\xa4\xe6\x1a"
+	"\xf0\x70\x98\xe7\x58\x7d\xa3\x9d\xc4\x26\x1e\xdb\x30\x73\x91\x71"
+	"\x6c\xdb\x1d\x25\x40\xd1\x9f\x81\xb2\xd3\x4a\x3a\x21\xe0\xd9\x8f"
+	"\xbf\x5f\x49\xec\x4d\x5c\x6e\xe5\x3b\x2a\x14\x68\x6b\xf4\x94\x8a"
+	"\x25\x59\xb7\xb8\x03\xf0\x55\x47\xe5\x21\x81\xc8\x85\xcc\xd1\x8a"
+	"\x06\x02\xfa\x27\x99\x93\xc5\x40\x95\xa2\x04\x65\x4e\xd0\xf6\x56"
+	"\xc1\x38\x45\xa9\xb6\x53\xe6\x14\xbc\x6b\xe7\xd1\xf3\x39\xea\x2e"
+	"\x79\x0a\x76\xdf\x49\x92\xb6\x7f\x8f\x88\xef\xa0\x78\x63\x5d\xd3"
+	"\xdf\x37\x13\x34\x4d\x26\xbf\x07\x17\x94\x14\xc1\x7f\xb2\x7b\x67"
+	"\x54\xeb\x12\x2e\xed\xb3\xf2\x22\x95\xc5\x44\x9a\xd4\xfe\xc0\x9a"
+	"\x29\x09\x28\x6b\x6b\x22\xd8\x01\xd6\x71\x70\x6e\x3d\x72\x7f\x98"
+	"\xdd\x60\x77\x28\x7a\x7f\xe1\x9a\xd6\xd5\x5d\x42\x5f\xf2\x5d\x55"
+	"\xfa\x3d\xf5\x4e\x6f\x7f\x1c\xe2\x8c\xd3\x0e\x6a\x2e\x3b\x45\x4d"
+	"\xae\xeb\x72\x9b\x1c\xfe\x78\xab\x04\x46\x69\x82\x15\x14\x77\x82";
+static const uint8_t dh_shared[] =
+	"\x39\x5d\x6b\x2c\x77\xcd\xee\x24\x29\xcb\x73\x2a\x75\x97\xa7\x47"
+	"\x4a\xdf\xc2\x06\xcb\x26\xb8\xc0\x24\xfc\xc5\x9d\x87\x6b\xa1\x04"
+	"\xdd\xef\x5a\x9b\x6f\xd2\x10\x7b\x8f\xf6\x76\x0b\x59\xe5\x92\xde"
+	"\x6c\x36\xa9\x03\x9f\x49\x9f\x29\xb3\x06\xc4\xee\xf4\xe2\x51\xb0"
+	"\x88\xab\xa1\xa1\x03\x78\xac\x85\xf4\xbf\x27\xbc\xee\x21\xad\x7a"
+	"\xe9\x3d\x27\xba\xfc\xf8\x0f\x47\xe5\xbe\xb4\xf5\x04\xbf\x8c\x94"
+	"\x6f\xad\x91\x91\xb4\xcd\xdb\x32\xfe\x64\xe8\x97\x83\x16\x89\x4b"
+	"\xa9\x7c\xef\x9d\x8e\x1a\x72\x26\xa3\x0d\x6e\xbc\xa7\xa7\xfa\x95"
+	"\x43\x06\x04\xc0\x06\x39\xca\x6e\xdf\x73\xdb\x9f\x32\xd9\xea\x3e"
+	"\x36\xa7\x6e\xa1\x36\xf5\x80\x70\x04\x4c\x38\x24\x4b\xc6\x9b\x0a"
+	"\x12\xb0\xc1\xed\xb3\x0b\xec\x15\x94\xb1\xa4\xab\x1d\xe6\x9f\xd5"
+	"\xca\xe6\x51\x5d\xe8\x5b\x35\xe8\x4d\x98\x08\x93\x41\xca\xf2\xa4"
+	"\xfe\x43\xdb\xff\x64\x8b\xd6\x45\x05\x1a\x0a\xaa\x3c\x14\xef\x70"
+	"\xff\xcf\x96\xfa\x07\x8e\x28\x00\x83\x3f\x7f\x74\x23\xfd\x7d\x22"
+	"\xb2\xc2\x91\xcf\xcb\x61\x29\x7d\x0e\x41\xac\xcb\xc8\xda\xe8\xc3"
+	"\x79\xd5\xdc\x54\x1e\x4d\x8f\x21\xde\x96\x3e\x24\x3d\xf4\x8a\x8e";
+
+/* big endian; NIST P-256, the peer public key is x || y */
+static const uint8_t ecdh_priv[] =
+	"\xcb\xa8\x59\xa0\x99\xc5\x66\xc6\x74\xf4\x79\x96\xae\xd5\xce\x80"
+	"\xfb\x85\xa8\x9c\x1b\x9c\x7e\xc8\xca\x03\x2f\xa5\x87\x2c\x3a\x66";
+static const uint8_t ecdh_peer[] =
+	"\xbf\xe9\x5a\x74\xa7\x95\x89\x3c\x89\x5c\x61\x62\xf3\xfd\xe4\x7d"
+	"\x08\x9f\xba\xfc\x42\xfc\x16\xfc\xb6\x97\xf4\x3e\xb4\x30\x07\x7a"
+	"\xe5\x31\x2c\x8b\xe1\xda\xe8\xf2\x8d\xd3\x97\xf8\x15\x43\xc9\x7e"
+	"\x1a\x7f\x0f\xc2\x92\xb1\x29\x4f\xb2\x28\x2c\x72\x6e\x50\xc3\x06";
+static const uint8_t ecdh_shared[] =
+	"\x73\x97\x5b\x81\x0b\xd4\x37\x60\xa4\x8f\x79\x2e\x19\x68\x9f\xfb"
+	"\x36\x4c\xdf\xfc\xb4\xa8\x67\xe3\xc4\xd2\x78\x60\x72\x29\x8f\x0c";
+
+/* CIOCKEY numbers are little endian */
+static void to_le(uint8_t *dst, const uint8_t *src, int size)
+{
+	int i;
+
+	for (i = 0; i < size; i++)
+		dst[i] = src[size - 1 - i];
+}
+
+static void set_param(struct crypt_kop *kop, int i, uint8_t *p, int size)
+{
+	kop->crk_param[i].crp_p = p;
+	kop->crk_param[i].crp_nbits = size * 8;
+}
+
+struct dh_params {
+	uint8_t priv[DH_PRIV_SIZE];
+	uint8_t peer[DH_SIZE];
+	uint8_t prime[DH_SIZE];
+	uint8_t shared[DH_SIZE];
+};
+
+static void setup_dh(struct crypt_kop *kop, struct dh_params *p)
+{
+	to_le(p->priv, dh_priv, DH_PRIV_SIZE);
+	to_le(p->peer, dh_peer, DH_SIZE);
+	to_le(p->prime, dh_prime, DH_SIZE);
+	memset(p->shared, 0, DH_SIZE);
+
+	memset(kop, 0, sizeof(*kop));
+	kop->crk_op = CRK_DH_COMPUTE_KEY;
+	kop->crk_iparams = 3;
+	kop->crk_oparams = 1;
+	set_param(kop, 0, p->priv, DH_PRIV_SIZE);
+	set_param(kop, 1, p->peer, DH_SIZE);
+	set_param(kop, 2, p->prime, DH_SIZE);
+	set_param(kop, 3, p->shared, DH_SIZE);
+}
+
+static int check_result(const uint8_t *le_result, const uint8_t *expected,
+			int size)
+{
+	uint8_t result[DH_SIZE];
+
+	to_le(result, le_result, size);
+	if (memcmp(result, expected, size) != 0) {
+		printf("Test failed: shared secret mismatch\n");
+		if (debug) {
+			print_buf("Result  : ", result, size);
+			print_buf("Expected: ", expected, size);
+		}
+		return 1;
+	}
+	return 0;
+}
+
+static int test_dh(int cfd)
+{
+	struct dh_params p;
+	struct crypt_kop kop;
+
+	setup_dh(&kop, &p);
+	if (ioctl(cfd, CIOCKEY, &kop)) {
+		my_perror("ioctl(CIOCKEY)");
+		return 1;
+	}
+
+	if (kop.crk_status != 0 ||
+	    check_result(p.shared, dh_shared, DH_SIZE))
+		return 1;
+
+	printf("Test passed\n");
+	return 0;
+}
+
+static int test_ecdh(int cfd)
+{
+	uint8_t priv[EC_SIZE], peer[2 * EC_SIZE], shared[EC_SIZE];
+	struct crypt_kop kop;
+
+	to_le(priv, ecdh_priv, EC_SIZE);
+	to_le(peer, ecdh_peer, 2 * EC_SIZE);
+	memset(shared, 0, EC_SIZE);
+
+	memset(&kop, 0, sizeof(kop));
+	kop.crk_op = CRK_ECDH_COMPUTE_KEY;
+	kop.crk_iparams = 2;
+	kop.crk_oparams = 1;
+	set_param(&kop, 0, priv, EC_SIZE);
+	set_param(&kop, 1, peer, 2 * EC_SIZE);
+	set_param(&kop, 2, shared, EC_SIZE);
+	if (ioctl(cfd, CIOCKEY, &kop)) {
+		my_perror("ioctl(CIOCKEY)");
+		return 1;
+	}
+
+	if (kop.crk_status != 0 || check_result(shared, ecdh_shared, EC_SIZE))
+		return 1;
+
+	/* a point that is not on the curve is refused */
+	peer[0] ^= 1;
+	if (ioctl(cfd, CIOCKEY, &kop) == 0 && kop.crk_status == 0) {
+		printf("Test failed: invalid public key accepted\n");
+		return 1;
+	}
+
+	printf("Test passed\n");
+	return 0;
+}
+
+/* The same agreement several times in one CIOCKEYBATCH; a broken request
+ * in the middle must only fail on its own.
+ */
+static int test_dh_batch(int cfd)
+{
+	static struct dh_params p[BATCH_SIZE];
+	struct crypt_kop kops[BATCH_SIZE];
+	struct crypt_kop_batch batch;
+	int i;
+
+	for (i = 0; i < BATCH_SIZE; i++)
+		setup_dh(&kops[i], &p[i]);
+	kops[BATCH_SIZE / 2].crk_iparams = 2;
+
+	batch.count = BATCH_SIZE;
+	batch.kops = kops;
+	if (ioctl(cfd, CIOCKEYBATCH, &batch)) {
+		my_perror("ioctl(CIOCKEYBATCH)");
+		return 1;
+	}
+
+	for (i = 0; i < BATCH_SIZE; i++) {
+		if (i == BATCH_SIZE / 2) {
+			if (kops[i].crk_status == 0) {
+				printf("Test failed: invalid request accepted\n");
+				return 1;
+			}
+			continue;
+		}
+
+		if (kops[i].crk_status != 0) {
+			printf("Test failed: request %d status %d\n", i,
+			       kops[i].crk_status);
+			return 1;
+		}
+		if (check_result(p[i].shared, dh_shared, DH_SIZE))
+			return 1;
+	}
+
+	printf("Test passed\n");
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int fd = -1, cfd = -1;
+	uint32_t features;
+
+	if (argc > 1)
+		debug = 1;
+
+	/* Open the crypto device */
+	fd = open("/dev/crypto", O_RDWR, 0);
+	if (fd < 0) {
+		perror("open(/dev/crypto)");
+		return 1;
+	}
+
+	/* Clone file descriptor */
+	if (ioctl(fd, CRIOGET, &cfd)) {
+		perror("ioctl(CRIOGET)");
+		return 1;
+	}
+
+	/* Set close-on-exec (not really neede here) */
+	if (fcntl(cfd, F_SETFD, 1) == -1) {
+		perror("fcntl(F_SETFD)");
+		return 1;
+	}
+
+	if (ioctl(cfd, CIOCASYMFEAT, &features)) {
+		perror("ioctl(CIOCASYMFEAT)");
+		return 1;
+	}
+
+	/* Run the test itself */
+	if (!(features & CRF_DH_COMPUTE_KEY)) {
+		printf("Diffie-Hellman is not supported\n");
+	} else {
+		if (test_dh(cfd))
+			return 1;
+		if (test_dh_batch(cfd))
+			return 1;
+	}
+
+	if (!(features & CRF_ECDH_COMPUTE_KEY)) {
+		printf("ECDH is not supported\n");
+	} else if (test_ecdh(cfd)) {
+		return 1;
+	}
+
+	/* Close cloned descriptor */
+	if (close(cfd)) {
+		perror("close(cfd)");
+		return 1;
+	}
+
+	/* Close the original descriptor */
+	if (close(fd)) {
+		perror("close(fd)");
+		return 1;
+	}
+
+	return 0;
+}
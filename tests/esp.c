@@ -0,0 +1,300 @@
+/*
+ * Demo on how to use /dev/crypto device for IPsec ESP packets, with the
+ * sequence numbers, padding and anti-replay checks handled by the kernel.
+ *
+ * Placed under public domain.
+ *
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/ioctl.h>
+#include <crypto/cryptodev.h>
+
+#define	KEY_SIZE	16
+#define	SALT_SIZE	4
+#define	HEADER_SIZE	8
+#define	DATA_SIZE	37
+#define	SPI		0x01020304
+#define	NEXT_HEADER	4	/* IPv4 */
+
+#define my_perror(x) {fprintf(stderr, "%s: %d\n", __func__, __LINE__); perror(x); }
+
+static int debug = 0;
+
+static void print_buf(char *desc, const unsigned char *buf, int size)
+{
+	int i;
+	fputs(desc, stdout);
+	for (i = 0; i < size; i++) {
+		printf("%.2x", (uint8_t) buf[i]);
+	}
+	fputs("\n", stdout);
+}
+
+/* key 10..1f, salt 80..83, "abc..." with sequence number 1 */
+static const uint8_t esp_gcm_packet[] =
+	"\x01\x02\x03\x04\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00\x01"
+	"\x86\x1f\xf1\x59\xe8\xae\xf3\x64\xe1\xd2\xdd\x67\xed\x6a\x90\x8a"
+	"\x33\x84\x50\xad\x2f\xc6\x63\x77\x48\x80\x02\x47\xfd\xe1\xec\x8f"
+	"\x88\x29\xf3\x04\x89\x98\x3d\xca\x30\x11\x1f\x88\x4c\xf1\x9b\x01"
+	"\xf7\x57\x20\x94\x9a\x76\x35\x9a";
+
+static int open_sa(int cfd, struct session_op *sess, int gcm, uint32_t window)
+{
+	struct esp_sa_op esop;
+	uint8_t key[KEY_SIZE], mackey[32], salt[SALT_SIZE];
+	int i;
+
+	for (i = 0; i < KEY_SIZE; i++)
+		key[i] = 0x10 + i;
+	for (i = 0; i < sizeof(mackey); i++)
+		mackey[i] = 0x40 + i;
+	for (i = 0; i < SALT_SIZE; i++)
+		salt[i] = 0x80 + i;
+
+	memset(sess, 0, sizeof(*sess));
+	sess->keylen = KEY_SIZE;
+	sess->key = key;
+	if (gcm) {
+		sess->cipher = CRYPTO_AES_GCM;
+	} else {
+		sess->cipher = CRYPTO_AES_CBC;
+		sess->mac = CRYPTO_SHA2_256_HMAC;
+		sess->mackeylen = sizeof(mackey);
+		sess->mackey = mackey;
+	}
+	if (ioctl(cfd, CIOCGSESSION, sess)) {
+		my_perror("ioctl(CIOCGSESSION)");
+		return -1;
+	}
+
+	memset(&esop, 0, sizeof(esop));
+	esop.ses = sess->ses;
+	esop.spi = SPI;
+	esop.replay_window = window;
+	esop.salt = gcm ? salt : NULL;
+	esop.salt_len = gcm ? SALT_SIZE : 0;
+	esop.seq = 1;
+	if (ioctl(cfd, CIOCESPSA, &esop)) {
+		my_perror("ioctl(CIOCESPSA)");
+		return -1;
+	}
+	return 0;
+}
+
+static int esp_op(int cfd, uint32_t ses, int op, uint8_t *packet,
+		  uint32_t *len, uint8_t *nh)
+{
+	struct crypt_auth_op cao;
+
+	memset(&cao, 0, sizeof(cao));
+	cao.ses = ses;
+	cao.op = op;
+	cao.flags = COP_FLAG_AEAD_ESP_TYPE;
+	cao.auth_src = nh;
+	cao.auth_len = 1;
+	cao.src = cao.dst = packet;
+	cao.len = *len;
+	if (ioctl(cfd, CIOCAUTHCRYPT, &cao))
+		return -1;
+
+	*len = cao.len;
+	return 0;
+}
+
+/* Seal packets on an outbound SA and open them on an inbound one, which
+ * rejects replays and forgeries.
+ */
+static int test_esp(int cfd, int gcm)
+{
+	uint8_t packets[3][128], copy[128];
+	struct session_op out, in;
+	unsigned int iv_size = gcm ? 8 : 16;
+	uint8_t *data;
+	uint32_t len[3], plen;
+	uint8_t nh;
+	int i, j;
+
+	if (open_sa(cfd, &out, gcm, 0) || open_sa(cfd, &in, gcm, 32))
+		return 1;
+
+	for (i = 0; i < 3; i++) {
+		data = packets[i] + HEADER_SIZE + iv_size;
+		for (j = 0; j < DATA_SIZE; j++)
+			data[j] = 'a' + j % 26;
+
+		nh = NEXT_HEADER;
+		len[i] = DATA_SIZE;
+		if (esp_op(cfd, out.ses, COP_ENCRYPT, packets[i], &len[i], &nh)) {
+			my_perror("ioctl(CIOCAUTHCRYPT)");
+			return 1;
+		}
+
+		if (packets[i][3] != 0x04 || packets[i][7] != i + 1) {
+			printf("Test failed: packet %d header mismatch\n", i);
+			return 1;
+		}
+	}
+
+	if (gcm && (len[0] != sizeof(esp_gcm_packet) - 1 ||
+		    memcmp(packets[0], esp_gcm_packet, len[0]) != 0)) {
+		printf("Test failed: packet mismatch\n");
+		if (debug) {
+			print_buf("Packet  : ", packets[0], len[0]);
+			print_buf("Expected: ", esp_gcm_packet, sizeof(esp_gcm_packet) - 1);
+		}
+		return 1;
+	}
+
+	/* a forged packet fails and does not count as received */
+	memcpy(copy, packets[1], len[1]);
+	copy[len[1] - 1] ^= 1;
+	plen = len[1];
+	if (esp_op(cfd, in.ses, COP_DECRYPT, copy, &plen, &nh) == 0 ||
+	    errno != EBADMSG) {
+		printf("Test failed: forged packet accepted\n");
+		return 1;
+	}
+
+	/* out of order is fine */
+	for (i = 2; i >= 0; i--) {
+		memcpy(copy, packets[i], len[i]);
+		plen = len[i];
+		nh = 0;
+		if (esp_op(cfd, in.ses, COP_DECRYPT, packets[i], &plen, &nh)) {
+			my_perror("ioctl(CIOCAUTHCRYPT)");
+			return 1;
+		}
+
+		data = packets[i] + HEADER_SIZE + iv_size;
+		if (plen != DATA_SIZE || nh != NEXT_HEADER) {
+			printf("Test failed: packet %d has length %u, next header %u\n",
+			       i, plen, nh);
+			return 1;
+		}
+		for (j = 0; j < DATA_SIZE; j++) {
+			if (data[j] != 'a' + j % 26) {
+				printf("Test failed: packet %d data mismatch\n", i);
+				return 1;
+			}
+		}
+
+		/* replaying it fails */
+		plen = len[i];
+		if (esp_op(cfd, in.ses, COP_DECRYPT, copy, &plen, &nh) == 0 ||
+		    errno != EBADMSG) {
+			printf("Test failed: replayed packet %d accepted\n", i);
+			return 1;
+		}
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &out.ses) ||
+	    ioctl(cfd, CIOCFSESSION, &in.ses)) {
+		my_perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	printf("Test passed\n");
+	return 0;
+}
+
+/* Only CBC ciphers, whose IV is a block, take the place of AES-GCM */
+static int test_not_cbc(int cfd)
+{
+	static const int ciphers[] = { CRYPTO_AES_ECB, CRYPTO_AES_XTS };
+	static const int keylens[] = { KEY_SIZE, 2 * KEY_SIZE };
+	struct session_op sess;
+	struct esp_sa_op esop;
+	uint8_t key[2 * KEY_SIZE], mackey[32];
+	int i;
+
+	memset(key, 0x10, sizeof(key));
+	memset(mackey, 0x40, sizeof(mackey));
+	for (i = 0; i < 2; i++) {
+		memset(&sess, 0, sizeof(sess));
+		sess.cipher = ciphers[i];
+		sess.keylen = keylens[i];
+		sess.key = key;
+		sess.mac = CRYPTO_SHA2_256_HMAC;
+		sess.mackeylen = sizeof(mackey);
+		sess.mackey = mackey;
+		if (ioctl(cfd, CIOCGSESSION, &sess)) {
+			my_perror("ioctl(CIOCGSESSION)");
+			return 1;
+		}
+
+		memset(&esop, 0, sizeof(esop));
+		esop.ses = sess.ses;
+		esop.spi = SPI;
+		esop.seq = 1;
+		if (ioctl(cfd, CIOCESPSA, &esop) == 0 || errno != EINVAL) {
+			printf("Test failed: ESP SA with cipher %d accepted\n",
+			       ciphers[i]);
+			return 1;
+		}
+
+		if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+			my_perror("ioctl(CIOCFSESSION)");
+			return 1;
+		}
+	}
+
+	if (debug) printf("Test passed\n");
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int fd = -1, cfd = -1;
+
+	if (argc > 1)
+		debug = 1;
+
+	/* Open the crypto device */
+	fd = open("/dev/crypto", O_RDWR, 0);
+	if (fd < 0) {
+		perror("open(/dev/crypto)");
+		return 1;
+	}
+
+	/* Clone file descriptor */
+	if (ioctl(fd, CRIOGET, &cfd)) {
+		perror("ioctl(CRIOGET)");
+		return 1;
+	}
+
+	/* Set close-on-exec (not really neede here) */
+	if (fcntl(cfd, F_SETFD, 1) == -1) {
+		perror("fcntl(F_SETFD)");
+		return 1;
+	}
+
+	/* Run the test itself */
+	if (test_esp(cfd, 1))
+		return 1;
+
+	if (test_esp(cfd, 0))
+		return 1;
+
+	if (test_not_cbc(cfd))
+		return 1;
+
+	/* Close cloned descriptor */
+	if (close(cfd)) {
+		perror("close(cfd)");
+		return 1;
+	}
+
+	/* Close the original descriptor */
+	if (close(fd)) {
+		perror("close(fd)");
+		return 1;
+	}
+
+	return 0;
+}
@@ -9,6 +9,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdint.h>
+#include <errno.h>
 
 #include <sys/ioctl.h>
 #include <crypto/cryptodev.h>
@@ -289,6 +290,300 @@ test_extras(int cfd)
 }
 
 
+#ifdef CIOCHASHBATCH
+static int
+test_batch(int cfd)
+{
+	struct session_op sess;
+	struct hash_batch_op hbop;
+	struct hash_batch_msg msgs[20];
+	uint8_t macs[20 * SHA1_HASH_LEN];
+	uint8_t sha1_out[] = "\x8f\x82\x03\x94\xf9\x53\x35\x18\x20\x45\xda\x24\xf3\x4d\xe5\x2b\xf8\xbc\x34\x32";
+	uint8_t sha1_empty_out[] = "\xda\x39\xa3\xee\x5e\x6b\x4b\x0d\x32\x55\xbf\xef\x95\x60\x18\x90\xaf\xd8\x07\x09";
+	int i;
+
+	memset(&sess, 0, sizeof(sess));
+	memset(&hbop, 0, sizeof(hbop));
+	memset(macs, 0, sizeof(macs));
+
+	sess.cipher = 0;
+	sess.mac = CRYPTO_SHA1;
+	if (ioctl(cfd, CIOCGSESSION, &sess)) {
+		perror("ioctl(CIOCGSESSION)");
+		return 1;
+	}
+
+	/* more messages than processed at once, every third is empty */
+	for (i = 0; i < 20; i++) {
+		if (i % 3 == 2) {
+			msgs[i].src = NULL;
+			msgs[i].len = 0;
+		} else {
+			msgs[i].src = (uint8_t *)"what do ya want for nothing?";
+			msgs[i].len = sizeof("what do ya want for nothing?")-1;
+		}
+	}
+
+	hbop.ses = sess.ses;
+	hbop.count = 20;
+	hbop.msgs = msgs;
+	hbop.mac = macs;
+	if (ioctl(cfd, CIOCHASHBATCH, &hbop)) {
+		perror("ioctl(CIOCHASHBATCH)");
+		return 1;
+	}
+
+	for (i = 0; i < 20; i++) {
+		uint8_t *expected = (i % 3 == 2) ? sha1_empty_out : sha1_out;
+
+		if (memcmp(&macs[i * SHA1_HASH_LEN], expected, SHA1_HASH_LEN) != 0) {
+			fprintf(stderr, "HASH test [batch]: message %d failed\n", i);
+			return 1;
+		}
+	}
+	if (debug) fprintf(stderr, "HASH test [batch]: passed\n");
+
+	/* Finish crypto session */
+	if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	return 0;
+}
+#endif
+
+
+#ifdef CIOCHASHEXPORT
+/* Hash the first part of a message in one session, and finish it in
+ * another one after importing the state.
+ */
+static int
+test_state(int cfd)
+{
+	struct session_op sess1, sess2;
+	struct hash_state_op hsop;
+	struct crypt_op cryp;
+	uint8_t state[1024];
+	uint8_t mac[AALG_MAX_RESULT_LEN];
+	uint8_t sha1_out[] = "\x8f\x82\x03\x94\xf9\x53\x35\x18\x20\x45\xda\x24\xf3\x4d\xe5\x2b\xf8\xbc\x34\x32";
+
+	memset(&sess1, 0, sizeof(sess1));
+	memset(&sess2, 0, sizeof(sess2));
+	memset(&hsop, 0, sizeof(hsop));
+	memset(&cryp, 0, sizeof(cryp));
+	memset(mac, 0, sizeof(mac));
+
+	sess1.mac = sess2.mac = CRYPTO_SHA1;
+	if (ioctl(cfd, CIOCGSESSION, &sess1) ||
+	    ioctl(cfd, CIOCGSESSION, &sess2)) {
+		perror("ioctl(CIOCGSESSION)");
+		return 1;
+	}
+
+	cryp.ses = sess1.ses;
+	cryp.len = sizeof("what do")-1;
+	cryp.src = "what do";
+	cryp.mac = mac;
+	cryp.op = COP_ENCRYPT;
+	cryp.flags = COP_FLAG_UPDATE | COP_FLAG_RESET;
+	if (ioctl(cfd, CIOCCRYPT, &cryp)) {
+		perror("ioctl(CIOCCRYPT)");
+		return 1;
+	}
+
+	hsop.ses = sess1.ses;
+	hsop.state = state;
+	hsop.len = sizeof(state);
+	if (ioctl(cfd, CIOCHASHEXPORT, &hsop)) {
+		perror("ioctl(CIOCHASHEXPORT)");
+		return 1;
+	}
+
+	/* a modified state is refused */
+	hsop.ses = sess2.ses;
+	state[0] ^= 1;
+	if (ioctl(cfd, CIOCHASHIMPORT, &hsop) == 0 || errno != EBADMSG) {
+		fprintf(stderr, "HASH test [state]: modified state imported\n");
+		return 1;
+	}
+	state[0] ^= 1;
+
+	if (ioctl(cfd, CIOCHASHIMPORT, &hsop)) {
+		perror("ioctl(CIOCHASHIMPORT)");
+		return 1;
+	}
+
+	cryp.ses = sess2.ses;
+	cryp.len = sizeof(" ya want for nothing?")-1;
+	cryp.src = " ya want for nothing?";
+	cryp.flags = COP_FLAG_FINAL;
+	if (ioctl(cfd, CIOCCRYPT, &cryp)) {
+		perror("ioctl(CIOCCRYPT)");
+		return 1;
+	}
+
+	if (memcmp(mac, sha1_out, SHA1_HASH_LEN) != 0) {
+		fprintf(stderr, "HASH test [state]: failed\n");
+		return 1;
+	}
+	if (debug) fprintf(stderr, "HASH test [state]: passed\n");
+
+	if (ioctl(cfd, CIOCFSESSION, &sess1.ses) ||
+	    ioctl(cfd, CIOCFSESSION, &sess2.ses)) {
+		perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	return 0;
+}
+#endif
+
+
+/* one-shot MAC of msg with a keyed session, compared to expected */
+static int
+test_keyed_mac(int cfd, const char *name, int alg, const uint8_t *key,
+	       int keylen, const uint8_t *msg, int len, const uint8_t *expected,
+	       int maclen)
+{
+	struct session_op sess;
+	struct crypt_op cryp;
+	uint8_t mac[AALG_MAX_RESULT_LEN];
+	int i;
+
+	memset(&sess, 0, sizeof(sess));
+	sess.mac = alg;
+	sess.mackeylen = keylen;
+	sess.mackey = (uint8_t *)key;
+	if (ioctl(cfd, CIOCGSESSION, &sess)) {
+		perror("ioctl(CIOCGSESSION)");
+		return 1;
+	}
+
+	memset(&cryp, 0, sizeof(cryp));
+	cryp.ses = sess.ses;
+	cryp.len = len;
+	cryp.src = (uint8_t *)msg;
+	cryp.mac = mac;
+	cryp.op = COP_ENCRYPT;
+	if (ioctl(cfd, CIOCCRYPT, &cryp)) {
+		perror("ioctl(CIOCCRYPT)");
+		return 1;
+	}
+
+	if (memcmp(mac, expected, maclen) != 0) {
+		printf("mac: ");
+		for (i = 0; i < maclen; i++)
+			printf("%.2x", mac[i]);
+		puts("\n");
+		fprintf(stderr, "%s test: failed\n", name);
+		return 1;
+	}
+	if (debug)
+		fprintf(stderr, "%s test: passed\n", name);
+
+	if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	return 0;
+}
+
+/* block cipher based MACs, RFC 4493 and RFC 3566 */
+static int
+test_cipher_macs(int cfd)
+{
+	const uint8_t cmac_key[] = "\x2b\x7e\x15\x16\x28\xae\xd2\xa6"
+				   "\xab\xf7\x15\x88\x09\xcf\x4f\x3c";
+	const uint8_t cmac_msg[] = "\x6b\xc1\xbe\xe2\x2e\x40\x9f\x96"
+				   "\xe9\x3d\x7e\x11\x73\x93\x17\x2a";
+	const uint8_t cmac_out[] = "\x07\x0a\x16\xb4\x6b\x4d\x41\x44"
+				   "\xf7\x9b\xdd\x9d\xd0\x4a\x28\x7c";
+	const uint8_t xcbc_msg[] = "\x00\x01\x02";
+	const uint8_t xcbc_out[] = "\x5b\x37\x65\x80\xae\x2f\x19\xaf"
+				   "\xe7\x21\x9c\xee\xf1\x72\x75\x6f";
+	uint8_t xcbc_key[16];
+	int i;
+
+	for (i = 0; i < sizeof(xcbc_key); i++)
+		xcbc_key[i] = i;
+
+	if (test_keyed_mac(cfd, "AES-CMAC", CRYPTO_AES_CMAC, cmac_key, 16,
+			   cmac_msg, 16, cmac_out, 16))
+		return 1;
+
+	return test_keyed_mac(cfd, "AES-XCBC-MAC", CRYPTO_AES_XCBC_MAC,
+			      xcbc_key, 16, xcbc_msg, 3, xcbc_out, 16);
+}
+
+/* whether the kernel provides a hash or MAC */
+static int
+have_mac(int cfd, int alg, int keylen)
+{
+	struct session_op sess;
+	uint8_t key[32];
+
+	memset(key, 0, sizeof(key));
+	memset(&sess, 0, sizeof(sess));
+	sess.mac = alg;
+	sess.mackeylen = keylen;
+	sess.mackey = key;
+	if (ioctl(cfd, CIOCGSESSION, &sess))
+		return 0;
+
+	ioctl(cfd, CIOCFSESSION, &sess.ses);
+	return 1;
+}
+
+/* SHA-3 (FIPS 202) and BLAKE2 (RFC 7693), when available */
+static int
+test_sha3_blake2(int cfd)
+{
+	const uint8_t sha3_out[] =
+		"\x3a\x98\x5d\xa7\x4f\xe2\x25\xb2\x04\x5c\x17\x2d\x6b\xd3\x90\xbd"
+		"\x85\x5f\x08\x6e\x3e\x9d\x52\x5b\x46\xbf\xe2\x45\x11\x43\x15\x32";
+	const uint8_t sha3_hmac_out[] =
+		"\x8c\x6e\x06\x83\x40\x94\x27\xf8\x93\x17\x11\xb1\x0c\xa9\x2a\x50"
+		"\x6e\xb1\xfa\xfa\x48\xfa\xdd\x66\xd7\x61\x26\xf4\x7a\xc2\xc3\x33";
+	const uint8_t blake2b_out[] =
+		"\xbd\xdd\x81\x3c\x63\x42\x39\x72\x31\x71\xef\x3f\xee\x98\x57\x9b"
+		"\x94\x96\x4e\x3b\xb1\xcb\x3e\x42\x72\x62\xc8\xc0\x68\xd5\x23\x19";
+	const uint8_t blake2b_keyed_out[] =
+		"\x8c\x79\x99\x54\x22\x9a\x3f\x74\x3a\xd1\xeb\x6e\xe3\xbd\x04\xf1"
+		"\xad\x43\x38\x1e\xf5\x00\x90\x99\xcf\xf2\x08\x44\x22\xdf\x5a\x2f";
+	const char fox[] = "The quick brown fox jumps over the lazy dog";
+	uint8_t blake2_key[32];
+
+	memset(blake2_key, 0x42, sizeof(blake2_key));
+
+	if (!have_mac(cfd, CRYPTO_SHA3_256, 0)) {
+		printf("SHA-3 is not supported\n");
+	} else {
+		if (test_keyed_mac(cfd, "SHA3-256", CRYPTO_SHA3_256, NULL, 0,
+				   (uint8_t *)"abc", 3, sha3_out, 32))
+			return 1;
+		if (test_keyed_mac(cfd, "HMAC-SHA3-256", CRYPTO_SHA3_256_HMAC,
+				   (uint8_t *)"key", 3, (uint8_t *)fox,
+				   sizeof(fox) - 1, sha3_hmac_out, 32))
+			return 1;
+	}
+
+	if (!have_mac(cfd, CRYPTO_BLAKE2B_256, 0)) {
+		printf("BLAKE2b is not supported\n");
+	} else {
+		if (test_keyed_mac(cfd, "BLAKE2b-256", CRYPTO_BLAKE2B_256, NULL,
+				   0, (uint8_t *)"abc", 3, blake2b_out, 32))
+			return 1;
+		if (test_keyed_mac(cfd, "keyed BLAKE2b-256", CRYPTO_BLAKE2B_256,
+				   blake2_key, sizeof(blake2_key),
+				   (uint8_t *)"abc", 3, blake2b_keyed_out, 32))
+			return 1;
+	}
+
+	return 0;
+}
+
 int
 main(int argc, char** argv)
 {
@@ -322,6 +617,22 @@ main(int argc, char** argv)
 	if (test_extras(cfd))
 		return 1;
 
+	if (test_cipher_macs(cfd))
+		return 1;
+
+	if (test_sha3_blake2(cfd))
+		return 1;
+
+#ifdef CIOCHASHBATCH
+	if (test_batch(cfd))
+		return 1;
+#endif
+
+#ifdef CIOCHASHEXPORT
+	if (test_state(cfd))
+		return 1;
+#endif
+
 	/* Close cloned descriptor */
 	if (close(cfd)) {
 		perror("close(cfd)");
@@ -0,0 +1,241 @@
+/*
+ * Demo on how to use /dev/crypto device for key derivation (HKDF and the
+ * TLS 1.2 PRF) with CIOCKDF.
+ *
+ * Placed under public domain.
+ *
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/ioctl.h>
+#include <crypto/cryptodev.h>
+
+#define	PRK_SIZE	32
+#define	OKM_SIZE	42
+#define	PRF_SIZE	100
+
+#define my_perror(x) {fprintf(stderr, "%s: %d\n", __func__, __LINE__); perror(x); }
+
+static int debug = 0;
+
+static void print_buf(char *desc, const unsigned char *buf, int size)
+{
+	int i;
+	fputs(desc, stdout);
+	for (i = 0; i < size; i++) {
+		printf("%.2x", (uint8_t) buf[i]);
+	}
+	fputs("\n", stdout);
+}
+
+/* RFC 5869, test case 1 */
+static const uint8_t hkdf_prk[] =
+	"\x07\x77\x09\x36\x2c\x2e\x32\xdf\x0d\xdc\x3f\x0d\xc4\x7b\xba\x63"
+	"\x90\xb6\xc7\x3b\xb5\x0f\x9c\x31\x22\xec\x84\x4a\xd7\xc2\xb3\xe5";
+static const uint8_t hkdf_okm[] =
+	"\x3c\xb2\x5f\x25\xfa\xac\xd5\x7a\x90\x43\x4f\x64\xd0\x36\x2f\x2a"
+	"\x2d\x2d\x0a\x90\xcf\x1a\x5a\x4c\x5d\xb0\x2d\x56\xec\xc4\xc5\xbf"
+	"\x34\x00\x72\x08\xd5\xb8\x87\x18\x58\x65";
+
+/* TLS 1.2 PRF with SHA-256; the seed is label || seed */
+static const uint8_t prf_secret[] =
+	"\x9b\xbe\x43\x6b\xa9\x40\xf0\x17\xb1\x76\x52\x84\x9a\x71\xdb\x35";
+static const uint8_t prf_seed[] =
+	"\x74\x65\x73\x74\x20\x6c\x61\x62\x65\x6c\xa0\xba\x9f\x93\x6c\xda"
+	"\x31\x18\x27\xa6\xf7\x96\xff\xd5\x19\x8c";
+static const uint8_t prf_output[] =
+	"\xe3\xf2\x29\xba\x72\x7b\xe1\x7b\x8d\x12\x26\x20\x55\x7c\xd4\x53"
+	"\xc2\xaa\xb2\x1d\x07\xc3\xd4\x95\x32\x9b\x52\xd4\xe6\x1e\xdb\x5a"
+	"\x6b\x30\x17\x91\xe9\x0d\x35\xc9\xc9\xa4\x6b\x4e\x14\xba\xf9\xaf"
+	"\x0f\xa0\x22\xf7\x07\x7d\xef\x17\xab\xfd\x37\x97\xc0\x56\x4b\xab"
+	"\x4f\xbc\x91\x66\x6e\x9d\xef\x9b\x97\xfc\xe3\x4f\x79\x67\x89\xba"
+	"\xa4\x80\x82\xd1\x22\xee\x42\xc5\xa7\x2e\x5a\x51\x10\xff\xf7\x01"
+	"\x87\x34\x7b\x66";
+
+static int open_session(int cfd, struct session_op *sess,
+			const uint8_t *key, int keylen)
+{
+	memset(sess, 0, sizeof(*sess));
+	sess->mac = CRYPTO_SHA2_256_HMAC;
+	sess->mackeylen = keylen;
+	sess->mackey = (uint8_t *)key;
+	if (ioctl(cfd, CIOCGSESSION, sess)) {
+		my_perror("ioctl(CIOCGSESSION)");
+		return -1;
+	}
+	return 0;
+}
+
+static int derive(int cfd, uint32_t ses, int op, const uint8_t *in,
+		  int in_len, const uint8_t *info, int info_len,
+		  uint8_t *out, int out_len)
+{
+	struct kdf_op kop;
+
+	memset(&kop, 0, sizeof(kop));
+	kop.ses = ses;
+	kop.op = op;
+	kop.in = (uint8_t *)in;
+	kop.in_len = in_len;
+	kop.info = (uint8_t *)info;
+	kop.info_len = info_len;
+	kop.out = out;
+	kop.out_len = out_len;
+	return ioctl(cfd, CIOCKDF, &kop);
+}
+
+static int check(const char *what, const uint8_t *out, const uint8_t *expected,
+		 int size)
+{
+	if (memcmp(out, expected, size) != 0) {
+		printf("Test failed: %s mismatch\n", what);
+		if (debug) {
+			print_buf("Output  : ", out, size);
+			print_buf("Expected: ", expected, size);
+		}
+		return 1;
+	}
+	return 0;
+}
+
+static int test_hkdf(int cfd)
+{
+	uint8_t ikm[22], salt[13], info[10];
+	uint8_t prk[PRK_SIZE], okm[OKM_SIZE];
+	struct session_op sess, prk_sess;
+	int i;
+
+	memset(ikm, 0x0b, sizeof(ikm));
+	for (i = 0; i < sizeof(salt); i++)
+		salt[i] = i;
+	for (i = 0; i < sizeof(info); i++)
+		info[i] = 0xf0 + i;
+
+	/* the salt is the key of the extract step */
+	if (open_session(cfd, &sess, salt, sizeof(salt)))
+		return 1;
+
+	if (derive(cfd, sess.ses, KDF_HKDF_EXTRACT, ikm, sizeof(ikm),
+		   NULL, 0, prk, sizeof(prk))) {
+		my_perror("ioctl(CIOCKDF)");
+		return 1;
+	}
+	if (check("PRK", prk, hkdf_prk, PRK_SIZE))
+		return 1;
+
+	/* both steps at once */
+	memset(okm, 0, sizeof(okm));
+	if (derive(cfd, sess.ses, KDF_HKDF, ikm, sizeof(ikm),
+		   info, sizeof(info), okm, sizeof(okm))) {
+		my_perror("ioctl(CIOCKDF)");
+		return 1;
+	}
+	if (check("OKM", okm, hkdf_okm, OKM_SIZE))
+		return 1;
+
+	/* expand only, keyed with the PRK */
+	if (open_session(cfd, &prk_sess, prk, sizeof(prk)))
+		return 1;
+
+	memset(okm, 0, sizeof(okm));
+	if (derive(cfd, prk_sess.ses, KDF_HKDF_EXPAND, info, sizeof(info),
+		   NULL, 0, okm, sizeof(okm))) {
+		my_perror("ioctl(CIOCKDF)");
+		return 1;
+	}
+	if (check("OKM", okm, hkdf_okm, OKM_SIZE))
+		return 1;
+
+	/* at most 255 blocks can be derived */
+	if (derive(cfd, prk_sess.ses, KDF_HKDF_EXPAND, info, sizeof(info),
+		   NULL, 0, okm, 255 * PRK_SIZE + 1) == 0) {
+		printf("Test failed: too long output accepted\n");
+		return 1;
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &prk_sess.ses) ||
+	    ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		my_perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	printf("Test passed\n");
+	return 0;
+}
+
+static int test_tls12_prf(int cfd)
+{
+	uint8_t out[PRF_SIZE];
+	struct session_op sess;
+
+	if (open_session(cfd, &sess, prf_secret, sizeof(prf_secret) - 1))
+		return 1;
+
+	if (derive(cfd, sess.ses, KDF_TLS12_PRF, prf_seed, sizeof(prf_seed) - 1,
+		   NULL, 0, out, sizeof(out))) {
+		my_perror("ioctl(CIOCKDF)");
+		return 1;
+	}
+	if (check("PRF output", out, prf_output, PRF_SIZE))
+		return 1;
+
+	if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		my_perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	printf("Test passed\n");
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int fd = -1, cfd = -1;
+
+	if (argc > 1)
+		debug = 1;
+
+	/* Open the crypto device */
+	fd = open("/dev/crypto", O_RDWR, 0);
+	if (fd < 0) {
+		perror("open(/dev/crypto)");
+		return 1;
+	}
+
+	/* Clone file descriptor */
+	if (ioctl(fd, CRIOGET, &cfd)) {
+		perror("ioctl(CRIOGET)");
+		return 1;
+	}
+
+	/* Set close-on-exec (not really neede here) */
+	if (fcntl(cfd, F_SETFD, 1) == -1) {
+		perror("fcntl(F_SETFD)");
+		return 1;
+	}
+
+	/* Run the test itself */
+	if (test_hkdf(cfd))
+		return 1;
+
+	if (test_tls12_prf(cfd))
+		return 1;
+
+	/* Close cloned descriptor */
+	if (close(cfd)) {
+		perror("close(cfd)");
+		return 1;
+	}
+
+	/* Close the original descriptor */
+	if (close(fd)) {
+		perror("close(fd)");
+		return 1;
+	}
+
+	return 0;
+}
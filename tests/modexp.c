@@ -0,0 +1,247 @@
+/*
+ * Demo on how to use /dev/crypto device for modular exponentiation
+ * (e.g., RSA private key operations) with CIOCKEY.
+ *
+ * Placed under public domain.
+ *
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include <sys/ioctl.h>
+#include <crypto/cryptodev.h>
+
+#define	NUM_SIZE	128
+
+#define my_perror(x) {fprintf(stderr, "%s: %d\n", __func__, __LINE__); perror(x); }
+
+static int debug = 0;
+
+static void print_buf(char *desc, const unsigned char *buf, int size)
+{
+	int i;
+	fputs(desc, stdout);
+	for (i = 0; i < size; i++) {
+		printf("%.2x", (uint8_t) buf[i]);
+	}
+	fputs("\n", stdout);
+}
+
+/* big endian; the result is base^exp mod mod */
+static const uint8_t modexp_mod[] =
+	"\xe3\xd4\x55\x66\xfb\x46\xa8\x44\x7d\x71\x43\x5f\xd3\xcc\xa1\x41"
+	"\x68\x68\xd9\x1d\x93\x7f\x5a\x19\x13\xe7\x5c\x17\x8a\xf3\x4e\x81"
+	"\x44\xa1\x5d\x89\x8f\x61\xf0\x37\x5d\x50\xc5\xf7\x6e\xb1\x13\x5c"
+	"\xa7\x00\xbc\x19\xba\xfe\x68\x60\x44\xf8\x5b\xd6\x3f\x65\x82\x26"
+	"\x2d\x2c\x30\x9b\xa0\x82\x5a\xcb\x80\xa5\x0d\xd9\x00\x1a\x65\x66"
+	"\x14\x1e\xc2\xc0\xe0\x04\x5d\xce\x48\xd3\x9b\xe1\xca\x37\x41\x7a"
+	"\xe8\xcd\x8a\xd5\xeb\x17\x4f\x64\xcd\x26\x81\x10\xf5\x91\x3f\x13"
+	"\x05\x56\x65\xf0\xfb\xb3\xe8\x4e\x0e\xf1\x52\x12\x54\x25\xb7\xb3";
+static const uint8_t modexp_base[] =
+	"\x07\xe9\xd7\x9c\xfc\x25\x69\xf9\xe6\x94\x21\xb7\x62\xae\x03\x71"
+	"\xff\x3f\x86\xae\x98\x08\xb9\x2c\x00\xcf\x3d\x1f\x2b\x22\x69\x7f"
+	"\x8c\x9b\x62\xb8\xe2\xe0\xa8\x1b\xb6\x99\x43\x15\x53\x14\x82\xa1"
+	"\x97\xe2\x50\x86\xb4\x99\xb0\x37\x7d\xe1\x67\x3e\x2f\x39\x15\xcb"
+	"\x4b\x58\x4e\x85\x86\x31\xaf\x84\x34\x1b\x6b\xa3\xc3\xc0\x82\xea"
+	"\xb3\x9c\x15\xf3\x7f\x54\xcd\xf7\x83\x9e\x9e\x04\x1f\x9a\xe5\x8a"
+	"\x2a\xeb\xb8\x12\x64\x5e\xc1\x17\x3e\x49\x98\x6b\xe3\xa6\xcf\xce"
+	"\x65\x48\x75\xdf\xce\x5c\xa6\x01\xc1\x9d\xc4\x31\x58\x75\xd2\x14";
+static const uint8_t modexp_exp[] =
+	"\xd8\x9b\x15\x7c\x15\xa2\xe5\x6a\xba\x33\xce\x48\xfc\xa6\x1d\xdc"
+	"\x73\xe2\xbd\x19\x4b\xc4\x2d\xed\x81\xff\xd9\x9a\xa6\x54\xf1\xdf"
+	"\x76\x5b\xe5\xdb\x81\xd9\xec\x77\xa0\x71\x3b\xa2\x3c\x70\x8d\xf9"
+	"\x09\x5a\x18\xf5\x9c\x7b\x00\xae\x41\x95\x79\x94\xf0\x88\x69\xac"
+	"\xc0\xa7\x74\x6c\xff\xd3\xe0\xbb\xba\x2c\x62\xff\xed\xea\xe0\x59"
+	"\xee\xef\xc4\x1f\x7e\x9d\x92\xc8\xde\x28\x70\x52\x35\x4a\x14\xfe"
+	"\xcd\xab\xb5\xd7\x5f\x33\xda\x49\xe5\x9f\x5d\x5b\x6a\xea\x5f\xf1"
+	"\x37\xb5\x30\xd2\xe1\x4f\x0d\x18\xc1\xf0\x16\xb1\x23\x7c\xa4\x03";
+static const uint8_t modexp_result[] =
+	"\x19\xf2\x20\xb5\x24\x67\xce\x99\x7d\x1f\xa3\x4d\x27\x1a\x0e\x96"
+	"\x5f\x10\x33\x3a\x70\xb0\x9f\xdc\xa3\xfc\x1b\x8e\xa1\x6f\xdb\xcd"
+	"\xa9\x3b\xeb\x98\x20\x2e\xed\x01\xf7\xb0\xc7\xc7\xab\x65\x2f\x2d"
+	"\x85\x5b\xe2\x28\xb7\xc4\x4c\x91\x48\x86\x65\x98\x38\x26\xc5\xc5"
+	"\xef\x77\x20\x5a\x2b\xf6\xb0\x30\x47\xfa\x89\x7a\xc7\xfb\xff\xf1"
+	"\x1a\xef\x46\x39\x80\x32\x25\x23\x54\x9b\x74\x89\xac\x62\xee\x17"
+	"\xfa\xd1\xb0\xe3\x46\x89\x4e\x58\x95\x37\xe5\x13\xfd\x35\x56\xe8"
+	"\x71\xa5\x34\xff\xb3\x74\xd0\x5e\xb9\x69\xa4\xd6\x82\x58\x76\xf9";
+
+/* CIOCKEY numbers are little endian */
+static void to_le(uint8_t *dst, const uint8_t *src, int size)
+{
+	int i;
+
+	for (i = 0; i < size; i++)
+		dst[i] = src[size - 1 - i];
+}
+
+static void setup_kop(struct crypt_kop *kop, uint8_t params[4][NUM_SIZE])
+{
+	int i;
+
+	to_le(params[0], modexp_base, NUM_SIZE);
+	to_le(params[1], modexp_exp, NUM_SIZE);
+	to_le(params[2], modexp_mod, NUM_SIZE);
+	memset(params[3], 0, NUM_SIZE);
+
+	memset(kop, 0, sizeof(*kop));
+	kop->crk_op = CRK_MOD_EXP;
+	kop->crk_iparams = 3;
+	kop->crk_oparams = 1;
+	for (i = 0; i < 4; i++) {
+		kop->crk_param[i].crp_p = params[i];
+		kop->crk_param[i].crp_nbits = NUM_SIZE * 8;
+	}
+}
+
+static int check_result(uint8_t *le_result)
+{
+	uint8_t result[NUM_SIZE];
+
+	to_le(result, le_result, NUM_SIZE);
+	if (memcmp(result, modexp_result, NUM_SIZE) != 0) {
+		printf("Test failed: result mismatch\n");
+		if (debug) {
+			print_buf("Result  : ", result, NUM_SIZE);
+			print_buf("Expected: ", modexp_result, NUM_SIZE);
+		}
+		return 1;
+	}
+	return 0;
+}
+
+static int test_mod_exp(int cfd)
+{
+	uint8_t params[4][NUM_SIZE];
+	struct crypt_kop kop;
+
+	setup_kop(&kop, params);
+	if (ioctl(cfd, CIOCKEY, &kop)) {
+		my_perror("ioctl(CIOCKEY)");
+		return 1;
+	}
+
+	if (kop.crk_status != 0 || check_result(params[3]))
+		return 1;
+
+	/* a base larger than the modulus is refused */
+	setup_kop(&kop, params);
+	memset(params[0], 0xff, NUM_SIZE);
+	if (ioctl(cfd, CIOCKEY, &kop) == 0) {
+		printf("Test failed: base larger than modulus accepted\n");
+		return 1;
+	}
+
+	printf("Test passed\n");
+	return 0;
+}
+
+#ifdef CIOCASYNCKEY
+#define ASYNC_JOBS	4
+
+static int test_async_mod_exp(int cfd)
+{
+	uint8_t params[ASYNC_JOBS][4][NUM_SIZE];
+	struct crypt_kop kop;
+	struct pollfd pfd;
+	int i;
+
+	for (i = 0; i < ASYNC_JOBS; i++) {
+		setup_kop(&kop, params[i]);
+		if (ioctl(cfd, CIOCASYNCKEY, &kop)) {
+			if (errno == EINVAL) {
+				printf("Asynchronous operation not enabled\n");
+				return 0;
+			}
+			my_perror("ioctl(CIOCASYNCKEY)");
+			return 1;
+		}
+	}
+
+	pfd.fd = cfd;
+	pfd.events = POLLIN;
+	for (i = 0; i < ASYNC_JOBS; ) {
+		if (poll(&pfd, 1, 5000) <= 0) {
+			my_perror("poll()");
+			return 1;
+		}
+
+		while (ioctl(cfd, CIOCASYNCKEYFETCH, &kop) == 0) {
+			if (kop.crk_status != 0 ||
+			    check_result(kop.crk_param[3].crp_p))
+				return 1;
+			i++;
+		}
+		if (errno != EBUSY) {
+			my_perror("ioctl(CIOCASYNCKEYFETCH)");
+			return 1;
+		}
+	}
+
+	printf("Test passed\n");
+	return 0;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+	int fd = -1, cfd = -1;
+	uint32_t features;
+
+	if (argc > 1)
+		debug = 1;
+
+	/* Open the crypto device */
+	fd = open("/dev/crypto", O_RDWR, 0);
+	if (fd < 0) {
+		perror("open(/dev/crypto)");
+		return 1;
+	}
+
+	/* Clone file descriptor */
+	if (ioctl(fd, CRIOGET, &cfd)) {
+		perror("ioctl(CRIOGET)");
+		return 1;
+	}
+
+	/* Set close-on-exec (not really neede here) */
+	if (fcntl(cfd, F_SETFD, 1) == -1) {
+		perror("fcntl(F_SETFD)");
+		return 1;
+	}
+
+	if (ioctl(cfd, CIOCASYMFEAT, &features)) {
+		perror("ioctl(CIOCASYMFEAT)");
+		return 1;
+	}
+
+	/* Run the test itself */
+	if (!(features & CRF_MOD_EXP)) {
+		printf("Modular exponentiation is not supported\n");
+	} else {
+		if (test_mod_exp(cfd))
+			return 1;
+#ifdef CIOCASYNCKEY
+		if (test_async_mod_exp(cfd))
+			return 1;
+#endif
+	}
+
+	/* Close cloned descriptor */
+	if (close(cfd)) {
+		perror("close(cfd)");
+		return 1;
+	}
+
+	/* Close the original descriptor */
+	if (close(fd)) {
+		perror("close(fd)");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,130 @@
+/*
+ * Demo on how to use /dev/crypto device for random number generation
+ * with CIOCRANDOM.
+ *
+ * Placed under public domain.
+ *
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/ioctl.h>
+#include <crypto/cryptodev.h>
+
+/* not page aligned and spanning many pages */
+#define	RANDOM_OFFSET	13
+#define	RANDOM_SIZE	(1024 * 1024 + 77)
+#define	GUARD_SIZE	64
+
+#define my_perror(x) {fprintf(stderr, "%s: %d\n", __func__, __LINE__); perror(x); }
+
+static uint8_t buf1[RANDOM_OFFSET + RANDOM_SIZE + GUARD_SIZE];
+static uint8_t buf2[RANDOM_SIZE];
+
+/* whether a run of 32 zero bytes exists, which random data never has */
+static int has_zero_run(const uint8_t *buf, int size)
+{
+	int i, run = 0;
+
+	for (i = 0; i < size; i++) {
+		run = buf[i] ? 0 : run + 1;
+		if (run == 32)
+			return 1;
+	}
+	return 0;
+}
+
+static int test_random(int cfd)
+{
+	struct random_op rop;
+	int i;
+
+	memset(buf1, 0, sizeof(buf1));
+
+	rop.len = RANDOM_SIZE;
+	rop.dst = buf1 + RANDOM_OFFSET;
+	if (ioctl(cfd, CIOCRANDOM, &rop)) {
+		my_perror("ioctl(CIOCRANDOM)");
+		return 1;
+	}
+
+	if (has_zero_run(buf1 + RANDOM_OFFSET, RANDOM_SIZE)) {
+		printf("Test failed: output not filled\n");
+		return 1;
+	}
+
+	for (i = 0; i < sizeof(buf1); i++) {
+		if (i >= RANDOM_OFFSET && i < RANDOM_OFFSET + RANDOM_SIZE)
+			continue;
+		if (buf1[i] != 0) {
+			printf("Test failed: write outside of the buffer\n");
+			return 1;
+		}
+	}
+
+	rop.dst = buf2;
+	if (ioctl(cfd, CIOCRANDOM, &rop)) {
+		my_perror("ioctl(CIOCRANDOM)");
+		return 1;
+	}
+
+	if (memcmp(buf1 + RANDOM_OFFSET, buf2, 64) == 0) {
+		printf("Test failed: repeated output\n");
+		return 1;
+	}
+
+	/* nothing to do */
+	rop.len = 0;
+	if (ioctl(cfd, CIOCRANDOM, &rop)) {
+		my_perror("ioctl(CIOCRANDOM)");
+		return 1;
+	}
+
+	printf("Test passed\n");
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int fd = -1, cfd = -1;
+
+	/* Open the crypto device */
+	fd = open("/dev/crypto", O_RDWR, 0);
+	if (fd < 0) {
+		perror("open(/dev/crypto)");
+		return 1;
+	}
+
+	/* Clone file descriptor */
+	if (ioctl(fd, CRIOGET, &cfd)) {
+		perror("ioctl(CRIOGET)");
+		return 1;
+	}
+
+	/* Set close-on-exec (not really neede here) */
+	if (fcntl(cfd, F_SETFD, 1) == -1) {
+		perror("fcntl(F_SETFD)");
+		return 1;
+	}
+
+	/* Run the test itself */
+	if (test_random(cfd))
+		return 1;
+
+	/* Close cloned descriptor */
+	if (close(cfd)) {
+		perror("close(cfd)");
+		return 1;
+	}
+
+	/* Close the original descriptor */
+	if (close(fd)) {
+		perror("close(fd)");
+		return 1;
+	}
+
+	return 0;
+}
@@ -127,29 +127,20 @@ int hash_data(struct session_op *sess, int fdc, int chunksize, int alignmask)
 	return 0;
 }
 
-int main(void)
+static int test_hash(int fdc, const char *name, int mac, char *key,
+		     int keylen)
 {
-	int fd, i, fdc = -1, alignmask = 0;
 	struct session_op sess;
-	char keybuf[32];
+	int i, alignmask = 0;
 #ifdef CIOCGSESSINFO
 	struct session_info_op siop;
 #endif
 
-	signal(SIGALRM, alarm_handler);
-
-	if ((fd = open("/dev/crypto", O_RDWR, 0)) < 0) {
-		perror("open()");
-		return 1;
-	}
-	if (ioctl(fd, CRIOGET, &fdc)) {
-		perror("ioctl(CRIOGET)");
-		return 1;
-	}
-
-	fprintf(stderr, "Testing SHA1 Hash: \n");
+	fprintf(stderr, "\nTesting %s: \n", name);
 	memset(&sess, 0, sizeof(sess));
-	sess.mac = CRYPTO_SHA1;
+	sess.mac = mac;
+	sess.mackeylen = keylen;
+	sess.mackey = (unsigned char *)key;
 	if (ioctl(fdc, CIOCGSESSION, &sess)) {
 		perror("ioctl(CIOCGSESSION)");
 		return 1;
@@ -160,7 +151,7 @@ int main(void)
 		perror("ioctl(CIOCGSESSINFO)");
 		return 1;
 	}
-	printf("requested hash CRYPTO_SHA1, got %s with driver %s\n",
+	printf("requested %s, got %s with driver %s\n", name,
 			siop.hash_info.cra_name, siop.hash_info.cra_driver_name);
 	alignmask = siop.alignmask;
 #endif
@@ -170,28 +161,43 @@ int main(void)
 			break;
 	}
 
-	fprintf(stderr, "\nTesting SHA256 Hash: \n");
-	memset(&sess, 0, sizeof(sess));
-	sess.mac = CRYPTO_SHA2_256;
-	if (ioctl(fdc, CIOCGSESSION, &sess)) {
-		perror("ioctl(CIOCGSESSION)");
+	ioctl(fdc, CIOCFSESSION, &sess.ses);
+	return 0;
+}
+
+int main(void)
+{
+	int fd, fdc = -1;
+	char keybuf[32];
+
+	signal(SIGALRM, alarm_handler);
+
+	if ((fd = open("/dev/crypto", O_RDWR, 0)) < 0) {
+		perror("open()");
 		return 1;
 	}
-#ifdef CIOCGSESSINFO
-	siop.ses = sess.ses;
-	if (ioctl(fdc, CIOCGSESSINFO, &siop)) {
-		perror("ioctl(CIOCGSESSINFO)");
+	if (ioctl(fd, CRIOGET, &fdc)) {
+		perror("ioctl(CRIOGET)");
 		return 1;
 	}
-	printf("requested hash CRYPTO_SHA2_256, got %s with driver %s\n",
-			siop.hash_info.cra_name, siop.hash_info.cra_driver_name);
-	alignmask = siop.alignmask;
-#endif
 
-	for (i = 256; i <= (64 * 1024); i *= 4) {
-		if (hash_data(&sess, fdc, i, alignmask))
-			break;
-	}
+	memset(keybuf, 0x42, sizeof(keybuf));
+
+	if (test_hash(fdc, "SHA1 Hash", CRYPTO_SHA1, NULL, 0))
+		return 1;
+
+	if (test_hash(fdc, "SHA256 Hash", CRYPTO_SHA2_256, NULL, 0))
+		return 1;
+
+	/* the rest may not be available; carry on without them */
+	test_hash(fdc, "SHA3-256 Hash", CRYPTO_SHA3_256, NULL, 0);
+	test_hash(fdc, "BLAKE2b-256 Hash", CRYPTO_BLAKE2B_256, NULL, 0);
+	test_hash(fdc, "BLAKE2b-512 Hash", CRYPTO_BLAKE2B_512, NULL, 0);
+	test_hash(fdc, "BLAKE2s-256 Hash", CRYPTO_BLAKE2S_256, NULL, 0);
+	test_hash(fdc, "HMAC-SHA256", CRYPTO_SHA2_256_HMAC, keybuf, 32);
+	test_hash(fdc, "AES-128-CMAC", CRYPTO_AES_CMAC, keybuf, 16);
+	test_hash(fdc, "AES-128-XCBC-MAC", CRYPTO_AES_XCBC_MAC, keybuf, 16);
+	test_hash(fdc, "Poly1305", CRYPTO_POLY1305, NULL, 0);
 
 	close(fdc);
 	close(fd);
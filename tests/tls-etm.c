@@ -0,0 +1,295 @@
+/*
+ * Demo on how to use /dev/crypto device for TLS CBC records with
+ * encrypt-then-MAC (RFC 7366) and for DTLS CBC records.
+ *
+ * Placed under public domain.
+ *
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/ioctl.h>
+#include <crypto/cryptodev.h>
+
+#define	KEY_SIZE	16
+#define	MAC_KEY_SIZE	20
+#define	HEADER_SIZE	13
+#define	BLOCK_SIZE	16
+#define	TAG_SIZE	20
+#define	DATA_SIZE	37
+#define	CT_SIZE		48
+
+#define my_perror(x) {fprintf(stderr, "%s: %d\n", __func__, __LINE__); perror(x); }
+
+static int debug = 0;
+
+static void print_buf(char *desc, const unsigned char *buf, int size)
+{
+	int i;
+	fputs(desc, stdout);
+	for (i = 0; i < size; i++) {
+		printf("%.2x", (uint8_t) buf[i]);
+	}
+	fputs("\n", stdout);
+}
+
+/* AES-128-CBC key 00..0f, explicit IV 20..2f, HMAC-SHA1 key 0b..,
+ * sequence number 1, application data "abc..." */
+static const uint8_t etm_record[] =
+	"\xe7\xf6\x37\x57\x72\x4b\xef\x34\x72\xe0\x3b\x1c\xb7\x1c\x73\x75"
+	"\x48\xc0\xc0\x00\x67\xba\xfa\xf8\xfb\xfa\xed\x80\xb4\xe0\x10\x23"
+	"\x29\xbc\x31\x14\x3d\xe9\xb6\xf5\xcd\x77\x81\x2d\xc2\xda\xc3\xd8"
+	"\xbd\xaf\x25\xdf\xac\xba\xaf\xd9\x5c\xc2\x74\x79\x6f\x31\x94\x1f"
+	"\xac\x6b\xa8\x45";
+
+static int open_session(int cfd, struct session_op *sess)
+{
+	uint8_t key[KEY_SIZE], mac_key[MAC_KEY_SIZE];
+	int i;
+
+	for (i = 0; i < KEY_SIZE; i++)
+		key[i] = i;
+	memset(mac_key, 0x0b, sizeof(mac_key));
+
+	memset(sess, 0, sizeof(*sess));
+	sess->cipher = CRYPTO_AES_CBC;
+	sess->keylen = KEY_SIZE;
+	sess->key = key;
+	sess->mac = CRYPTO_SHA1_HMAC;
+	sess->mackeylen = MAC_KEY_SIZE;
+	sess->mackey = mac_key;
+	if (ioctl(cfd, CIOCGSESSION, sess)) {
+		my_perror("ioctl(CIOCGSESSION)");
+		return -1;
+	}
+	return 0;
+}
+
+static void fill_data(uint8_t *data)
+{
+	int i;
+
+	for (i = 0; i < DATA_SIZE; i++)
+		data[i] = 'a' + i % 26;
+}
+
+static int check_data(const uint8_t *data)
+{
+	int i;
+
+	for (i = 0; i < DATA_SIZE; i++)
+		if (data[i] != 'a' + i % 26)
+			return 1;
+	return 0;
+}
+
+static int record_op(int cfd, uint32_t ses, int op, uint16_t flags,
+		     uint8_t *hdr, uint8_t *data, uint32_t *len)
+{
+	struct crypt_auth_op cao;
+	uint8_t iv[BLOCK_SIZE];
+	int i;
+
+	for (i = 0; i < BLOCK_SIZE; i++)
+		iv[i] = 0x20 + i;
+
+	memset(&cao, 0, sizeof(cao));
+	cao.ses = ses;
+	cao.op = op;
+	cao.flags = COP_FLAG_AEAD_TLS_TYPE | flags;
+	cao.auth_src = hdr;
+	cao.auth_len = HEADER_SIZE;
+	cao.src = cao.dst = data;
+	cao.len = *len;
+	cao.iv = iv;
+	if (ioctl(cfd, CIOCAUTHCRYPT, &cao))
+		return -1;
+
+	*len = cao.len;
+	return 0;
+}
+
+/* Encrypt a record with encrypt-then-MAC against a known answer, decrypt
+ * it back and check that a modified record is refused.
+ */
+static int test_etm(int cfd)
+{
+	uint8_t hdr[HEADER_SIZE] = { 0, 0, 0, 0, 0, 0, 0, 1, 0x17, 3, 3 };
+	uint8_t data[CT_SIZE + TAG_SIZE];
+	struct session_op sess;
+	uint32_t len;
+
+	if (open_session(cfd, &sess))
+		return 1;
+
+	fill_data(data);
+	len = DATA_SIZE;
+	if (record_op(cfd, sess.ses, COP_ENCRYPT, COP_FLAG_TLS_ETM, hdr, data, &len)) {
+		my_perror("ioctl(CIOCAUTHCRYPT)");
+		return 1;
+	}
+
+	if (len != sizeof(data) || memcmp(data, etm_record, sizeof(data)) != 0 ||
+	    hdr[11] != 0 || hdr[12] != BLOCK_SIZE + CT_SIZE) {
+		printf("Test failed: record mismatch\n");
+		if (debug) {
+			print_buf("Record  : ", data, sizeof(data));
+			print_buf("Expected: ", etm_record, sizeof(data));
+		}
+		return 1;
+	}
+
+	if (record_op(cfd, sess.ses, COP_DECRYPT, COP_FLAG_TLS_ETM, hdr, data, &len)) {
+		my_perror("ioctl(CIOCAUTHCRYPT)");
+		return 1;
+	}
+
+	if (len != DATA_SIZE || check_data(data)) {
+		printf("Test failed: decrypted record mismatch\n");
+		return 1;
+	}
+
+	/* the MAC is checked before the record is decrypted */
+	memcpy(data, etm_record, sizeof(data));
+	data[CT_SIZE - 1] ^= 1;
+	len = sizeof(data);
+	if (record_op(cfd, sess.ses, COP_DECRYPT, COP_FLAG_TLS_ETM, hdr, data, &len) == 0 ||
+	    errno != EBADMSG || memcmp(data, etm_record, CT_SIZE - 1) != 0) {
+		printf("Test failed: modified record accepted\n");
+		return 1;
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		my_perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	if (debug) printf("Test passed\n");
+	return 0;
+}
+
+/* Round trip DTLS records with both MAC orders; the kernel takes the
+ * epoch and sequence number from the DTLS header and sets its length.
+ */
+static int test_dtls(int cfd)
+{
+	static const uint16_t flags[] = { 0, COP_FLAG_TLS_ETM };
+	/* data, MAC and padding, or padded data and MAC; the explicit IV
+	 * is in the length of the header */
+	static const uint32_t lens[] = { 64, CT_SIZE + TAG_SIZE };
+	uint8_t hdr[HEADER_SIZE] = { 0x17, 0xfe, 0xfd, 0, 1, 0, 0, 0, 0, 0, 7 };
+	uint8_t data[CT_SIZE + TAG_SIZE + BLOCK_SIZE];
+	struct session_op sess;
+	uint32_t len;
+	int i;
+
+	if (open_session(cfd, &sess))
+		return 1;
+
+	for (i = 0; i < 2; i++) {
+		fill_data(data);
+		len = DATA_SIZE;
+		if (record_op(cfd, sess.ses, COP_ENCRYPT, COP_FLAG_DTLS | flags[i],
+			      hdr, data, &len)) {
+			my_perror("ioctl(CIOCAUTHCRYPT)");
+			return 1;
+		}
+
+		if (len != lens[i] ||
+		    hdr[11] != 0 || hdr[12] != BLOCK_SIZE + len) {
+			printf("Test failed: DTLS record %d has length %u\n", i, len);
+			return 1;
+		}
+
+		/* another sequence number changes the MAC */
+		hdr[10] ^= 1;
+		if (record_op(cfd, sess.ses, COP_DECRYPT, COP_FLAG_DTLS | flags[i],
+			      hdr, data, &len) == 0 || errno != EBADMSG) {
+			printf("Test failed: DTLS record %d accepted out of order\n", i);
+			return 1;
+		}
+		hdr[10] ^= 1;
+
+		/* the MtE attempt above decrypted the record in place */
+		if (i == 0) {
+			fill_data(data);
+			len = DATA_SIZE;
+			if (record_op(cfd, sess.ses, COP_ENCRYPT, COP_FLAG_DTLS,
+				      hdr, data, &len)) {
+				my_perror("ioctl(CIOCAUTHCRYPT)");
+				return 1;
+			}
+		}
+
+		if (record_op(cfd, sess.ses, COP_DECRYPT, COP_FLAG_DTLS | flags[i],
+			      hdr, data, &len)) {
+			my_perror("ioctl(CIOCAUTHCRYPT)");
+			return 1;
+		}
+
+		if (len != DATA_SIZE || check_data(data)) {
+			printf("Test failed: DTLS record %d mismatch\n", i);
+			return 1;
+		}
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		my_perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	if (debug) printf("Test passed\n");
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int fd = -1, cfd = -1;
+
+	if (argc > 1)
+		debug = 1;
+
+	/* Open the crypto device */
+	fd = open("/dev/crypto", O_RDWR, 0);
+	if (fd < 0) {
+		perror("open(/dev/crypto)");
+		return 1;
+	}
+
+	/* Clone file descriptor */
+	if (ioctl(fd, CRIOGET, &cfd)) {
+		perror("ioctl(CRIOGET)");
+		return 1;
+	}
+
+	/* Set close-on-exec (not really neede here) */
+	if (fcntl(cfd, F_SETFD, 1) == -1) {
+		perror("fcntl(F_SETFD)");
+		return 1;
+	}
+
+	/* Run the test itself */
+	if (test_etm(cfd))
+		return 1;
+
+	if (test_dtls(cfd))
+		return 1;
+
+	/* Close cloned descriptor */
+	if (close(cfd)) {
+		perror("close(cfd)");
+		return 1;
+	}
+
+	/* Close the original descriptor */
+	if (close(fd)) {
+		perror("close(fd)");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,559 @@
+/*
+ * Demo on how to use /dev/crypto device for TLS 1.2 AES-GCM records,
+ * with the explicit nonces and additional data built by the kernel, one
+ * record at a time and many at once.
+ *
+ * Placed under public domain.
+ *
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/ioctl.h>
+#include <crypto/cryptodev.h>
+
+#define	KEY_SIZE	16
+#define	SALT_SIZE	4
+#define	NONCE_SIZE	8
+#define	HEADER_SIZE	5
+#define	DTLS_HEADER_SIZE	13
+#define	TAG_SIZE	16
+#define	DATA_SIZE	37
+#define	FIRST_SEQ	5
+#define	DTLS_EPOCH	1
+#define	BATCH_RECORD	1000
+#define	BATCH_SIZE	3500
+#define	BATCH_RECORDS	4
+#define	OVERHEAD	(HEADER_SIZE + NONCE_SIZE + TAG_SIZE)
+
+#define my_perror(x) {fprintf(stderr, "%s: %d\n", __func__, __LINE__); perror(x); }
+
+static int debug = 0;
+
+static void print_buf(char *desc, const unsigned char *buf, int size)
+{
+	int i;
+	fputs(desc, stdout);
+	for (i = 0; i < size; i++) {
+		printf("%.2x", (uint8_t) buf[i]);
+	}
+	fputs("\n", stdout);
+}
+
+/* key 10..1f, salt 80..83, "abc..." with sequence numbers 5 and 6 */
+static const uint8_t tls12_record1[] =
+	"\x17\x03\x03\x00\x3d\x00\x00\x00\x00\x00\x00\x00\x05\x0e\xc5\xa2"
+	"\xb7\x23\xdb\xb6\xe6\xf2\x78\x88\x64\xdd\x14\xae\x11\x80\x96\x14"
+	"\xa6\xbf\x90\x26\xe3\x88\xcd\x8d\x62\xd1\x49\x89\x19\x55\x00\x45"
+	"\xaf\x8b\xcb\xed\x91\x16\x62\xbd\x1a\x66\xd7\x53\xe3\xba\xe6\xac"
+	"\x9b\x73";
+static const uint8_t tls12_record2[] =
+	"\x15\x03\x03\x00\x3d\x00\x00\x00\x00\x00\x00\x00\x06\x3d\x4a\xc8"
+	"\xe1\x7e\xb6\x56\xa1\x7a\x39\x33\x6f\x44\x45\x54\x16\x8d\xbf\x69"
+	"\xcb\x37\x67\x04\x0e\x4b\xa8\xbe\x18\x70\xcb\xdc\x86\xef\x2b\xc1"
+	"\x01\x58\xb1\xa7\x81\x3b\x07\xbe\x74\xc8\x46\xa5\x78\xdb\x55\x8c"
+	"\x83\x34";
+
+static const uint8_t *records[] = { tls12_record1, tls12_record2 };
+static const uint8_t types[] = { 0x17, 0x15 };
+
+/* the same with a DTLS 1.2 header, epoch 1 and sequence number 5 */
+static const uint8_t dtls12_record[] =
+	"\x17\xfe\xfd\x00\x01\x00\x00\x00\x00\x00\x05\x00\x3d\x00\x01\x00"
+	"\x00\x00\x00\x00\x05\x2d\x33\x40\x2d\x88\xcb\x5e\xef\x29\x7a\xe8"
+	"\x26\x38\x9b\x2c\x3d\x92\x75\x6a\x1a\xcd\xa2\x29\x8a\x66\x36\x21"
+	"\xce\x86\x33\x5b\x0a\xe3\x3a\xa5\xfd\xe5\xa3\x49\xc3\xcb\x04\x22"
+	"\x5d\x04\xd2\xf1\x2a\x11\xa5\xb5\x44\x26";
+
+static int open_session(int cfd, struct session_op *sess, uint64_t seq)
+{
+	struct record_state_op rsop;
+	uint8_t key[KEY_SIZE], salt[SALT_SIZE];
+	int i;
+
+	for (i = 0; i < KEY_SIZE; i++)
+		key[i] = 0x10 + i;
+	for (i = 0; i < SALT_SIZE; i++)
+		salt[i] = 0x80 + i;
+
+	memset(sess, 0, sizeof(*sess));
+	sess->cipher = CRYPTO_AES_GCM;
+	sess->keylen = KEY_SIZE;
+	sess->key = key;
+	if (ioctl(cfd, CIOCGSESSION, sess)) {
+		my_perror("ioctl(CIOCGSESSION)");
+		return -1;
+	}
+
+	memset(&rsop, 0, sizeof(rsop));
+	rsop.ses = sess->ses;
+	rsop.iv = salt;
+	rsop.iv_len = SALT_SIZE;
+	rsop.seq = seq;
+	if (ioctl(cfd, CIOCRECORD, &rsop)) {
+		my_perror("ioctl(CIOCRECORD)");
+		return -1;
+	}
+	return 0;
+}
+
+static int test_tls12_gcm(int cfd)
+{
+	uint8_t record[HEADER_SIZE + NONCE_SIZE + DATA_SIZE + TAG_SIZE];
+	uint8_t *body = record + HEADER_SIZE;
+	uint8_t *data = body + NONCE_SIZE;
+	struct session_op enc, dec;
+	struct crypt_auth_op cao;
+	int i, j;
+
+	if (open_session(cfd, &enc, FIRST_SEQ) ||
+	    open_session(cfd, &dec, FIRST_SEQ))
+		return 1;
+
+	for (i = 0; i < 2; i++) {
+		record[0] = types[i];
+		record[1] = 3;
+		record[2] = 3;
+		for (j = 0; j < DATA_SIZE; j++)
+			data[j] = 'a' + j % 26;
+
+		memset(&cao, 0, sizeof(cao));
+		cao.ses = enc.ses;
+		cao.op = COP_ENCRYPT;
+		cao.flags = COP_FLAG_AEAD_TLS12_GCM_TYPE;
+		cao.auth_src = record;
+		cao.auth_len = HEADER_SIZE;
+		cao.src = cao.dst = body;
+		cao.len = DATA_SIZE;
+		if (ioctl(cfd, CIOCAUTHCRYPT, &cao)) {
+			my_perror("ioctl(CIOCAUTHCRYPT)");
+			return 1;
+		}
+
+		if (cao.len != NONCE_SIZE + DATA_SIZE + TAG_SIZE ||
+		    memcmp(record, records[i], sizeof(record)) != 0) {
+			printf("Test failed: record %d mismatch\n", i);
+			if (debug) {
+				print_buf("Record  : ", record, sizeof(record));
+				print_buf("Expected: ", records[i], sizeof(record));
+			}
+			return 1;
+		}
+	}
+
+	for (i = 0; i < 2; i++) {
+		memcpy(record, records[i], sizeof(record));
+
+		memset(&cao, 0, sizeof(cao));
+		cao.ses = dec.ses;
+		cao.op = COP_DECRYPT;
+		cao.flags = COP_FLAG_AEAD_TLS12_GCM_TYPE;
+		cao.auth_src = record;
+		cao.auth_len = HEADER_SIZE;
+		cao.src = cao.dst = body;
+		cao.len = NONCE_SIZE + DATA_SIZE + TAG_SIZE;
+		if (ioctl(cfd, CIOCAUTHCRYPT, &cao)) {
+			my_perror("ioctl(CIOCAUTHCRYPT)");
+			return 1;
+		}
+
+		if (cao.len != DATA_SIZE) {
+			printf("Test failed: record %d has length %u\n",
+			       i, cao.len);
+			return 1;
+		}
+		for (j = 0; j < DATA_SIZE; j++) {
+			if (data[j] != 'a' + j % 26) {
+				printf("Test failed: record %d data mismatch\n", i);
+				return 1;
+			}
+		}
+	}
+
+	/* a replayed record fails, as the sequence number moved on */
+	memcpy(record, records[1], sizeof(record));
+	cao.ses = dec.ses;
+	cao.len = NONCE_SIZE + DATA_SIZE + TAG_SIZE;
+	if (ioctl(cfd, CIOCAUTHCRYPT, &cao) == 0 || errno != EBADMSG) {
+		printf("Test failed: replayed record accepted\n");
+		return 1;
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &enc.ses) ||
+	    ioctl(cfd, CIOCFSESSION, &dec.ses)) {
+		my_perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	printf("Test passed\n");
+	return 0;
+}
+
+/* DTLS records carry the epoch and sequence number in their header: the
+ * kernel writes them on encryption and reads them on decryption.
+ */
+static int test_dtls12_gcm(int cfd)
+{
+	uint8_t record[DTLS_HEADER_SIZE + NONCE_SIZE + DATA_SIZE + TAG_SIZE];
+	uint8_t *body = record + DTLS_HEADER_SIZE;
+	uint8_t *data = body + NONCE_SIZE;
+	struct session_op sess;
+	struct crypt_auth_op cao;
+	int j;
+
+	if (open_session(cfd, &sess, (uint64_t)DTLS_EPOCH << 48 | FIRST_SEQ))
+		return 1;
+
+	memset(record, 0, DTLS_HEADER_SIZE);
+	record[0] = 0x17;
+	record[1] = 0xfe;
+	record[2] = 0xfd;
+	for (j = 0; j < DATA_SIZE; j++)
+		data[j] = 'a' + j % 26;
+
+	memset(&cao, 0, sizeof(cao));
+	cao.ses = sess.ses;
+	cao.op = COP_ENCRYPT;
+	cao.flags = COP_FLAG_AEAD_TLS12_GCM_TYPE | COP_FLAG_DTLS;
+	cao.auth_src = record;
+	cao.auth_len = DTLS_HEADER_SIZE;
+	cao.src = cao.dst = body;
+	cao.len = DATA_SIZE;
+	if (ioctl(cfd, CIOCAUTHCRYPT, &cao)) {
+		my_perror("ioctl(CIOCAUTHCRYPT)");
+		return 1;
+	}
+
+	if (memcmp(record, dtls12_record, sizeof(record)) != 0) {
+		printf("Test failed: DTLS record mismatch\n");
+		if (debug) {
+			print_buf("Record  : ", record, sizeof(record));
+			print_buf("Expected: ", dtls12_record, sizeof(record));
+		}
+		return 1;
+	}
+
+	/* the session's sequence number doesn't matter when decrypting */
+	cao.op = COP_DECRYPT;
+	cao.len = NONCE_SIZE + DATA_SIZE + TAG_SIZE;
+	if (ioctl(cfd, CIOCAUTHCRYPT, &cao)) {
+		my_perror("ioctl(CIOCAUTHCRYPT)");
+		return 1;
+	}
+
+	if (cao.len != DATA_SIZE || memcmp(data, "abcdefghij", 10) != 0) {
+		printf("Test failed: DTLS record data mismatch\n");
+		return 1;
+	}
+
+	/* the sequence number in the header is authenticated */
+	memcpy(record, dtls12_record, sizeof(record));
+	record[10] ^= 1;
+	cao.len = NONCE_SIZE + DATA_SIZE + TAG_SIZE;
+	if (ioctl(cfd, CIOCAUTHCRYPT, &cao) == 0 || errno != EBADMSG) {
+		printf("Test failed: modified DTLS header accepted\n");
+		return 1;
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		my_perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	printf("Test passed\n");
+	return 0;
+}
+
+/* Seal a plaintext as many records with CIOCTLSBATCH, in place and not,
+ * and compare them with records sealed one at a time.
+ */
+static int test_batch(int cfd)
+{
+	static uint8_t plaintext[BATCH_SIZE];
+	static uint8_t expected[BATCH_SIZE + BATCH_RECORDS * OVERHEAD];
+	static uint8_t records[BATCH_SIZE + BATCH_RECORDS * OVERHEAD];
+	struct session_op one, batch;
+	struct crypt_auth_op cao;
+	struct tls_batch_op tbo;
+	struct record_state_op rsop;
+	uint32_t pos = 0, n;
+	int i, j;
+
+	for (i = 0; i < BATCH_SIZE; i++)
+		plaintext[i] = i * 13;
+
+	if (open_session(cfd, &one, FIRST_SEQ))
+		return 1;
+
+	for (i = 0; i < BATCH_RECORDS; i++) {
+		n = BATCH_SIZE - i * BATCH_RECORD;
+		if (n > BATCH_RECORD)
+			n = BATCH_RECORD;
+
+		expected[pos] = 0x17;
+		expected[pos + 1] = 3;
+		expected[pos + 2] = 3;
+		memcpy(expected + pos + HEADER_SIZE + NONCE_SIZE,
+		       plaintext + i * BATCH_RECORD, n);
+
+		memset(&cao, 0, sizeof(cao));
+		cao.ses = one.ses;
+		cao.op = COP_ENCRYPT;
+		cao.flags = COP_FLAG_AEAD_TLS12_GCM_TYPE;
+		cao.auth_src = expected + pos;
+		cao.auth_len = HEADER_SIZE;
+		cao.src = cao.dst = expected + pos + HEADER_SIZE;
+		cao.len = n;
+		if (ioctl(cfd, CIOCAUTHCRYPT, &cao)) {
+			my_perror("ioctl(CIOCAUTHCRYPT)");
+			return 1;
+		}
+		pos += HEADER_SIZE + cao.len;
+	}
+
+	/* each batch in a session of its own, as sequence numbers cannot
+	 * be rewound */
+	for (j = 0; j < 2; j++) {
+		if (open_session(cfd, &batch, FIRST_SEQ))
+			return 1;
+
+		memset(&tbo, 0, sizeof(tbo));
+		tbo.ses = batch.ses;
+		tbo.flags = COP_FLAG_AEAD_TLS12_GCM_TYPE;
+		tbo.type = 0x17;
+		tbo.len = BATCH_SIZE;
+		tbo.max_record = BATCH_RECORD;
+		tbo.dst = records;
+		if (j == 0) {
+			memcpy(records, plaintext, BATCH_SIZE);
+			tbo.src = records;
+		} else {
+			tbo.src = plaintext;
+		}
+		if (ioctl(cfd, CIOCTLSBATCH, &tbo)) {
+			my_perror("ioctl(CIOCTLSBATCH)");
+			return 1;
+		}
+
+		if (tbo.records != BATCH_RECORDS || tbo.len != sizeof(expected) ||
+		    memcmp(records, expected, sizeof(expected)) != 0) {
+			printf("Test failed: batch %d mismatch\n", j);
+			return 1;
+		}
+
+		if (ioctl(cfd, CIOCFSESSION, &batch.ses)) {
+			my_perror("ioctl(CIOCFSESSION)");
+			return 1;
+		}
+	}
+
+	/* nor can the record state be set again to reuse a nonce */
+	memset(&rsop, 0, sizeof(rsop));
+	rsop.ses = one.ses;
+	rsop.iv = (uint8_t *)"\x80\x81\x82\x83";
+	rsop.iv_len = SALT_SIZE;
+	rsop.seq = FIRST_SEQ;
+	if (ioctl(cfd, CIOCRECORD, &rsop) == 0 || errno != EBUSY) {
+		printf("Test failed: sequence number rewound\n");
+		return 1;
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &one.ses)) {
+		my_perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	printf("Test passed\n");
+	return 0;
+}
+
+/* A batch that fails leaves an in-place plaintext untouched if the session
+ * cannot seal records at all, and otherwise reports the records sealed.
+ */
+static int test_batch_failure(int cfd)
+{
+	static uint8_t plaintext[BATCH_SIZE];
+	static uint8_t records[BATCH_SIZE + BATCH_RECORDS * OVERHEAD];
+	struct session_op sess;
+	struct tls_batch_op tbo;
+	uint8_t key[KEY_SIZE];
+	int i;
+
+	for (i = 0; i < BATCH_SIZE; i++)
+		plaintext[i] = i * 13;
+
+	/* no record state */
+	memset(key, 0x10, sizeof(key));
+	memset(&sess, 0, sizeof(sess));
+	sess.cipher = CRYPTO_AES_GCM;
+	sess.keylen = KEY_SIZE;
+	sess.key = key;
+	if (ioctl(cfd, CIOCGSESSION, &sess)) {
+		my_perror("ioctl(CIOCGSESSION)");
+		return 1;
+	}
+
+	memcpy(records, plaintext, BATCH_SIZE);
+	memset(&tbo, 0, sizeof(tbo));
+	tbo.ses = sess.ses;
+	tbo.flags = COP_FLAG_AEAD_TLS12_GCM_TYPE;
+	tbo.type = 0x17;
+	tbo.len = BATCH_SIZE;
+	tbo.max_record = BATCH_RECORD;
+	tbo.src = tbo.dst = records;
+	if (ioctl(cfd, CIOCTLSBATCH, &tbo) == 0 || errno != EINVAL ||
+	    tbo.records != 0 || memcmp(records, plaintext, BATCH_SIZE) != 0) {
+		printf("Test failed: batch without record state\n");
+		return 1;
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		my_perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	/* the sequence number runs out at the third record */
+	if (open_session(cfd, &sess, ~0ULL - 2))
+		return 1;
+
+	memset(&tbo, 0, sizeof(tbo));
+	tbo.ses = sess.ses;
+	tbo.flags = COP_FLAG_AEAD_TLS12_GCM_TYPE;
+	tbo.type = 0x17;
+	tbo.len = BATCH_SIZE;
+	tbo.max_record = BATCH_RECORD;
+	tbo.src = plaintext;
+	tbo.dst = records;
+	if (ioctl(cfd, CIOCTLSBATCH, &tbo) == 0 || errno != EOVERFLOW ||
+	    tbo.records != 2 || tbo.len != 2 * (BATCH_RECORD + OVERHEAD)) {
+		printf("Test failed: %u sealed records reported\n", tbo.records);
+		return 1;
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		my_perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	if (debug) printf("Test passed\n");
+	return 0;
+}
+
+/* ChaCha20-Poly1305 also has a 12-byte nonce, but not the TLS 1.2 GCM
+ * one, so its sessions are refused.
+ */
+static int test_not_gcm(int cfd)
+{
+	uint8_t record[HEADER_SIZE + NONCE_SIZE + DATA_SIZE + TAG_SIZE];
+	uint8_t key[32];
+	struct session_op sess;
+	struct record_state_op rsop;
+	struct crypt_auth_op cao;
+
+	memset(key, 0x10, sizeof(key));
+	memset(&sess, 0, sizeof(sess));
+	sess.cipher = CRYPTO_CHACHA20_POLY1305;
+	sess.keylen = sizeof(key);
+	sess.key = key;
+	if (ioctl(cfd, CIOCGSESSION, &sess)) {
+		my_perror("ioctl(CIOCGSESSION)");
+		return 1;
+	}
+
+	memset(&rsop, 0, sizeof(rsop));
+	rsop.ses = sess.ses;
+	rsop.iv = (uint8_t *)"\x80\x81\x82\x83";
+	rsop.iv_len = SALT_SIZE;
+	rsop.seq = FIRST_SEQ;
+	if (ioctl(cfd, CIOCRECORD, &rsop)) {
+		my_perror("ioctl(CIOCRECORD)");
+		return 1;
+	}
+
+	memset(record, 0, sizeof(record));
+	record[0] = 0x17;
+	record[1] = 3;
+	record[2] = 3;
+
+	memset(&cao, 0, sizeof(cao));
+	cao.ses = sess.ses;
+	cao.op = COP_ENCRYPT;
+	cao.flags = COP_FLAG_AEAD_TLS12_GCM_TYPE;
+	cao.auth_src = record;
+	cao.auth_len = HEADER_SIZE;
+	cao.src = cao.dst = record + HEADER_SIZE;
+	cao.len = DATA_SIZE;
+	if (ioctl(cfd, CIOCAUTHCRYPT, &cao) == 0 || errno != EINVAL) {
+		printf("Test failed: ChaCha20-Poly1305 accepted as GCM\n");
+		return 1;
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &sess.ses)) {
+		my_perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	if (debug) printf("Test passed\n");
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int fd = -1, cfd = -1;
+
+	if (argc > 1)
+		debug = 1;
+
+	/* Open the crypto device */
+	fd = open("/dev/crypto", O_RDWR, 0);
+	if (fd < 0) {
+		perror("open(/dev/crypto)");
+		return 1;
+	}
+
+	/* Clone file descriptor */
+	if (ioctl(fd, CRIOGET, &cfd)) {
+		perror("ioctl(CRIOGET)");
+		return 1;
+	}
+
+	/* Set close-on-exec (not really neede here) */
+	if (fcntl(cfd, F_SETFD, 1) == -1) {
+		perror("fcntl(F_SETFD)");
+		return 1;
+	}
+
+	/* Run the test itself */
+	if (test_tls12_gcm(cfd))
+		return 1;
+
+	if (test_dtls12_gcm(cfd))
+		return 1;
+
+	if (test_batch(cfd))
+		return 1;
+
+	if (test_batch_failure(cfd))
+		return 1;
+
+	if (test_not_gcm(cfd))
+		return 1;
+
+	/* Close cloned descriptor */
+	if (close(cfd)) {
+		perror("close(cfd)");
+		return 1;
+	}
+
+	/* Close the original descriptor */
+	if (close(fd)) {
+		perror("close(fd)");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,217 @@
+/*
+ * Demo on how to use /dev/crypto device for TLS 1.3 records with
+ * AES-GCM, with the nonces and headers built by the kernel.
+ *
+ * Placed under public domain.
+ *
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/ioctl.h>
+#include <crypto/cryptodev.h>
+
+#define	KEY_SIZE	16
+#define	IV_SIZE		12
+#define	HEADER_SIZE	5
+#define	TAG_SIZE	16
+#define	DATA_SIZE	37
+#define	FIRST_SEQ	5
+
+#define my_perror(x) {fprintf(stderr, "%s: %d\n", __func__, __LINE__); perror(x); }
+
+static int debug = 0;
+
+static void print_buf(char *desc, const unsigned char *buf, int size)
+{
+	int i;
+	fputs(desc, stdout);
+	for (i = 0; i < size; i++) {
+		printf("%.2x", (uint8_t) buf[i]);
+	}
+	fputs("\n", stdout);
+}
+
+/* key 10..1f, static IV 80..8b, "abc..." with sequence numbers 5 and 6 */
+static const uint8_t tls13_record1[] =
+	"\x17\x03\x03\x00\x36\x7f\x78\xe6\x3d\x8f\x87\x24\xa7\x03\xed\x97"
+	"\x3b\x94\x5e\x00\xf3\x10\x91\xf0\x8d\x87\x18\x8c\xe0\x32\x5b\x29"
+	"\x4a\x97\x79\x7a\x9f\x3a\xac\x87\x4b\x34\x0f\xde\x86\x6e\x08\x30"
+	"\xea\x5f\xe6\xf9\x6b\x37\xef\xbc\x05\xf3\x00";
+static const uint8_t tls13_record2[] =
+	"\x17\x03\x03\x00\x36\xa4\xa8\x3b\x5d\xac\x5f\x93\x57\x5e\x0b\x89"
+	"\xc4\xc8\x93\x26\x20\xd8\xf7\x68\xb9\xbb\xe4\x05\x67\x69\x90\x74"
+	"\x02\x6f\xb0\x2a\x4f\xde\xad\x3d\xbb\x31\xcd\x54\x38\x32\x2d\x8d"
+	"\xb9\x6a\x9d\xcb\xa2\xbc\x65\xdf\x7f\x2d\x93";
+
+static const uint8_t *records[] = { tls13_record1, tls13_record2 };
+static const uint8_t types[] = { 0x17, 0x16 };
+
+static int open_session(int cfd, struct session_op *sess)
+{
+	struct record_state_op rsop;
+	uint8_t key[KEY_SIZE], iv[IV_SIZE];
+	int i;
+
+	for (i = 0; i < KEY_SIZE; i++)
+		key[i] = 0x10 + i;
+	for (i = 0; i < IV_SIZE; i++)
+		iv[i] = 0x80 + i;
+
+	memset(sess, 0, sizeof(*sess));
+	sess->cipher = CRYPTO_AES_GCM;
+	sess->keylen = KEY_SIZE;
+	sess->key = key;
+	if (ioctl(cfd, CIOCGSESSION, sess)) {
+		my_perror("ioctl(CIOCGSESSION)");
+		return -1;
+	}
+
+	memset(&rsop, 0, sizeof(rsop));
+	rsop.ses = sess->ses;
+	rsop.iv = iv;
+	rsop.iv_len = IV_SIZE;
+	rsop.seq = FIRST_SEQ;
+	if (ioctl(cfd, CIOCRECORD, &rsop)) {
+		my_perror("ioctl(CIOCRECORD)");
+		return -1;
+	}
+	return 0;
+}
+
+static int test_tls13(int cfd)
+{
+	uint8_t record[HEADER_SIZE + DATA_SIZE + 1 + TAG_SIZE];
+	uint8_t *data = record + HEADER_SIZE;
+	struct session_op enc, dec;
+	struct crypt_auth_op cao;
+	int i, j;
+
+	if (open_session(cfd, &enc) || open_session(cfd, &dec))
+		return 1;
+
+	for (i = 0; i < 2; i++) {
+		record[0] = types[i];
+		for (j = 0; j < DATA_SIZE; j++)
+			data[j] = 'a' + j % 26;
+
+		memset(&cao, 0, sizeof(cao));
+		cao.ses = enc.ses;
+		cao.op = COP_ENCRYPT;
+		cao.flags = COP_FLAG_AEAD_TLS13_TYPE;
+		cao.auth_src = record;
+		cao.auth_len = HEADER_SIZE;
+		cao.src = cao.dst = data;
+		cao.len = DATA_SIZE;
+		if (ioctl(cfd, CIOCAUTHCRYPT, &cao)) {
+			my_perror("ioctl(CIOCAUTHCRYPT)");
+			return 1;
+		}
+
+		if (cao.len != DATA_SIZE + 1 + TAG_SIZE ||
+		    memcmp(record, records[i], sizeof(record)) != 0) {
+			printf("Test failed: record %d mismatch\n", i);
+			if (debug) {
+				print_buf("Record  : ", record, sizeof(record));
+				print_buf("Expected: ", records[i], sizeof(record));
+			}
+			return 1;
+		}
+	}
+
+	for (i = 0; i < 2; i++) {
+		memcpy(record, records[i], sizeof(record));
+
+		memset(&cao, 0, sizeof(cao));
+		cao.ses = dec.ses;
+		cao.op = COP_DECRYPT;
+		cao.flags = COP_FLAG_AEAD_TLS13_TYPE;
+		cao.auth_src = record;
+		cao.auth_len = HEADER_SIZE;
+		cao.src = cao.dst = data;
+		cao.len = DATA_SIZE + 1 + TAG_SIZE;
+		if (ioctl(cfd, CIOCAUTHCRYPT, &cao)) {
+			my_perror("ioctl(CIOCAUTHCRYPT)");
+			return 1;
+		}
+
+		if (cao.len != DATA_SIZE || record[0] != types[i]) {
+			printf("Test failed: record %d has length %u, type %u\n",
+			       i, cao.len, record[0]);
+			return 1;
+		}
+		for (j = 0; j < DATA_SIZE; j++) {
+			if (data[j] != 'a' + j % 26) {
+				printf("Test failed: record %d data mismatch\n", i);
+				return 1;
+			}
+		}
+	}
+
+	/* a replayed record fails, as the sequence number moved on */
+	memcpy(record, records[1], sizeof(record));
+	cao.ses = dec.ses;
+	cao.len = DATA_SIZE + 1 + TAG_SIZE;
+	if (ioctl(cfd, CIOCAUTHCRYPT, &cao) == 0 || errno != EBADMSG) {
+		printf("Test failed: replayed record accepted\n");
+		return 1;
+	}
+
+	if (ioctl(cfd, CIOCFSESSION, &enc.ses) ||
+	    ioctl(cfd, CIOCFSESSION, &dec.ses)) {
+		my_perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	printf("Test passed\n");
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int fd = -1, cfd = -1;
+
+	if (argc > 1)
+		debug = 1;
+
+	/* Open the crypto device */
+	fd = open("/dev/crypto", O_RDWR, 0);
+	if (fd < 0) {
+		perror("open(/dev/crypto)");
+		return 1;
+	}
+
+	/* Clone file descriptor */
+	if (ioctl(fd, CRIOGET, &cfd)) {
+		perror("ioctl(CRIOGET)");
+		return 1;
+	}
+
+	/* Set close-on-exec (not really neede here) */
+	if (fcntl(cfd, F_SETFD, 1) == -1) {
+		perror("fcntl(F_SETFD)");
+		return 1;
+	}
+
+	/* Run the test itself */
+	if (test_tls13(cfd))
+		return 1;
+
+	/* Close cloned descriptor */
+	if (close(cfd)) {
+		perror("close(cfd)");
+		return 1;
+	}
+
+	/* Close the original descriptor */
+	if (close(fd)) {
+		perror("close(fd)");
+		return 1;
+	}
+
+	return 0;
+}
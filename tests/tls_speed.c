@@ -0,0 +1,232 @@
+/*  tls_speed - TLS MAC-then-encrypt record benchmark for cryptodev
+ *
+ *    Based on aead_speed.c, Copyright (C) 2010 by Phil Sutter <phil.sutter@viprinet.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <signal.h>
+
+#include <crypto/cryptodev.h>
+
+/* the module parameter setting how much of a record is hashed and
+ * encrypted at a time when there is no fused driver */
+#define CHUNK_PARAM "/sys/module/cryptodev/parameters/cryptodev_chunk_size"
+
+static int si = 1; /* SI by default */
+
+static double udifftimeval(struct timeval start, struct timeval end)
+{
+	return (double)(end.tv_usec - start.tv_usec) +
+	       (double)(end.tv_sec - start.tv_sec) * 1000 * 1000;
+}
+
+static volatile int must_finish;
+
+static void alarm_handler(int signo)
+{
+        must_finish = 1;
+}
+
+static char *units[] = { "", "Ki", "Mi", "Gi", "Ti", 0};
+static char *si_units[] = { "", "K", "M", "G", "T", 0};
+
+static void value2human(int si, double bytes, double time, double* data, double* speed,char* metric)
+{
+	int unit = 0;
+
+	*data = bytes;
+
+	if (si) {
+		while (*data > 1000 && si_units[unit + 1]) {
+			*data /= 1000;
+			unit++;
+		}
+		*speed = *data / time;
+		sprintf(metric, "%sB", si_units[unit]);
+	} else {
+		while (*data > 1024 && units[unit + 1]) {
+			*data /= 1024;
+			unit++;
+		}
+		*speed = *data / time;
+		sprintf(metric, "%sB", units[unit]);
+	}
+}
+
+#define BLOCK_SIZE 16
+#define TAG_SIZE 32
+
+int encrypt_records(struct session_op *sess, int fdc, int recsize)
+{
+	struct crypt_auth_op cao;
+	char *buffer, iv[BLOCK_SIZE], auth[13];
+	static int val = 23;
+	struct timeval start, end;
+	double total = 0;
+	double secs, ddata, dspeed;
+	char metric[16];
+
+	if (!(buffer = malloc(recsize + TAG_SIZE + BLOCK_SIZE))) {
+		perror("malloc()");
+		return 1;
+	}
+
+	memset(iv, 0x23, sizeof(iv));
+	memset(auth, 0x17, sizeof(auth));
+
+	printf("\tEncrypting records of %d bytes: ", recsize);
+	fflush(stdout);
+
+	memset(buffer, val++, recsize);
+
+	must_finish = 0;
+	alarm(5);
+
+	gettimeofday(&start, NULL);
+	do {
+		memset(&cao, 0, sizeof(cao));
+		cao.ses = sess->ses;
+		cao.auth_src = (unsigned char *)auth;
+		cao.auth_len = sizeof(auth);
+		cao.len = recsize;
+		cao.iv = (unsigned char *)iv;
+		cao.op = COP_ENCRYPT;
+		cao.flags = COP_FLAG_AEAD_TLS_TYPE;
+		cao.src = cao.dst = (unsigned char *)buffer;
+
+		if (ioctl(fdc, CIOCAUTHCRYPT, &cao)) {
+			perror("ioctl(CIOCAUTHCRYPT)");
+			return 1;
+		}
+		total+=recsize;
+	} while(must_finish==0);
+	gettimeofday(&end, NULL);
+
+	secs = udifftimeval(start, end)/ 1000000.0;
+
+	value2human(si, total, secs, &ddata, &dspeed, metric);
+	printf ("done. %.2f %s in %.2f secs: ", ddata, metric, secs);
+	printf ("%.2f %s/sec\n", dspeed, metric);
+
+	free(buffer);
+	return 0;
+}
+
+static int test_tls(int fdc)
+{
+	struct session_op sess;
+	char keybuf[16], mackeybuf[32];
+	int i;
+
+	memset(&sess, 0, sizeof(sess));
+	sess.cipher = CRYPTO_AES_CBC;
+	sess.keylen = sizeof(keybuf);
+	memset(keybuf, 0x42, sizeof(keybuf));
+	sess.key = (unsigned char *)keybuf;
+	sess.mac = CRYPTO_SHA2_256_HMAC;
+	sess.mackeylen = sizeof(mackeybuf);
+	memset(mackeybuf, 0x0b, sizeof(mackeybuf));
+	sess.mackey = (unsigned char *)mackeybuf;
+	if (ioctl(fdc, CIOCGSESSION, &sess)) {
+		perror("ioctl(CIOCGSESSION)");
+		return 1;
+	}
+
+	for (i = 1024; i <= (16 * 1024); i *= 2) {
+		if (encrypt_records(&sess, fdc, i))
+			break;
+	}
+
+	if (ioctl(fdc, CIOCFSESSION, &sess.ses)) {
+		perror("ioctl(CIOCFSESSION)");
+		return 1;
+	}
+
+	return 0;
+}
+
+static int set_chunk_size(const char *size)
+{
+	FILE *fp;
+	int ret;
+
+	if (!(fp = fopen(CHUNK_PARAM, "w")))
+		return -1;
+	ret = fputs(size, fp) < 0;
+	if (fclose(fp))
+		ret = -1;
+	return ret;
+}
+
+int main(int argc, char** argv)
+{
+	char chunk_size[16] = "";
+	FILE *fp;
+	int fd, fdc = -1;
+
+	signal(SIGALRM, alarm_handler);
+
+	if (argc > 1) {
+		if (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0) {
+			printf("Usage: tls_speed [--kib]\n");
+			exit(0);
+		}
+		if (strcmp(argv[1], "--kib") == 0) {
+			si = 0;
+		}
+	}
+
+	if ((fd = open("/dev/crypto", O_RDWR, 0)) < 0) {
+		perror("open()");
+		return 1;
+	}
+	if (ioctl(fd, CRIOGET, &fdc)) {
+		perror("ioctl(CRIOGET)");
+		return 1;
+	}
+
+	if ((fp = fopen(CHUNK_PARAM, "r"))) {
+		if (!fgets(chunk_size, sizeof(chunk_size), fp))
+			chunk_size[0] = 0;
+		chunk_size[strcspn(chunk_size, "\n")] = 0;
+		fclose(fp);
+	}
+
+	/* compare with hashing and encrypting whole records, if allowed */
+	if (chunk_size[0] && set_chunk_size("0") == 0) {
+		fprintf(stderr, "\nTesting AES-128-CBC-HMAC-SHA256, whole records: \n");
+		test_tls(fdc);
+		set_chunk_size(chunk_size);
+	}
+
+	if (chunk_size[0])
+		fprintf(stderr, "\nTesting AES-128-CBC-HMAC-SHA256, chunks of %s bytes: \n",
+			chunk_size);
+	else
+		fprintf(stderr, "\nTesting AES-128-CBC-HMAC-SHA256: \n");
+	test_tls(fdc);
+
+	close(fdc);
+	close(fd);
+	return 0;
+}